@@ -0,0 +1,42 @@
+#!/bin/bash
+# This script builds project and measures how command buffer recording time
+# scales with recording thread count
+#
+# Args:
+# --draws:<value>        [OPTIONAL]        draw calls per frame
+# --frames:<value>       [OPTIONAL]        frames per run
+# --build:<value>        [OPTIONAL]        set build dir
+
+SCRIPT_DIR="$(dirname "$(realpath "$0")")"
+cd "$SCRIPT_DIR" || exit 1
+
+BUILD_DIR="./build/"
+DRAWS=100000
+FRAMES=100
+THREAD_COUNTS=(0 1 2 4 8 16)
+
+SET_BUILD_DIR=""
+for arg in "$@"; do
+    if [[ $arg == --draws:* ]]; then
+        DRAWS="${arg#--draws:}"
+    fi
+    if [[ $arg == --frames:* ]]; then
+        FRAMES="${arg#--frames:}"
+    fi
+    if [[ $arg == --build:* ]]; then
+        SET_BUILD_DIR="$arg"
+        BUILD_DIR="${arg#--build:}/"
+    fi
+done
+
+# Build
+./build.sh --target:vulkan_test ${SET_BUILD_DIR} || exit 1
+
+# Run
+echo "threads,avg_record_ms"
+for threads in "${THREAD_COUNTS[@]}"; do
+    result=$(${BUILD_DIR}vulkan_test --headless --pipeline-cache: \
+        --frames:"${FRAMES}" --draws:"${DRAWS}" --threads:"${threads}" |
+        sed -n 's/^Average command buffer recording time: \([0-9.e+-]*\) ms.*/\1/p') || exit 1
+    echo "${threads},${result}"
+done
@@ -4,29 +4,33 @@
 # Args:
 # --target:<value>       [OPTIONAL]        build selected target
 # --build:<value>        [OPTIONAL]        set build dir
+#
+# All other args are passed to the target
 
 SCRIPT_DIR="$(dirname "$(realpath "$0")")"
 cd "$SCRIPT_DIR" || exit 1
 
 BUILD_DIR="./build/"
 TARGET="vulkan_test"
-RUN_TARGET=${BUILD_DIR}${TARGET}
 
 SET_TARGET=""
 SET_BUILD_DIR=""
+RUN_ARGS=()
 for arg in "$@"; do
     if [[ $arg == --target:* ]]; then
         SET_TARGET="$arg"
         TARGET="${arg#--target:}"
-    fi
-    if [[ $arg == --build:* ]]; then
+    elif [[ $arg == --build:* ]]; then
         SET_BUILD_DIR="$arg"
-        BUILD_DIR="${arg#--build:}"
+        BUILD_DIR="${arg#--build:}/"
+    else
+        RUN_ARGS+=("$arg")
     fi
 done
+RUN_TARGET=${BUILD_DIR}${TARGET}
 
 # Build
 ./build.sh ${SET_TARGET} ${SET_BUILD_DIR} || exit 1
 
 # Run
-${RUN_TARGET} || exit 1
+${RUN_TARGET} "${RUN_ARGS[@]}" || exit 1
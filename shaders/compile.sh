@@ -1,7 +1,12 @@
 #!/bin/bash
+# Compiles shaders into shaders/*.spv without CMake. CMake builds already do
+# that with the glslc they found, see CMakeLists.txt
 
 SCRIPT_DIR="$(dirname "$(realpath "$0")")"
 cd "$SCRIPT_DIR" || exit 1
 
 glslc shader.vert -o vert.spv
 glslc shader.frag -o frag.spv
+glslc cull.comp -o cull.spv
+glslc mesh.vert -o mesh.spv
+glslc color.frag -o color.spv
@@ -0,0 +1,55 @@
+#version 450
+
+// Per instance attributes, see InstanceBuffer
+layout(location = 0) in vec2 inOffset;
+layout(location = 1) in float inScale;
+layout(location = 2) in float inRotation;
+layout(location = 3) in vec4 inColor;
+
+// Quantized mesh vertex, see QuantizedVertex and MeshBuffer
+layout(location = 4) in vec4 inPosition;
+layout(location = 5) in vec2 inNormal;
+layout(location = 6) in vec2 inUv;
+
+// Values shared by every draw of a frame, see FrameUniforms
+layout(set = 1, binding = 0) uniform FrameData {
+    vec2 viewportSize;
+    float timeSeconds;
+    uint frameNumber;
+    // Instance offsets to clip space, keeps instances square
+    vec2 viewScale;
+} frame;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragUv;
+
+const vec3 kLightDirection = vec3(0.4, 0.6, 0.7);
+const float kAmbient = 0.25;
+
+// Inverse of encodeOctahedral() in src/mesh.hpp
+vec3 decodeOctahedral(vec2 encoded) {
+    vec3 normal = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    float fold = max(-normal.z, 0.0);
+    normal.x += normal.x >= 0.0 ? -fold : fold;
+    normal.y += normal.y >= 0.0 ? -fold : fold;
+    return normalize(normal);
+}
+
+void main() {
+    float s = sin(inRotation);
+    float c = cos(inRotation);
+
+    // Mesh fills [-1, 1], scale it onto the square of the triangle in
+    // shader.vert. Mesh y points up, clip space y down
+    vec3 position = inPosition.xyz * 0.5;
+    vec2 rotated = mat2(c, s, -s, c) * vec2(position.x, -position.y);
+
+    // Positive z faces the viewer and is closer
+    gl_Position = vec4((rotated * inScale + inOffset) * frame.viewScale,
+                       0.5 - position.z, 1.0);
+
+    vec3 normal = decodeOctahedral(inNormal);
+    float diffuse = max(dot(normal, normalize(kLightDirection)), 0.0);
+    fragColor = inColor.rgb * (kAmbient + (1.0 - kAmbient) * diffuse);
+    fragUv = inUv;
+}
@@ -1,6 +1,28 @@
 #version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+// Bindless heap arrays, see BindlessHeap::Kind
+layout(set = 0, binding = 0) uniform texture2D textures[];
+layout(set = 0, binding = 2) uniform sampler samplers[];
+
+// Heap slots of a draw, see DrawConstants
+layout(push_constant) uniform DrawConstants {
+    uint textureSlot;
+    uint samplerSlot;
+} draw;
+
+const uint kInvalidSlot = 0xFFFFFFFFu;
 
 layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec2 fragUv;
 layout(location = 0) out vec4 outColor;
 
-void main() { outColor = vec4(fragColor, 1.0); }
+void main() {
+    vec3 color = fragColor;
+    if (draw.textureSlot != kInvalidSlot) {
+        color *= texture(sampler2D(textures[draw.textureSlot],
+                                   samplers[draw.samplerSlot]),
+                         fragUv).rgb;
+    }
+    outColor = vec4(color, 1.0);
+}
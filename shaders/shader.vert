@@ -1,12 +1,34 @@
 #version 450
 
+// Per instance attributes, see InstanceBuffer
+layout(location = 0) in vec2 inOffset;
+layout(location = 1) in float inScale;
+layout(location = 2) in float inRotation;
+layout(location = 3) in vec4 inColor;
+
+// Values shared by every draw of a frame, see FrameUniforms
+layout(set = 1, binding = 0) uniform FrameData {
+    vec2 viewportSize;
+    float timeSeconds;
+    uint frameNumber;
+    // Instance offsets to clip space, keeps instances square
+    vec2 viewScale;
+} frame;
+
 layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragUv;
 
 vec2 positions[3] = vec2[](vec2(0.0, -0.5), vec2(0.5, 0.5), vec2(-0.5, 0.5));
 vec3 colors[3] =
     vec3[](vec3(1.0, 0.0, 0.0), vec3(0.0, 1.0, 0.0), vec3(0.0, 0.0, 1.0));
 
 void main() {
-    gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
-    fragColor = colors[gl_VertexIndex];
+    float s = sin(inRotation);
+    float c = cos(inRotation);
+    vec2 position = mat2(c, s, -s, c) * positions[gl_VertexIndex];
+
+    gl_Position =
+        vec4((position * inScale + inOffset) * frame.viewScale, 0.0, 1.0);
+    fragColor = colors[gl_VertexIndex] * inColor.rgb;
+    fragUv = positions[gl_VertexIndex] + 0.5;
 }
@@ -0,0 +1,307 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include "mapped_file.hpp"
+
+// Binary asset container, read through a memory mapping:
+//
+//   PackHeader
+//   PackEntry[tableSize]  hash table of contents, open addressing
+//   names                 concatenated, not null terminated
+//   blobs                 each kBlobAlignment aligned
+//
+// All integers are little endian. A lookup hashes the name and probes
+// linearly from its bucket until an empty entry, so opening a pack reads
+// no table and finding an asset touches one or two cache lines. Blobs are
+// returned as spans of the mapping, so uploads copy them straight from page
+// cache into staging memory
+namespace asset_pack {
+
+static_assert(std::endian::native == std::endian::little,
+              "Asset packs are little endian");
+
+inline constexpr std::array<char, 8> kMagic{'V', 'K', 'T', 'P',
+                                            'A', 'C', 'K', '\0'};
+inline constexpr uint32_t kVersion{1};
+// Enough for SPIR-V words and any vertex attribute, and blobs never share a
+// cache line
+inline constexpr uint64_t kBlobAlignment{64};
+
+enum class AssetType : uint8_t {
+    kRaw,
+    // Whole SPIR-V module, size is a multiple of 4
+    kSpirv,
+    // Quantized mesh, see writeMeshAsset() in src/mesh.hpp
+    kMesh,
+};
+
+struct PackHeader {
+    std::array<char, 8> magic{};
+    uint32_t version{};
+    uint32_t entryCount{};
+    // Power of two, at least twice entryCount so probes stay short
+    uint32_t tableSize{};
+    uint32_t reserved{};
+    uint64_t namesOffset{};
+    uint64_t fileSize{};
+};
+static_assert(sizeof(PackHeader) == 40);
+
+struct PackEntry {
+    uint64_t nameHash{};
+    uint64_t offset{};
+    uint64_t size{};
+    uint32_t nameOffset{};
+    // 0 marks an empty bucket, names are never empty
+    uint16_t nameLength{};
+    AssetType type{};
+    uint8_t reserved{};
+};
+static_assert(sizeof(PackEntry) == 32);
+
+// 64-bit FNV-1a
+inline uint64_t hashName(std::string_view name) {
+    uint64_t hash{0xCBF29CE484222325ULL};
+    for (char c : name) {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+inline uint64_t alignUp(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+}  // namespace asset_pack
+
+// Read only view of an asset pack file. Header and table bounds are checked
+// on open, every entry when it is looked up. Returned spans stay valid as
+// long as the pack
+class AssetPack {
+   public:
+    struct Asset {
+        asset_pack::AssetType type{};
+        std::span<const std::byte> data{};
+    };
+
+    explicit AssetPack(const std::string& path) : file_{path}, path_{path} {
+        using asset_pack::PackEntry;
+        using asset_pack::PackHeader;
+
+        if (file_.size() < sizeof(PackHeader)) {
+            throw std::runtime_error{"Invalid asset pack: " + path};
+        }
+        std::memcpy(&header_, file_.data(), sizeof(header_));
+
+        uint64_t table_end{sizeof(PackHeader) +
+                           uint64_t{header_.tableSize} * sizeof(PackEntry)};
+        if (header_.magic != asset_pack::kMagic ||
+            header_.version != asset_pack::kVersion ||
+            header_.fileSize != file_.size() ||
+            !std::has_single_bit(header_.tableSize) ||
+            header_.entryCount > header_.tableSize / 2 ||
+            header_.namesOffset < table_end ||
+            header_.namesOffset > file_.size()) {
+            throw std::runtime_error{"Invalid asset pack: " + path};
+        }
+    }
+
+    AssetPack(const AssetPack&) = delete;
+    AssetPack& operator=(const AssetPack&) = delete;
+    AssetPack(AssetPack&&) = delete;
+    AssetPack& operator=(AssetPack&&) = delete;
+
+    uint32_t size() const { return header_.entryCount; }
+
+    std::optional<Asset> find(std::string_view name) const {
+        uint64_t hash{asset_pack::hashName(name)};
+        uint32_t mask{header_.tableSize - 1};
+        auto bucket{static_cast<uint32_t>(hash) & mask};
+        // Bounded, so a corrupt table without empty buckets can not hang
+        for (uint32_t probe{}; probe < header_.tableSize;
+             ++probe, bucket = (bucket + 1) & mask) {
+            asset_pack::PackEntry entry{readEntry(bucket)};
+            if (entry.nameLength == 0) {
+                return std::nullopt;
+            }
+            if (entry.nameHash == hash && entryName(entry) == name) {
+                return Asset{entry.type,
+                             file_.bytes().subspan(entry.offset, entry.size)};
+            }
+        }
+        return std::nullopt;
+    }
+    Asset get(std::string_view name) const {
+        std::optional<Asset> asset{find(name)};
+        if (!asset) {
+            throw std::runtime_error{"Asset " + std::string{name} +
+                                     " not found in " + path_};
+        }
+        return *asset;
+    }
+
+    // Starts reading pages of asset in the background, so a later first
+    // touch does not block on disk
+    void prefetch(const Asset& asset) const { file_.prefetch(asset.data); }
+
+   private:
+    // Table starts right after the 40 byte header, so entries are read with
+    // memcpy instead of through a misaligned pointer
+    asset_pack::PackEntry readEntry(uint32_t bucket) const {
+        asset_pack::PackEntry entry{};
+        std::memcpy(&entry,
+                    file_.bytes().data() + sizeof(asset_pack::PackHeader) +
+                        size_t{bucket} * sizeof(entry),
+                    sizeof(entry));
+
+        if (entry.nameLength != 0 &&
+            (header_.namesOffset + entry.nameOffset + entry.nameLength >
+                 file_.size() ||
+             entry.offset % asset_pack::kBlobAlignment != 0 ||
+             entry.offset > file_.size() ||
+             entry.size > file_.size() - entry.offset)) {
+            throw std::runtime_error{"Corrupt asset pack entry: " + path_};
+        }
+        return entry;
+    }
+    std::string_view entryName(const asset_pack::PackEntry& entry) const {
+        return {reinterpret_cast<const char*>(file_.bytes().data()) +
+                    header_.namesOffset + entry.nameOffset,
+                entry.nameLength};
+    }
+
+    MappedFile file_;
+    std::string path_;
+    asset_pack::PackHeader header_{};
+};
+
+// Builds an asset pack in memory and writes it in one go. Used by the
+// offline packer, see src/asset_packer.cpp
+class AssetPackWriter {
+   public:
+    void add(std::string name, asset_pack::AssetType type,
+             std::vector<std::byte> data) {
+        if (name.empty() || name.size() > UINT16_MAX) {
+            throw std::runtime_error{"Invalid asset name: " + name};
+        }
+        for (const Pending& asset : assets_) {
+            if (asset.name == name) {
+                throw std::runtime_error{"Duplicate asset name: " + name};
+            }
+        }
+        if (type == asset_pack::AssetType::kSpirv &&
+            (data.empty() || data.size() % sizeof(uint32_t) != 0)) {
+            throw std::runtime_error{"Invalid SPIR-V asset: " + name};
+        }
+
+        assets_.push_back({std::move(name), type, std::move(data)});
+    }
+
+    // Written to a temporary file which is renamed over path, so readers
+    // never map a half written pack
+    void write(const std::string& path) const {
+        using asset_pack::PackEntry;
+        using asset_pack::PackHeader;
+
+        PackHeader header{};
+        header.magic = asset_pack::kMagic;
+        header.version = asset_pack::kVersion;
+        header.entryCount = static_cast<uint32_t>(assets_.size());
+        header.tableSize =
+            std::bit_ceil(std::max<uint32_t>(2 * header.entryCount, 1));
+        header.namesOffset =
+            sizeof(PackHeader) + uint64_t{header.tableSize} * sizeof(PackEntry);
+
+        std::vector<PackEntry> table(header.tableSize);
+        std::string names{};
+        std::vector<uint64_t> offsets{};
+        uint64_t names_size{};
+        for (const Pending& asset : assets_) {
+            names_size += asset.name.size();
+        }
+        uint64_t offset{asset_pack::alignUp(header.namesOffset + names_size,
+                                            asset_pack::kBlobAlignment)};
+
+        for (const Pending& asset : assets_) {
+            PackEntry entry{};
+            entry.nameHash = asset_pack::hashName(asset.name);
+            entry.offset = offset;
+            entry.size = asset.data.size();
+            entry.nameOffset = static_cast<uint32_t>(names.size());
+            entry.nameLength = static_cast<uint16_t>(asset.name.size());
+            entry.type = asset.type;
+            names += asset.name;
+            offsets.push_back(offset);
+            offset = asset_pack::alignUp(offset + asset.data.size(),
+                                         asset_pack::kBlobAlignment);
+
+            uint32_t mask{header.tableSize - 1};
+            auto bucket{static_cast<uint32_t>(entry.nameHash) & mask};
+            while (table[bucket].nameLength != 0) {
+                bucket = (bucket + 1) & mask;
+            }
+            table[bucket] = entry;
+        }
+        header.fileSize = offset;
+
+        std::string tmp_path{path + ".tmp"};
+        {
+            std::ofstream file{tmp_path, std::ios::binary | std::ios::trunc};
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(reinterpret_cast<const char*>(table.data()),
+                       static_cast<std::streamsize>(table.size() *
+                                                    sizeof(PackEntry)));
+            file.write(names.data(),
+                       static_cast<std::streamsize>(names.size()));
+            for (size_t i{}; i < assets_.size(); ++i) {
+                pad(file, offsets[i]);
+                file.write(
+                    reinterpret_cast<const char*>(assets_[i].data.data()),
+                    static_cast<std::streamsize>(assets_[i].data.size()));
+            }
+            pad(file, header.fileSize);
+            if (!file) {
+                throw std::runtime_error{"Failed to write asset pack: " +
+                                         tmp_path};
+            }
+        }
+
+        std::error_code error{};
+        std::filesystem::rename(tmp_path, path, error);
+        if (error) {
+            throw std::runtime_error{"Failed to rename asset pack: " +
+                                     error.message()};
+        }
+    }
+
+   private:
+    struct Pending {
+        std::string name{};
+        asset_pack::AssetType type{};
+        std::vector<std::byte> data{};
+    };
+
+    static void pad(std::ofstream& file, uint64_t offset) {
+        auto position{static_cast<uint64_t>(file.tellp())};
+        std::string zeros(offset - position, '\0');
+        file.write(zeros.data(), static_cast<std::streamsize>(zeros.size()));
+    }
+
+    std::vector<Pending> assets_{};
+};
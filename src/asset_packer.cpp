@@ -0,0 +1,93 @@
+#include <cstddef>
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+#include <iostream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "asset_pack.hpp"
+#include "mapped_file.hpp"
+#include "mesh.hpp"
+#include "mesh_optimizer.hpp"
+
+// Offline packer. Bundles files into one asset pack, see src/asset_pack.hpp.
+//
+// Usage: vulkan_test_pack <output> <input>...
+//
+// Every input is either a path, stored under its file name, or
+// <name>=<path>. Files ending in .spv are stored as SPIR-V, all others as
+// raw bytes. OBJ files are imported, optimized and quantized into meshes
+// instead, stored as <stem>.mesh by default
+
+asset_pack::AssetType assetType(const std::filesystem::path& path) {
+    if (path.extension() == ".spv") {
+        return asset_pack::AssetType::kSpirv;
+    }
+    if (path.extension() == ".obj") {
+        return asset_pack::AssetType::kMesh;
+    }
+    return asset_pack::AssetType::kRaw;
+}
+
+std::vector<std::byte> buildMesh(const MappedFile& file) {
+    Mesh mesh{importObj(std::string_view{
+        static_cast<const char*>(file.data()), file.size()})};
+    normalizeMesh(mesh);
+
+    float acmr_before{mesh_optimizer::averageCacheMissRatio(
+        mesh.indices, mesh.vertices.size())};
+    mesh_optimizer::optimizeMesh(mesh);
+    std::cout << "  " << mesh.vertices.size() << " vertices, "
+              << mesh.indices.size() / 3 << " triangles, ACMR "
+              << acmr_before << " -> "
+              << mesh_optimizer::averageCacheMissRatio(mesh.indices,
+                                                       mesh.vertices.size())
+              << '\n';
+
+    return writeMeshAsset(mesh);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0]  // NOLINT
+                  << " <output> [<name>=]<input>...\n";
+        return EXIT_FAILURE;
+    }
+
+    try {
+        AssetPackWriter writer{};
+        for (int i{2}; i < argc; ++i) {
+            std::string arg{argv[i]};  // NOLINT
+            size_t separator{arg.find('=')};
+            std::filesystem::path path{
+                separator == std::string::npos ? arg
+                                               : arg.substr(separator + 1)};
+            asset_pack::AssetType type{assetType(path)};
+            std::string name{
+                separator != std::string::npos ? arg.substr(0, separator)
+                : type == asset_pack::AssetType::kMesh
+                    ? path.stem().string() + ".mesh"
+                    : path.filename().string()};
+
+            MappedFile file{path.string()};
+            std::cout << name << ":\n";
+            std::vector<std::byte> data{
+                type == asset_pack::AssetType::kMesh
+                    ? buildMesh(file)
+                    : std::vector<std::byte>(file.bytes().begin(),
+                                             file.bytes().end())};
+            std::cout << "  " << data.size() << " bytes\n";
+            writer.add(std::move(name), type, std::move(data));
+        }
+
+        writer.write(argv[1]);  // NOLINT
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,197 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "hello_triangle_application.hpp"
+#include "statistics.hpp"
+
+// Runs a fixed number of frames without a window and reports frame time
+// statistics as JSON, so results can be compared between runs in CI.
+//
+// Args:
+// --output:<value>            results file, bench_results.json by default
+// --warmup:<value>            frames excluded from statistics, 30 by default
+//
+// All other args are passed to the application. Offscreen target is used
+// unless --headless-surface is passed
+
+struct BenchConfig {
+    std::string outputPath{"bench_results.json"};
+    uint32_t warmupFrameCount{30};
+};
+
+const char* presentModeName(const AppConfig& config) {
+    if (config.renderTarget == RenderTarget::kOffscreen) {
+        return "none";
+    }
+    if (!config.presentMode.has_value()) {
+        return "default";
+    }
+
+    switch (config.presentMode.value()) {
+        case VK_PRESENT_MODE_FIFO_KHR:
+            return "fifo";
+        case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+            return "fifo-relaxed";
+        case VK_PRESENT_MODE_MAILBOX_KHR:
+            return "mailbox";
+        case VK_PRESENT_MODE_IMMEDIATE_KHR:
+            return "immediate";
+        default:
+            return "other";
+    }
+}
+
+const char* latencyPolicyName(LatencyPolicy policy) {
+    switch (policy) {
+        case LatencyPolicy::kLowLatency:
+            return "low";
+        case LatencyPolicy::kThroughput:
+            return "throughput";
+        case LatencyPolicy::kPower:
+            return "power";
+        case LatencyPolicy::kBalanced:
+        default:
+            return "balanced";
+    }
+}
+
+void writeResults(std::ostream& out, const AppConfig& config,
+                  const BenchConfig& bench_config,
+                  const HelloTriangleApplication& app) {
+    const std::vector<double>& frame_times{app.frameTimes()};
+    std::vector<double> sorted(
+        frame_times.begin() +
+            static_cast<std::ptrdiff_t>(bench_config.warmupFrameCount),
+        frame_times.end());
+    std::ranges::sort(sorted);
+
+    double total_ms{std::accumulate(sorted.begin(), sorted.end(), 0.0)};
+    double mean_ms{total_ms / static_cast<double>(sorted.size())};
+
+    // Frames which were not presented have no latency sample, so warmup is
+    // only approximately skipped here
+    const std::vector<double>& input_to_present{app.inputToPresentTimes()};
+    std::vector<double> sorted_latency(
+        input_to_present.begin() +
+            static_cast<std::ptrdiff_t>(std::min<size_t>(
+                bench_config.warmupFrameCount, input_to_present.size())),
+        input_to_present.end());
+    std::ranges::sort(sorted_latency);
+    double latency_mean_ms{
+        sorted_latency.empty()
+            ? 0.0
+            : std::accumulate(sorted_latency.begin(), sorted_latency.end(),
+                              0.0) /
+                  static_cast<double>(sorted_latency.size())};
+
+    out << "{\n"
+        << "  \"render_target\": \""
+        << (config.renderTarget == RenderTarget::kOffscreen
+                ? "offscreen"
+                : "headless-surface")
+        << "\",\n"
+        << "  \"present_mode\": \"" << presentModeName(config) << "\",\n"
+        << "  \"latency_policy\": \""
+        << latencyPolicyName(config.latencyPolicy) << "\",\n"
+        << "  \"fps_limit\": " << config.fpsLimit << ",\n"
+        << "  \"frames_in_flight\": " << config.framesInFlight << ",\n"
+        << "  \"draws\": " << config.drawCount << ",\n"
+        << "  \"instances_per_draw\": " << config.instanceCount << ",\n"
+        << "  \"animated_instances\": " << config.animatedInstanceCount
+        << ",\n"
+        << "  \"threads\": " << config.recordThreadCount << ",\n"
+        << "  \"gpu_culling\": " << (config.gpuCulling ? "true" : "false")
+        << ",\n"
+        << "  \"async_compute\": " << (config.asyncCompute ? "true" : "false")
+        << ",\n"
+        << "  \"msaa_samples\": " << app.msaaSamples() << ",\n"
+        << "  \"depth\": " << (config.depth ? "true" : "false") << ",\n"
+        << "  \"textures\": " << config.textureCount << ",\n"
+        << "  \"texture_budget_mib\": " << config.textureBudgetMiB << ",\n"
+        << "  \"triangles_per_instance\": " << app.trianglesPerInstance()
+        << ",\n"
+        << "  \"init_threads\": " << config.initThreadCount << ",\n"
+        << "  \"init_ms\": " << app.initMs() << ",\n"
+        << "  \"time_to_first_frame_ms\": " << app.timeToFirstFrameMs() << ",\n"
+        << "  \"performance_warnings\": " << app.performanceWarningCount()
+        << ",\n"
+        << "  \"frames\": " << sorted.size() << ",\n"
+        << "  \"warmup_frames\": " << bench_config.warmupFrameCount << ",\n"
+        << "  \"total_ms\": " << total_ms << ",\n"
+        << "  \"fps\": " << 1000.0 / mean_ms << ",\n"
+        << "  \"frame_ms\": {\n"
+        << "    \"mean\": " << mean_ms << ",\n"
+        << "    \"min\": " << sorted.front() << ",\n"
+        << "    \"p50\": " << percentile(sorted, 50.0) << ",\n"
+        << "    \"p95\": " << percentile(sorted, 95.0) << ",\n"
+        << "    \"p99\": " << percentile(sorted, 99.0) << ",\n"
+        << "    \"max\": " << sorted.back() << "\n"
+        << "  },\n"
+        << "  \"input_to_present_ms\": {\n"
+        << "    \"mean\": " << latency_mean_ms << ",\n"
+        << "    \"p50\": "
+        << (sorted_latency.empty() ? 0.0 : percentile(sorted_latency, 50.0))
+        << ",\n"
+        << "    \"p99\": "
+        << (sorted_latency.empty() ? 0.0 : percentile(sorted_latency, 99.0))
+        << "\n"
+        << "  }\n"
+        << "}\n";
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        BenchConfig bench_config{};
+
+        // Benchmark never opens a window. Later --headless-surface overrides
+        // this
+        std::string headless_arg{"--headless"};
+        std::vector<char*> app_args{argv[0], headless_arg.data()};  // NOLINT
+
+        for (int i{1}; i < argc; ++i) {
+            std::string arg{argv[i]};  // NOLINT
+
+            if (arg.starts_with("--output:")) {
+                bench_config.outputPath = arg.substr(std::strlen("--output:"));
+            } else if (arg.starts_with("--warmup:")) {
+                bench_config.warmupFrameCount = static_cast<uint32_t>(
+                    std::stoul(arg.substr(std::strlen("--warmup:"))));
+            } else {
+                app_args.push_back(argv[i]);  // NOLINT
+            }
+        }
+
+        AppConfig config{
+            parseArgs(static_cast<int>(app_args.size()), app_args.data())};
+        if (config.frameCount <= bench_config.warmupFrameCount) {
+            throw std::runtime_error{
+                "--frames must be greater than --warmup"};
+        }
+
+        HelloTriangleApplication app{config};
+        app.run();
+
+        std::ofstream file{bench_config.outputPath, std::ios::trunc};
+        writeResults(file, config, bench_config, app);
+        if (!file) {
+            throw std::runtime_error{"Failed to write benchmark results!"};
+        }
+
+        writeResults(std::cout, config, bench_config, app);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
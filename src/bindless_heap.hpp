@@ -0,0 +1,326 @@
+#pragma once
+
+#include <vulkan/vulkan_core.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+// One descriptor set holding every texture, storage buffer and sampler the
+// app uses. It is bound once per command buffer and shaders index its arrays
+// with slots passed through push constants, so draws never switch descriptor
+// sets and batch freely.
+//
+// The set is update-after-bind (VK_EXT_descriptor_indexing), so new slots may
+// be written while command buffers reading other slots are pending. A
+// released slot is only handed out again once every frame which could still
+// read it has completed.
+class BindlessHeap {
+   public:
+    // Value of a kind is also the binding of its array in set 0
+    enum class Kind : uint8_t {
+        // VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE
+        kTexture,
+        // VK_DESCRIPTOR_TYPE_STORAGE_BUFFER
+        kBuffer,
+        // VK_DESCRIPTOR_TYPE_SAMPLER
+        kSampler,
+        kCount,
+    };
+
+    // Marks "no resource" in push constants. Never returned by add*()
+    static constexpr uint32_t kInvalidSlot{0xFFFFFFFF};
+
+    // Slots of every kind. Lowered to device limits by clampCapacity()
+    struct Capacity {
+        uint32_t textures{16384};
+        uint32_t buffers{4096};
+        uint32_t samplers{64};
+    };
+
+    // VK_EXT_descriptor_indexing depends on maintenance3
+    static constexpr std::array<const char*, 2> kDeviceExtensions{
+        VK_KHR_MAINTENANCE3_EXTENSION_NAME,
+        VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME};
+
+    // get_features2 is nullptr if VK_KHR_get_physical_device_properties2 is
+    // not enabled, then nothing is supported
+    static bool isSupported(
+        VkPhysicalDevice device,
+        PFN_vkGetPhysicalDeviceFeatures2KHR get_features2) {
+        if (get_features2 == nullptr) {
+            return false;
+        }
+
+        VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexing{};
+        indexing.sType =
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+        VkPhysicalDeviceFeatures2KHR features{};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
+        features.pNext = &indexing;
+        get_features2(device, &features);
+
+        return features.features.shaderSampledImageArrayDynamicIndexing ==
+                   VK_TRUE &&
+               features.features.shaderStorageBufferArrayDynamicIndexing ==
+                   VK_TRUE &&
+               indexing.descriptorBindingSampledImageUpdateAfterBind ==
+                   VK_TRUE &&
+               indexing.descriptorBindingStorageBufferUpdateAfterBind ==
+                   VK_TRUE &&
+               indexing.descriptorBindingUpdateUnusedWhilePending == VK_TRUE &&
+               indexing.descriptorBindingPartiallyBound == VK_TRUE &&
+               indexing.runtimeDescriptorArray == VK_TRUE;
+    }
+    // Enable what isSupported() checks. indexing goes into pNext chain of
+    // device create info
+    static void enableFeatures(
+        VkPhysicalDeviceFeatures& device_features,
+        VkPhysicalDeviceDescriptorIndexingFeaturesEXT& indexing) {
+        device_features.shaderSampledImageArrayDynamicIndexing = VK_TRUE;
+        device_features.shaderStorageBufferArrayDynamicIndexing = VK_TRUE;
+
+        indexing = {};
+        indexing.sType =
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+        indexing.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+        indexing.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+        indexing.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+        indexing.descriptorBindingPartiallyBound = VK_TRUE;
+        indexing.runtimeDescriptorArray = VK_TRUE;
+    }
+    // Every array is visible to vertex and fragment stages, so per stage
+    // limits apply as well as per set ones
+    static Capacity clampCapacity(
+        Capacity capacity, VkPhysicalDevice device,
+        PFN_vkGetPhysicalDeviceProperties2KHR get_properties2) {
+        VkPhysicalDeviceDescriptorIndexingPropertiesEXT limits{};
+        limits.sType =
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES_EXT;
+        VkPhysicalDeviceProperties2KHR properties{};
+        properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2_KHR;
+        properties.pNext = &limits;
+        get_properties2(device, &properties);
+
+        auto clamp{[](uint32_t& count, uint32_t per_set, uint32_t per_stage) {
+            count = std::min({count, per_set, per_stage});
+        }};
+        clamp(capacity.textures,
+              limits.maxDescriptorSetUpdateAfterBindSampledImages,
+              limits.maxPerStageDescriptorUpdateAfterBindSampledImages);
+        clamp(capacity.buffers,
+              limits.maxDescriptorSetUpdateAfterBindStorageBuffers,
+              limits.maxPerStageDescriptorUpdateAfterBindStorageBuffers);
+        clamp(capacity.samplers, limits.maxDescriptorSetUpdateAfterBindSamplers,
+              limits.maxPerStageDescriptorUpdateAfterBindSamplers);
+        return capacity;
+    }
+
+    BindlessHeap(VkDevice device, const Capacity& capacity)
+        : device_{device} {
+        slots_[static_cast<size_t>(Kind::kTexture)].capacity =
+            capacity.textures;
+        slots_[static_cast<size_t>(Kind::kBuffer)].capacity = capacity.buffers;
+        slots_[static_cast<size_t>(Kind::kSampler)].capacity =
+            capacity.samplers;
+
+        createSetLayout();
+        createDescriptorSet();
+    }
+    ~BindlessHeap() {
+        vkDestroyDescriptorPool(device_, descriptorPool_, nullptr);
+        vkDestroyDescriptorSetLayout(device_, setLayout_, nullptr);
+    }
+
+    BindlessHeap(const BindlessHeap&) = delete;
+    BindlessHeap& operator=(const BindlessHeap&) = delete;
+    BindlessHeap(BindlessHeap&&) = delete;
+    BindlessHeap& operator=(BindlessHeap&&) = delete;
+
+    // Set 0 of pipeline layouts using the heap
+    VkDescriptorSetLayout setLayout() const { return setLayout_; }
+
+    // Bind heap as set 0 of layout. Once per command buffer is enough, as no
+    // other set is ever bound
+    void cmdBind(VkCommandBuffer command_buffer,
+                 VkPipelineBindPoint bind_point,
+                 VkPipelineLayout pipeline_layout) const {
+        vkCmdBindDescriptorSets(command_buffer, bind_point, pipeline_layout, 0,
+                                1, &descriptorSet_, 0, nullptr);
+    }
+
+    // add*() return the slot shaders index the kind's array with. View and
+    // buffer must stay alive until the slot is released and recycled.
+    // Safe to call from any thread
+    uint32_t addTexture(VkImageView image_view, VkImageLayout layout) {
+        VkDescriptorImageInfo image_info{VK_NULL_HANDLE, image_view, layout};
+        return add(Kind::kTexture, &image_info, nullptr);
+    }
+    uint32_t addBuffer(VkBuffer buffer, VkDeviceSize offset,
+                       VkDeviceSize range) {
+        VkDescriptorBufferInfo buffer_info{buffer, offset, range};
+        return add(Kind::kBuffer, nullptr, &buffer_info);
+    }
+    uint32_t addSampler(VkSampler sampler) {
+        VkDescriptorImageInfo image_info{sampler, VK_NULL_HANDLE,
+                                         VK_IMAGE_LAYOUT_UNDEFINED};
+        return add(Kind::kSampler, &image_info, nullptr);
+    }
+
+    // Slot may still be read by frames up to last_use_frame, usually the
+    // number of frames submitted so far. It is reused once recycle() is told
+    // that frame completed. Safe to call from any thread
+    void release(Kind kind, uint32_t slot, uint64_t last_use_frame) {
+        std::scoped_lock lock{mutex_};
+        slots_[static_cast<size_t>(kind)].pending.emplace_back(last_use_frame,
+                                                               slot);
+    }
+    // Frames up to completed_frame have finished on GPU
+    void recycle(uint64_t completed_frame) {
+        std::scoped_lock lock{mutex_};
+        for (auto& slots : slots_) {
+            // Releases come in frame order, so the oldest ones are in front
+            while (!slots.pending.empty() &&
+                   slots.pending.front().first <= completed_frame) {
+                slots.free.push_back(slots.pending.front().second);
+                slots.pending.pop_front();
+            }
+        }
+    }
+
+    // Slots handed out and not yet recycled
+    uint32_t usedSlots(Kind kind) const {
+        std::scoped_lock lock{mutex_};
+        const Slots& slots{slots_[static_cast<size_t>(kind)]};
+        return slots.next - static_cast<uint32_t>(slots.free.size());
+    }
+
+   private:
+    static constexpr size_t kKindCount{static_cast<size_t>(Kind::kCount)};
+    static constexpr std::array<VkDescriptorType, kKindCount>
+        kDescriptorTypes{VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+                         VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                         VK_DESCRIPTOR_TYPE_SAMPLER};
+
+    // Slot allocator of one kind
+    struct Slots {
+        uint32_t capacity{};
+        // Slots below it were handed out at least once
+        uint32_t next{};
+        std::vector<uint32_t> free{};
+        // Released slots and the last frame which may read them
+        std::deque<std::pair<uint64_t, uint32_t>> pending{};
+    };
+
+    void createSetLayout() {
+        std::array<VkDescriptorSetLayoutBinding, kKindCount> bindings{};
+        std::array<VkDescriptorBindingFlags, kKindCount> binding_flags{};
+        for (uint32_t i{}; i < kKindCount; ++i) {
+            bindings[i].binding = i;
+            bindings[i].descriptorType = kDescriptorTypes[i];
+            bindings[i].descriptorCount = slots_[i].capacity;
+            bindings[i].stageFlags =
+                VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+            // Most slots are empty, and only unused ones are ever written
+            // while the set is in use
+            binding_flags[i] =
+                VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT |
+                VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT |
+                VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT_EXT;
+        }
+
+        VkDescriptorSetLayoutBindingFlagsCreateInfoEXT flags_info{};
+        flags_info.sType =
+            VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+        flags_info.bindingCount = static_cast<uint32_t>(binding_flags.size());
+        flags_info.pBindingFlags = binding_flags.data();
+
+        VkDescriptorSetLayoutCreateInfo layout_info{};
+        layout_info.sType =
+            VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layout_info.pNext = &flags_info;
+        layout_info.flags =
+            VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+        layout_info.bindingCount = static_cast<uint32_t>(bindings.size());
+        layout_info.pBindings = bindings.data();
+
+        if (vkCreateDescriptorSetLayout(device_, &layout_info, nullptr,
+                                        &setLayout_) != VK_SUCCESS) {
+            throw std::runtime_error{
+                "Failed to create bindless descriptor set layout!"};
+        }
+    }
+    void createDescriptorSet() {
+        std::array<VkDescriptorPoolSize, kKindCount> pool_sizes{};
+        for (size_t i{}; i < kKindCount; ++i) {
+            pool_sizes[i].type = kDescriptorTypes[i];
+            pool_sizes[i].descriptorCount = slots_[i].capacity;
+        }
+
+        VkDescriptorPoolCreateInfo pool_info{};
+        pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
+        pool_info.maxSets = 1;
+        pool_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
+        pool_info.pPoolSizes = pool_sizes.data();
+
+        if (vkCreateDescriptorPool(device_, &pool_info, nullptr,
+                                   &descriptorPool_) != VK_SUCCESS) {
+            throw std::runtime_error{"Failed to create descriptor pool!"};
+        }
+
+        VkDescriptorSetAllocateInfo alloc_info{};
+        alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        alloc_info.descriptorPool = descriptorPool_;
+        alloc_info.descriptorSetCount = 1;
+        alloc_info.pSetLayouts = &setLayout_;
+
+        if (vkAllocateDescriptorSets(device_, &alloc_info, &descriptorSet_) !=
+            VK_SUCCESS) {
+            throw std::runtime_error{"Failed to allocate descriptor set!"};
+        }
+    }
+
+    uint32_t add(Kind kind, const VkDescriptorImageInfo* image_info,
+                 const VkDescriptorBufferInfo* buffer_info) {
+        std::scoped_lock lock{mutex_};
+        Slots& slots{slots_[static_cast<size_t>(kind)]};
+
+        uint32_t slot{};
+        if (!slots.free.empty()) {
+            slot = slots.free.back();
+            slots.free.pop_back();
+        } else if (slots.next < slots.capacity) {
+            slot = slots.next++;
+        } else {
+            throw std::runtime_error{"Bindless heap is full!"};
+        }
+
+        VkWriteDescriptorSet write{};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = descriptorSet_;
+        write.dstBinding = static_cast<uint32_t>(kind);
+        write.dstArrayElement = slot;
+        write.descriptorCount = 1;
+        write.descriptorType = kDescriptorTypes[static_cast<size_t>(kind)];
+        write.pImageInfo = image_info;
+        write.pBufferInfo = buffer_info;
+        // Updates of one set must not overlap, so this stays under the lock
+        vkUpdateDescriptorSets(device_, 1, &write, 0, nullptr);
+
+        return slot;
+    }
+
+    VkDevice device_;
+    VkDescriptorSetLayout setLayout_{VK_NULL_HANDLE};
+    VkDescriptorPool descriptorPool_{VK_NULL_HANDLE};
+    VkDescriptorSet descriptorSet_{VK_NULL_HANDLE};
+
+    mutable std::mutex mutex_{};
+    std::array<Slots, kKindCount> slots_{};
+};
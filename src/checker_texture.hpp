@@ -0,0 +1,106 @@
+#pragma once
+
+#include <vulkan/vulkan_core.h>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+
+#include "texture_streamer.hpp"
+
+// Procedural 8x8 checkerboard of size x size texels with a color pair picked
+// by seed. Stands in for texture files, so streaming can be exercised
+// without assets. Decodes into RGBA8, or into BC1 and ETC2 blocks of one
+// color each. Checker cells cover whole blocks down to mips where a cell is
+// smaller than a block, and from there on every texel is the average color,
+// which is what a box filter of the finer mip gives
+inline TextureStreamer::Desc checkerTexture(uint32_t seed, uint32_t size) {
+    using Rgb = std::array<uint8_t, 3>;
+
+    // Bright and dark variant of a hue spread by seed
+    uint32_t hash{(seed + 1) * 2654435761U};
+    Rgb light{static_cast<uint8_t>(128 + ((hash >> 8U) & 127U)),
+              static_cast<uint8_t>(128 + ((hash >> 16U) & 127U)),
+              static_cast<uint8_t>(128 + ((hash >> 24U) & 127U))};
+    Rgb dark{static_cast<uint8_t>(light[0] / 4),
+             static_cast<uint8_t>(light[1] / 4),
+             static_cast<uint8_t>(light[2] / 4)};
+    Rgb average{static_cast<uint8_t>((light[0] + dark[0]) / 2),
+                static_cast<uint8_t>((light[1] + dark[1]) / 2),
+                static_cast<uint8_t>((light[2] + dark[2]) / 2)};
+
+    TextureStreamer::Desc desc{};
+    desc.width = size;
+    desc.height = size;
+    desc.formats = {VK_FORMAT_BC1_RGB_UNORM_BLOCK,
+                    VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK,
+                    VK_FORMAT_R8G8B8A8_UNORM};
+    desc.decode = [=](VkFormat format, uint32_t mip_level,
+                      std::span<std::byte> texels) {
+        uint32_t mip_size{std::max(size >> mip_level, 1U)};
+        uint32_t cell_size{std::max(size / 8, 1U) >> mip_level};
+        bool blocks{format != VK_FORMAT_R8G8B8A8_UNORM};
+        uint32_t block_size{blocks ? 4U : 1U};
+        uint32_t row_blocks{(mip_size + block_size - 1) / block_size};
+
+        auto color{[&](uint32_t x, uint32_t y) -> const Rgb& {
+            if (cell_size < block_size) {
+                return average;
+            }
+            return ((x / cell_size + y / cell_size) % 2 == 0) ? light : dark;
+        }};
+
+        for (uint32_t by{}; by < row_blocks; ++by) {
+            for (uint32_t bx{}; bx < row_blocks; ++bx) {
+                const Rgb& c{color(bx * block_size, by * block_size)};
+                size_t index{static_cast<size_t>(by) * row_blocks + bx};
+
+                switch (format) {
+                    case VK_FORMAT_R8G8B8A8_UNORM: {
+                        std::byte* texel{&texels[index * 4]};
+                        texel[0] = std::byte{c[0]};
+                        texel[1] = std::byte{c[1]};
+                        texel[2] = std::byte{c[2]};
+                        texel[3] = std::byte{255};
+                        break;
+                    }
+                    case VK_FORMAT_BC1_RGB_UNORM_BLOCK: {
+                        // Both endpoints equal and all indices 0
+                        auto rgb565{static_cast<uint16_t>(
+                            ((c[0] * 31U + 127U) / 255U) << 11U |
+                            ((c[1] * 63U + 127U) / 255U) << 5U |
+                            ((c[2] * 31U + 127U) / 255U))};
+                        std::byte* block{&texels[index * 8]};
+                        for (size_t i{}; i < 8; ++i) {
+                            block[i] = std::byte{};
+                        }
+                        block[0] = block[2] = std::byte(rgb565 & 0xFFU);
+                        block[1] = block[3] = std::byte(rgb565 >> 8U);
+                        break;
+                    }
+                    case VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK: {
+                        // Differential mode with zero delta, modifier table 0
+                        // and all indices 0, which adds 2 to every channel
+                        std::byte* block{&texels[index * 8]};
+                        for (size_t i{}; i < 8; ++i) {
+                            block[i] = std::byte{};
+                        }
+                        for (size_t i{}; i < 3; ++i) {
+                            block[i] = std::byte(
+                                (std::max(c[i], uint8_t{2}) - 2U) >> 3U << 3U);
+                        }
+                        block[3] = std::byte{0x02};
+                        break;
+                    }
+                    default:
+                        throw std::runtime_error{
+                            "Unsupported checker texture format!"};
+                }
+            }
+        }
+    };
+    return desc;
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <vulkan/vulkan_core.h>
+
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+#include "pipeline_feedback.hpp"
+
+// Compute shader together with its descriptor set layout and pipeline layout.
+// All bindings live in set 0 and push constants, if any, start at offset 0
+class ComputePipeline {
+   public:
+    // feedback may be nullptr, otherwise it is chained into pipeline creation
+    ComputePipeline(VkDevice device, VkPipelineCache pipeline_cache,
+                    std::span<const uint32_t> shader_code,
+                    const std::vector<VkDescriptorSetLayoutBinding>& bindings,
+                    uint32_t push_constant_size,
+                    PipelineFeedback* feedback = nullptr)
+        : device_{device} {
+        VkDescriptorSetLayoutCreateInfo layout_info{};
+        layout_info.sType =
+            VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layout_info.bindingCount = static_cast<uint32_t>(bindings.size());
+        layout_info.pBindings = bindings.data();
+
+        if (vkCreateDescriptorSetLayout(device_, &layout_info, nullptr,
+                                        &descriptorSetLayout_) != VK_SUCCESS) {
+            throw std::runtime_error{
+                "Failed to create descriptor set layout!"};
+        }
+
+        VkPushConstantRange push_constant_range{};
+        push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        push_constant_range.offset = 0;
+        push_constant_range.size = push_constant_size;
+
+        VkPipelineLayoutCreateInfo pipeline_layout_info{};
+        pipeline_layout_info.sType =
+            VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipeline_layout_info.setLayoutCount = 1;
+        pipeline_layout_info.pSetLayouts = &descriptorSetLayout_;
+        pipeline_layout_info.pushConstantRangeCount =
+            push_constant_size > 0 ? 1 : 0;
+        pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+
+        if (vkCreatePipelineLayout(device_, &pipeline_layout_info, nullptr,
+                                   &pipelineLayout_) != VK_SUCCESS) {
+            throw std::runtime_error{"Failed to create pipeline layout!"};
+        }
+
+        VkShaderModuleCreateInfo module_info{};
+        module_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        module_info.codeSize = shader_code.size_bytes();
+        module_info.pCode = shader_code.data();
+
+        VkShaderModule shader_module{};
+        if (vkCreateShaderModule(device_, &module_info, nullptr,
+                                 &shader_module) != VK_SUCCESS) {
+            throw std::runtime_error{"Failed to create shader module!"};
+        }
+
+        VkComputePipelineCreateInfo pipeline_info{};
+        pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipeline_info.stage.sType =
+            VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipeline_info.stage.module = shader_module;
+        pipeline_info.stage.pName = "main";
+        pipeline_info.layout = pipelineLayout_;
+        if (feedback != nullptr) {
+            pipeline_info.pNext = feedback->chain(nullptr);
+        }
+
+        // Shader module is not needed once pipeline is created
+        VkResult result{vkCreateComputePipelines(
+            device_, pipeline_cache, 1, &pipeline_info, nullptr, &pipeline_)};
+        vkDestroyShaderModule(device_, shader_module, nullptr);
+
+        if (result != VK_SUCCESS) {
+            throw std::runtime_error{"Failed to create compute pipeline!"};
+        }
+    }
+    ~ComputePipeline() {
+        vkDestroyPipeline(device_, pipeline_, nullptr);
+        vkDestroyPipelineLayout(device_, pipelineLayout_, nullptr);
+        vkDestroyDescriptorSetLayout(device_, descriptorSetLayout_, nullptr);
+    }
+
+    ComputePipeline(const ComputePipeline&) = delete;
+    ComputePipeline& operator=(const ComputePipeline&) = delete;
+    ComputePipeline(ComputePipeline&&) = delete;
+    ComputePipeline& operator=(ComputePipeline&&) = delete;
+
+    VkDescriptorSetLayout descriptorSetLayout() const {
+        return descriptorSetLayout_;
+    }
+
+    void cmdBind(VkCommandBuffer command_buffer,
+                 VkDescriptorSet descriptor_set) const {
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                          pipeline_);
+        vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                                pipelineLayout_, 0, 1, &descriptor_set, 0,
+                                nullptr);
+    }
+    void cmdPushConstants(VkCommandBuffer command_buffer, const void* data,
+                          uint32_t size) const {
+        vkCmdPushConstants(command_buffer, pipelineLayout_,
+                           VK_SHADER_STAGE_COMPUTE_BIT, 0, size, data);
+    }
+
+   private:
+    VkDevice device_;
+    VkDescriptorSetLayout descriptorSetLayout_{VK_NULL_HANDLE};
+    VkPipelineLayout pipelineLayout_{VK_NULL_HANDLE};
+    VkPipeline pipeline_{VK_NULL_HANDLE};
+};
@@ -0,0 +1,340 @@
+#pragma once
+
+#include <vulkan/vulkan_core.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+
+// Multiple producer single consumer lock-free ring buffer. Every cell carries
+// a sequence number, so producers claim cells with a single CAS and the
+// consumer sees a cell only once its producer finished writing it
+template <typename T, size_t kCapacity>
+class MpscRing {
+    static_assert((kCapacity & (kCapacity - 1)) == 0,
+                  "Capacity must be a power of two");
+
+   public:
+    MpscRing() {
+        for (size_t i{}; i < kCapacity; ++i) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // Returns false if ring is full. Safe to call from any thread
+    bool push(const T& value) {
+        size_t head{head_.load(std::memory_order_relaxed)};
+        Cell* cell{};
+        while (true) {
+            cell = &cells_[head & (kCapacity - 1)];
+            size_t sequence{cell->sequence.load(std::memory_order_acquire)};
+            auto lag{static_cast<std::ptrdiff_t>(sequence - head)};
+            if (lag == 0) {
+                if (head_.compare_exchange_weak(head, head + 1,
+                                                std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (lag < 0) {
+                // Consumer has not released this cell since last lap
+                return false;
+            } else {
+                head = head_.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->value = value;
+        cell->sequence.store(head + 1, std::memory_order_release);
+        return true;
+    }
+    // Must only be called from the consumer thread
+    std::optional<T> pop() {
+        Cell& cell{cells_[tail_ & (kCapacity - 1)]};
+        if (cell.sequence.load(std::memory_order_acquire) != tail_ + 1) {
+            return std::nullopt;
+        }
+
+        T value{cell.value};
+        cell.sequence.store(tail_ + kCapacity, std::memory_order_release);
+        ++tail_;
+        return value;
+    }
+
+   private:
+    struct Cell {
+        std::atomic<size_t> sequence{};
+        T value{};
+    };
+
+    std::array<Cell, kCapacity> cells_{};
+    alignas(64) std::atomic<size_t> head_{};
+    // Only touched by the consumer
+    alignas(64) size_t tail_{};
+};
+
+// Copy of a debug utils message. Fixed size, so the callback never allocates
+struct DebugMessage {
+    static constexpr size_t kMaxIdNameLength{64};
+    static constexpr size_t kMaxTextLength{1024};
+
+    VkDebugUtilsMessageSeverityFlagBitsEXT severity{};
+    VkDebugUtilsMessageTypeFlagsEXT types{};
+    int32_t idNumber{};
+    // Truncated, always null terminated
+    std::array<char, kMaxIdNameLength> idName{};
+    std::array<char, kMaxTextLength> text{};
+};
+
+// Receives VK_EXT_debug_utils messages. The callback only copies a message
+// into a lock-free ring, so validation never blocks the thread which made the
+// offending call. A background thread drains the ring and prints messages
+// with de-duplication by message ID and a rate limit.
+//
+// Performance warnings are counted even when they are not printed, so they
+// can be tracked like any other metric.
+class DebugMessageSink {
+   public:
+    // Messages below minSeverity or without any of types never reach the
+    // callback. Errors are never rate limited
+    struct Filter {
+        VkDebugUtilsMessageSeverityFlagBitsEXT minSeverity{
+            VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT};
+        VkDebugUtilsMessageTypeFlagsEXT types{
+            VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT |
+            VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT |
+            VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT};
+        // Occurrences of one message ID printed before it is suppressed
+        uint32_t maxRepeats{3};
+        // Messages printed per second, errors excluded
+        uint32_t maxPerSecond{20};
+    };
+
+    DebugMessageSink(std::ostream& out, const Filter& filter)
+        : out_{out}, filter_{filter} {
+        drainer_ = std::jthread{[this](const std::stop_token& stop) {
+            drainLoop(stop);
+        }};
+    }
+    // Prints messages still in the ring and a summary
+    ~DebugMessageSink() {
+        drainer_.request_stop();
+        drainer_.join();
+        printSummary();
+    }
+
+    DebugMessageSink(const DebugMessageSink&) = delete;
+    DebugMessageSink& operator=(const DebugMessageSink&) = delete;
+    DebugMessageSink(DebugMessageSink&&) = delete;
+    DebugMessageSink& operator=(DebugMessageSink&&) = delete;
+
+    // Subscribes create_info to messages passing the filter
+    void populateCreateInfo(VkDebugUtilsMessengerCreateInfoEXT& create_info) {
+        create_info = {};
+        create_info.sType =
+            VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
+        // Severity bits grow with severity, so this keeps minSeverity and
+        // everything above it
+        create_info.messageSeverity =
+            ~(static_cast<VkDebugUtilsMessageSeverityFlagsEXT>(
+                  filter_.minSeverity) -
+              1) &
+            (VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT |
+             VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT |
+             VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT |
+             VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT);
+        create_info.messageType = filter_.types;
+        create_info.pfnUserCallback = callback;
+        create_info.pUserData = this;
+    }
+
+    // Performance warnings received so far, including unprinted ones
+    uint64_t performanceWarningCount() const {
+        return performanceWarnings_.load(std::memory_order_relaxed);
+    }
+
+   private:
+    static constexpr size_t kRingCapacity{256};
+
+    // Per message ID state, only touched by the drain thread
+    struct IdStats {
+        std::string name{};
+        uint64_t count{};
+        bool performance{};
+    };
+
+    // NOLINTBEGIN
+    static VKAPI_ATTR VkBool32 VKAPI_CALL
+    callback(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
+             VkDebugUtilsMessageTypeFlagsEXT messageType,
+             const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData,
+             void* pUserData) {
+        auto* sink{static_cast<DebugMessageSink*>(pUserData)};
+
+        if ((messageType & VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT) !=
+            0) {
+            sink->performanceWarnings_.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        DebugMessage message{};
+        message.severity = messageSeverity;
+        message.types = messageType;
+        message.idNumber = pCallbackData->messageIdNumber;
+        copyTruncated(message.idName, pCallbackData->pMessageIdName);
+        copyTruncated(message.text, pCallbackData->pMessage);
+
+        if (!sink->ring_.push(message)) {
+            sink->dropped_.fetch_add(1, std::memory_order_relaxed);
+        }
+        return VK_FALSE;
+    }
+    // NOLINTEND
+
+    template <size_t kSize>
+    static void copyTruncated(std::array<char, kSize>& destination,
+                              const char* source) {
+        if (source == nullptr) {
+            return;
+        }
+        size_t length{strnlen(source, kSize - 1)};
+        std::memcpy(destination.data(), source, length);
+        destination[length] = '\0';
+    }
+
+    static const char* severityName(
+        VkDebugUtilsMessageSeverityFlagBitsEXT severity) {
+        switch (severity) {
+            case VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT:
+                return "verbose";
+            case VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT:
+                return "info";
+            case VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT:
+                return "warning";
+            case VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT:
+                return "error";
+            default:
+                return "unknown";
+        }
+    }
+
+    void drainLoop(const std::stop_token& stop) {
+        while (true) {
+            // Read stop flag first, so messages pushed before stop are printed
+            bool stopping{stop.stop_requested()};
+            drain();
+            if (stopping) {
+                return;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds{5});
+        }
+    }
+    // Whole batch is written at once, so the stream is flushed once per
+    // batch instead of once per message
+    void drain() {
+        std::string batch{};
+        while (auto message{ring_.pop()}) {
+            handle(*message, batch);
+        }
+
+        auto now{std::chrono::steady_clock::now()};
+        if (now - windowStart_ >= std::chrono::seconds{1}) {
+            if (windowRateLimited_ > 0) {
+                batch += "validation layer: " +
+                         std::to_string(windowRateLimited_) +
+                         " messages rate limited\n";
+            }
+            windowStart_ = now;
+            windowPrinted_ = 0;
+            windowRateLimited_ = 0;
+        }
+
+        if (!batch.empty()) {
+            out_ << batch << std::flush;
+        }
+    }
+    void handle(const DebugMessage& message, std::string& batch) {
+        ++received_;
+
+        // Not every layer message has an ID, those are told apart by text
+        std::string_view text{message.text.data()};
+        uint64_t key{message.idNumber != 0
+                         ? static_cast<uint32_t>(message.idNumber)
+                         : std::hash<std::string_view>{}(text) | (1ULL << 63U)};
+        IdStats& stats{idStats_[key]};
+        if (stats.count++ == 0) {
+            stats.name = message.idName.data();
+            stats.performance =
+                (message.types &
+                 VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT) != 0;
+        }
+
+        if (stats.count > filter_.maxRepeats) {
+            ++duplicates_;
+            return;
+        }
+        bool error{message.severity ==
+                   VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT};
+        if (!error && windowPrinted_ >= filter_.maxPerSecond) {
+            ++windowRateLimited_;
+            ++rateLimited_;
+            return;
+        }
+        ++windowPrinted_;
+
+        batch += "validation layer [";
+        batch += severityName(message.severity);
+        batch += "]: ";
+        batch += text;
+        if (stats.count == filter_.maxRepeats) {
+            batch += " (further repeats suppressed)";
+        }
+        batch += '\n';
+    }
+
+    void printSummary() {
+        if (received_ == 0) {
+            return;
+        }
+
+        out_ << "Debug messages: " << received_ << " received, "
+             << duplicates_ << " repeats suppressed, " << rateLimited_
+             << " rate limited, " << dropped_.load(std::memory_order_relaxed)
+             << " dropped, " << performanceWarningCount()
+             << " performance warnings\n";
+        for (const auto& [key, stats] : idStats_) {
+            if (stats.count > filter_.maxRepeats || stats.performance) {
+                out_ << "  " << (stats.name.empty() ? "<no id>" : stats.name)
+                     << (stats.performance ? " (performance)" : "") << ": "
+                     << stats.count << " times\n";
+            }
+        }
+        out_ << std::flush;
+    }
+
+    std::ostream& out_;
+    Filter filter_;
+
+    MpscRing<DebugMessage, kRingCapacity> ring_{};
+    std::atomic<uint64_t> dropped_{};
+    std::atomic<uint64_t> performanceWarnings_{};
+
+    // Only touched by the drain thread, or after it has been joined
+    std::unordered_map<uint64_t, IdStats> idStats_{};
+    uint64_t received_{};
+    uint64_t duplicates_{};
+    uint64_t rateLimited_{};
+    std::chrono::steady_clock::time_point windowStart_{};
+    uint32_t windowPrinted_{};
+    uint64_t windowRateLimited_{};
+
+    // Declared last, so it is started after everything it uses
+    std::jthread drainer_{};
+};
@@ -0,0 +1,453 @@
+#pragma once
+
+#include <vulkan/vulkan_core.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <stdexcept>
+#include <vector>
+
+// Sub-allocates buffers and images from large VkDeviceMemory blocks, so the
+// number of vkAllocateMemory calls stays far below maxMemoryAllocationCount.
+// Each block keeps free ranges ordered by offset and serves requests best-fit.
+// Freed ranges are merged with their neighbours. Requests larger than half a
+// block get a dedicated block of their own.
+// Host visible blocks are persistently mapped.
+// All methods are thread safe.
+class DeviceMemoryAllocator {
+   public:
+    // How resource lays out its memory. Linear and optimal resources which
+    // share a bufferImageGranularity page alias on some hardware
+    enum class ResourceKind {
+        // Buffers and linear tiling images
+        kLinear,
+        // Optimal tiling images
+        kOptimal,
+    };
+
+    struct Allocation {
+        VkDeviceMemory memory{VK_NULL_HANDLE};
+        VkDeviceSize offset{};
+        VkDeviceSize size{};
+        // Host pointer to offset for host visible memory, nullptr otherwise
+        void* mapped{nullptr};
+        uint32_t memoryTypeIndex{};
+        // Block this allocation belongs to
+        uint64_t blockId{};
+    };
+
+    struct HeapStatistics {
+        VkDeviceSize heapSize{};
+        // Memory allocated from the driver
+        VkDeviceSize blockBytes{};
+        // Memory handed out to resources, including alignment padding
+        VkDeviceSize usedBytes{};
+        uint32_t blockCount{};
+        uint32_t allocationCount{};
+    };
+
+    // Called by defragment() for every moved allocation. Callback must copy
+    // contents of `from` into `to` and rebind its resource to `to`.
+    // `from` is freed after the callback returns
+    using MoveCallback =
+        std::function<void(const Allocation& from, const Allocation& to)>;
+
+    static constexpr VkDeviceSize kDefaultBlockSize{64ULL * 1024 * 1024};
+
+    DeviceMemoryAllocator(VkPhysicalDevice physical_device, VkDevice device,
+                          VkDeviceSize block_size = kDefaultBlockSize)
+        : device_{device}, blockSize_{block_size} {
+        vkGetPhysicalDeviceMemoryProperties(physical_device,
+                                            &memoryProperties_);
+
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(physical_device, &properties);
+        bufferImageGranularity_ = properties.limits.bufferImageGranularity;
+        maxAllocationCount_ = properties.limits.maxMemoryAllocationCount;
+    }
+    ~DeviceMemoryAllocator() {
+        for (auto& block : blocks_) {
+            vkFreeMemory(device_, block.memory, nullptr);
+        }
+    }
+
+    DeviceMemoryAllocator(const DeviceMemoryAllocator&) = delete;
+    DeviceMemoryAllocator& operator=(const DeviceMemoryAllocator&) = delete;
+    DeviceMemoryAllocator(DeviceMemoryAllocator&&) = delete;
+    DeviceMemoryAllocator& operator=(DeviceMemoryAllocator&&) = delete;
+
+    // Memory type with all `required` flags. Types which also have all
+    // `preferred` flags win
+    uint32_t findMemoryType(uint32_t type_bits, VkMemoryPropertyFlags required,
+                            VkMemoryPropertyFlags preferred = 0) const {
+        for (VkMemoryPropertyFlags flags : {required | preferred, required}) {
+            for (uint32_t i{}; i < memoryProperties_.memoryTypeCount; ++i) {
+                if ((type_bits & (1U << i)) &&
+                    (memoryProperties_.memoryTypes[i].propertyFlags & flags) ==
+                        flags) {
+                    return i;
+                }
+            }
+        }
+
+        throw std::runtime_error{"Failed to find suitable memory type!"};
+    }
+
+    Allocation allocate(const VkMemoryRequirements& requirements,
+                        VkMemoryPropertyFlags required,
+                        VkMemoryPropertyFlags preferred, ResourceKind kind) {
+        std::lock_guard lock{mutex_};
+        uint32_t memory_type{
+            findMemoryType(requirements.memoryTypeBits, required, preferred)};
+
+        bool dedicated{requirements.size > blockSize_ / 2};
+        if (!dedicated) {
+            for (auto& block : blocks_) {
+                if (block.memoryTypeIndex != memory_type || block.dedicated) {
+                    continue;
+                }
+                if (auto offset{tryAllocate(block, requirements.size,
+                                            requirements.alignment, kind)}) {
+                    return makeAllocation(block, *offset, requirements.size);
+                }
+            }
+        }
+
+        Block& block{createBlock(
+            memory_type, dedicated ? requirements.size : blockSize_,
+            dedicated)};
+        auto offset{tryAllocate(block, requirements.size,
+                                requirements.alignment, kind)};
+        if (!offset) {
+            throw std::runtime_error{"Failed to sub-allocate device memory!"};
+        }
+
+        return makeAllocation(block, *offset, requirements.size);
+    }
+    // Allocate memory for buffer and bind it
+    Allocation allocateForBuffer(VkBuffer buffer,
+                                 VkMemoryPropertyFlags required,
+                                 VkMemoryPropertyFlags preferred = 0) {
+        VkMemoryRequirements requirements{};
+        vkGetBufferMemoryRequirements(device_, buffer, &requirements);
+
+        Allocation allocation{
+            allocate(requirements, required, preferred, ResourceKind::kLinear)};
+        if (vkBindBufferMemory(device_, buffer, allocation.memory,
+                               allocation.offset) != VK_SUCCESS) {
+            free(allocation);
+            throw std::runtime_error{"Failed to bind buffer memory!"};
+        }
+
+        return allocation;
+    }
+    // Allocate memory for image and bind it
+    Allocation allocateForImage(
+        VkImage image, VkMemoryPropertyFlags required,
+        VkMemoryPropertyFlags preferred = 0,
+        VkImageTiling tiling = VK_IMAGE_TILING_OPTIMAL) {
+        VkMemoryRequirements requirements{};
+        vkGetImageMemoryRequirements(device_, image, &requirements);
+
+        Allocation allocation{allocate(requirements, required, preferred,
+                                       tiling == VK_IMAGE_TILING_OPTIMAL
+                                           ? ResourceKind::kOptimal
+                                           : ResourceKind::kLinear)};
+        if (vkBindImageMemory(device_, image, allocation.memory,
+                              allocation.offset) != VK_SUCCESS) {
+            free(allocation);
+            throw std::runtime_error{"Failed to bind image memory!"};
+        }
+
+        return allocation;
+    }
+
+    void free(const Allocation& allocation) {
+        std::lock_guard lock{mutex_};
+        auto block{findBlock(allocation.blockId)};
+        if (block == blocks_.end()) {
+            return;
+        }
+
+        auto used{block->usedRanges.find(allocation.offset)};
+        if (used == block->usedRanges.end()) {
+            return;
+        }
+        VkDeviceSize offset{used->first};
+        VkDeviceSize size{used->second.size};
+        block->usedRanges.erase(used);
+        block->usedBytes -= size;
+
+        // Merge with free neighbours
+        auto next{block->freeRanges.lower_bound(offset)};
+        if (next != block->freeRanges.end() && next->first == offset + size) {
+            size += next->second;
+            next = block->freeRanges.erase(next);
+        }
+        if (next != block->freeRanges.begin()) {
+            auto prev{std::prev(next)};
+            if (prev->first + prev->second == offset) {
+                offset = prev->first;
+                size += prev->second;
+                block->freeRanges.erase(prev);
+            }
+        }
+        block->freeRanges.emplace(offset, size);
+
+        if (block->dedicated) {
+            vkFreeMemory(device_, block->memory, nullptr);
+            blocks_.erase(block);
+        }
+    }
+
+    // Defragmentation hook. Moves allocations of a memory type out of later
+    // blocks into free space of earlier ones, then releases emptied blocks.
+    // Caller owns resources, so actual copy and rebind happen in `move`.
+    // Memory must not be in use by the device while this runs
+    void defragment(uint32_t memory_type_index, const MoveCallback& move) {
+        std::lock_guard lock{mutex_};
+        for (size_t src{blocks_.size()}; src-- > 0;) {
+            if (blocks_[src].memoryTypeIndex != memory_type_index ||
+                blocks_[src].dedicated) {
+                continue;
+            }
+
+            // Copy, since free() below edits used ranges of this block
+            std::map<VkDeviceSize, UsedRange> used{blocks_[src].usedRanges};
+            for (const auto& [offset, range] : used) {
+                for (size_t dst{}; dst < src; ++dst) {
+                    Block& target{blocks_[dst]};
+                    if (target.memoryTypeIndex != memory_type_index ||
+                        target.dedicated) {
+                        continue;
+                    }
+
+                    auto new_offset{tryAllocate(target, range.size,
+                                                range.alignment, range.kind)};
+                    if (!new_offset) {
+                        continue;
+                    }
+
+                    Allocation from{
+                        makeAllocation(blocks_[src], offset, range.size)};
+                    Allocation to{
+                        makeAllocation(target, *new_offset, range.size)};
+                    move(from, to);
+                    free(from);
+                    break;
+                }
+            }
+        }
+
+        releaseEmptyBlocks();
+    }
+
+    // Give empty blocks back to the driver
+    void releaseEmptyBlocks() {
+        std::lock_guard lock{mutex_};
+        std::erase_if(blocks_, [this](const Block& block) {
+            if (!block.usedRanges.empty()) {
+                return false;
+            }
+            vkFreeMemory(device_, block.memory, nullptr);
+            return true;
+        });
+    }
+
+    std::vector<HeapStatistics> heapStatistics() const {
+        std::lock_guard lock{mutex_};
+        std::vector<HeapStatistics> stats(memoryProperties_.memoryHeapCount);
+        for (uint32_t i{}; i < memoryProperties_.memoryHeapCount; ++i) {
+            stats[i].heapSize = memoryProperties_.memoryHeaps[i].size;
+        }
+
+        for (const auto& block : blocks_) {
+            HeapStatistics& heap{stats[memoryProperties_
+                                           .memoryTypes[block.memoryTypeIndex]
+                                           .heapIndex]};
+            ++heap.blockCount;
+            heap.blockBytes += block.size;
+            heap.usedBytes += block.usedBytes;
+            heap.allocationCount +=
+                static_cast<uint32_t>(block.usedRanges.size());
+        }
+
+        return stats;
+    }
+    void printStatistics(std::ostream& out) const {
+        std::vector<HeapStatistics> stats{heapStatistics()};
+        for (size_t i{}; i < stats.size(); ++i) {
+            out << "Memory heap " << i << ": " << stats[i].usedBytes
+                << " bytes used in " << stats[i].allocationCount
+                << " allocations, " << stats[i].blockBytes << " bytes in "
+                << stats[i].blockCount << " blocks, heap size "
+                << stats[i].heapSize << " bytes\n";
+        }
+    }
+
+   private:
+    struct UsedRange {
+        VkDeviceSize size{};
+        VkDeviceSize alignment{};
+        ResourceKind kind{};
+    };
+    struct Block {
+        uint64_t id{};
+        VkDeviceMemory memory{VK_NULL_HANDLE};
+        VkDeviceSize size{};
+        VkDeviceSize usedBytes{};
+        uint32_t memoryTypeIndex{};
+        void* mapped{nullptr};
+        bool dedicated{};
+        // Offset to size
+        std::map<VkDeviceSize, VkDeviceSize> freeRanges{};
+        std::map<VkDeviceSize, UsedRange> usedRanges{};
+    };
+
+    Block& createBlock(uint32_t memory_type, VkDeviceSize size,
+                       bool dedicated) {
+        if (blocks_.size() >= maxAllocationCount_) {
+            throw std::runtime_error{
+                "Device memory allocation count limit reached!"};
+        }
+
+        Block block{};
+        block.id = nextBlockId_++;
+        block.size = size;
+        block.memoryTypeIndex = memory_type;
+        block.dedicated = dedicated;
+        block.freeRanges.emplace(0, size);
+
+        VkMemoryAllocateInfo alloc_info{};
+        alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        alloc_info.allocationSize = size;
+        alloc_info.memoryTypeIndex = memory_type;
+
+        if (vkAllocateMemory(device_, &alloc_info, nullptr, &block.memory) !=
+            VK_SUCCESS) {
+            throw std::runtime_error{"Failed to allocate device memory!"};
+        }
+
+        if (memoryProperties_.memoryTypes[memory_type].propertyFlags &
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+            if (vkMapMemory(device_, block.memory, 0, VK_WHOLE_SIZE, 0,
+                            &block.mapped) != VK_SUCCESS) {
+                vkFreeMemory(device_, block.memory, nullptr);
+                throw std::runtime_error{"Failed to map device memory!"};
+            }
+        }
+
+        blocks_.push_back(std::move(block));
+        return blocks_.back();
+    }
+
+    std::vector<Block>::iterator findBlock(uint64_t id) {
+        return std::find_if(blocks_.begin(), blocks_.end(),
+                            [id](const Block& block) { return block.id == id; });
+    }
+
+    // Two ranges are on the same page if end of the first one and start of
+    // the second one fall into the same bufferImageGranularity sized page
+    bool onSamePage(VkDeviceSize first_end, VkDeviceSize second_start) const {
+        VkDeviceSize page_mask{~(bufferImageGranularity_ - 1)};
+        return ((first_end - 1) & page_mask) == (second_start & page_mask);
+    }
+
+    // Best-fit search over free ranges of block. Returns offset of the
+    // reserved range
+    std::optional<VkDeviceSize> tryAllocate(Block& block, VkDeviceSize size,
+                                            VkDeviceSize alignment,
+                                            ResourceKind kind) {
+        const bool check_granularity{bufferImageGranularity_ > 1};
+
+        auto best{block.freeRanges.end()};
+        VkDeviceSize best_offset{};
+        for (auto it{block.freeRanges.begin()}; it != block.freeRanges.end();
+             ++it) {
+            auto [free_offset, free_size]{*it};
+            VkDeviceSize offset{alignUp(free_offset, alignment)};
+
+            // Used range right before and right after this free range
+            auto next_used{block.usedRanges.lower_bound(free_offset)};
+            if (check_granularity && next_used != block.usedRanges.begin()) {
+                auto prev_used{std::prev(next_used)};
+                if (prev_used->second.kind != kind &&
+                    onSamePage(prev_used->first + prev_used->second.size,
+                               offset)) {
+                    offset = alignUp(offset, bufferImageGranularity_);
+                }
+            }
+
+            if (offset + size > free_offset + free_size) {
+                continue;
+            }
+            if (check_granularity && next_used != block.usedRanges.end() &&
+                next_used->second.kind != kind &&
+                onSamePage(offset + size, next_used->first)) {
+                continue;
+            }
+
+            if (best == block.freeRanges.end() || free_size < best->second) {
+                best = it;
+                best_offset = offset;
+            }
+        }
+
+        if (best == block.freeRanges.end()) {
+            return std::nullopt;
+        }
+
+        // Split free range around the reserved one
+        auto [free_offset, free_size]{*best};
+        block.freeRanges.erase(best);
+        if (best_offset > free_offset) {
+            block.freeRanges.emplace(free_offset, best_offset - free_offset);
+        }
+        if (best_offset + size < free_offset + free_size) {
+            block.freeRanges.emplace(
+                best_offset + size, free_offset + free_size - best_offset - size);
+        }
+        block.usedRanges.emplace(best_offset,
+                                 UsedRange{size, alignment, kind});
+        block.usedBytes += size;
+
+        return best_offset;
+    }
+
+    static Allocation makeAllocation(const Block& block, VkDeviceSize offset,
+                                     VkDeviceSize size) {
+        Allocation allocation{};
+        allocation.memory = block.memory;
+        allocation.offset = offset;
+        allocation.size = size;
+        allocation.memoryTypeIndex = block.memoryTypeIndex;
+        allocation.blockId = block.id;
+        if (block.mapped != nullptr) {
+            allocation.mapped = static_cast<char*>(block.mapped) + offset;
+        }
+
+        return allocation;
+    }
+
+    static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+        return alignment > 1 ? (value + alignment - 1) / alignment * alignment
+                             : value;
+    }
+
+    VkDevice device_;
+    VkDeviceSize blockSize_;
+    VkPhysicalDeviceMemoryProperties memoryProperties_{};
+    VkDeviceSize bufferImageGranularity_{1};
+    uint32_t maxAllocationCount_{};
+
+    // Recursive, since defragment() frees through the public interface
+    mutable std::recursive_mutex mutex_{};
+    std::vector<Block> blocks_{};
+    uint64_t nextBlockId_{1};
+};
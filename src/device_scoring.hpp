@@ -0,0 +1,177 @@
+#pragma once
+
+#include <vulkan/vulkan_core.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// How well a physical device is expected to run this app. Device type
+// dominates, so a discrete GPU always beats an integrated one, which always
+// beats a software rasterizer. Other terms break ties within a type
+struct DeviceScore {
+    VkPhysicalDevice device{VK_NULL_HANDLE};
+    std::string name{};
+    VkPhysicalDeviceType type{};
+    // Lowercase hex without dashes. Empty if device UUID can not be queried
+    std::string uuid{};
+    int64_t total{};
+    // Name and points of every scoring term
+    std::vector<std::pair<const char*, int64_t>> breakdown{};
+};
+
+inline const char* deviceTypeName(VkPhysicalDeviceType type) {
+    switch (type) {
+        case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+            return "discrete";
+        case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+            return "integrated";
+        case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+            return "virtual";
+        case VK_PHYSICAL_DEVICE_TYPE_CPU:
+            return "cpu";
+        default:
+            return "other";
+    }
+}
+
+// get_properties2 may be nullptr, then device UUID is left empty
+inline DeviceScore scorePhysicalDevice(
+    VkPhysicalDevice device,
+    PFN_vkGetPhysicalDeviceProperties2KHR get_properties2) {
+    DeviceScore score{};
+    score.device = device;
+
+    VkPhysicalDeviceProperties properties{};
+    vkGetPhysicalDeviceProperties(device, &properties);
+    score.name = properties.deviceName;
+    score.type = properties.deviceType;
+
+    if (get_properties2 != nullptr) {
+        VkPhysicalDeviceIDProperties id_properties{};
+        id_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+
+        VkPhysicalDeviceProperties2 properties2{};
+        properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties2.pNext = &id_properties;
+        get_properties2(device, &properties2);
+
+        constexpr const char* kHexDigits{"0123456789abcdef"};
+        for (uint8_t byte : id_properties.deviceUUID) {
+            score.uuid += kHexDigits[byte >> 4U];
+            score.uuid += kHexDigits[byte & 0xFU];
+        }
+    }
+
+    auto add{[&score](const char* term, int64_t points) {
+        score.breakdown.emplace_back(term, points);
+        score.total += points;
+    }};
+
+    switch (properties.deviceType) {
+        case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+            add("device type", 10000);
+            break;
+        case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+            add("device type", 5000);
+            break;
+        case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+            add("device type", 2000);
+            break;
+        case VK_PHYSICAL_DEVICE_TYPE_CPU:
+            add("device type", 100);
+            break;
+        default:
+            add("device type", 0);
+            break;
+    }
+
+    // Integrated GPUs report system memory as device local, so this is
+    // capped well below the gap between device types
+    VkPhysicalDeviceMemoryProperties memory_properties{};
+    vkGetPhysicalDeviceMemoryProperties(device, &memory_properties);
+    VkDeviceSize device_local_bytes{};
+    for (uint32_t i{}; i < memory_properties.memoryHeapCount; ++i) {
+        const VkMemoryHeap& heap{memory_properties.memoryHeaps[i]};
+        if ((heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0) {
+            device_local_bytes = std::max(device_local_bytes, heap.size);
+        }
+    }
+    add("device local memory",
+        std::min<int64_t>(
+            static_cast<int64_t>(device_local_bytes >> 20U) * 250 / 1024,
+            2000));
+
+    uint32_t queue_family_count{};
+    vkGetPhysicalDeviceQueueFamilyProperties(device, &queue_family_count,
+                                             nullptr);
+    std::vector<VkQueueFamilyProperties> queue_families(queue_family_count);
+    vkGetPhysicalDeviceQueueFamilyProperties(device, &queue_family_count,
+                                             queue_families.data());
+    bool compute_queue{};
+    bool transfer_queue{};
+    for (const auto& family : queue_families) {
+        if ((family.queueFlags & VK_QUEUE_COMPUTE_BIT) != 0 &&
+            (family.queueFlags & VK_QUEUE_GRAPHICS_BIT) == 0) {
+            compute_queue = true;
+        }
+        if ((family.queueFlags & VK_QUEUE_TRANSFER_BIT) != 0 &&
+            (family.queueFlags &
+             (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) == 0) {
+            transfer_queue = true;
+        }
+    }
+    add("compute queue", compute_queue ? 500 : 0);
+    add("transfer queue", transfer_queue ? 300 : 0);
+
+    add("max image size", properties.limits.maxImageDimension2D / 1024 * 10);
+    add("compute invocations",
+        properties.limits.maxComputeWorkGroupInvocations / 64);
+
+    VkPhysicalDeviceFeatures features{};
+    vkGetPhysicalDeviceFeatures(device, &features);
+    add("multi draw indirect", features.multiDrawIndirect ? 100 : 0);
+    add("draw indirect first instance",
+        features.drawIndirectFirstInstance ? 100 : 0);
+    add("BC textures", features.textureCompressionBC ? 100 : 0);
+    add("anisotropic filtering", features.samplerAnisotropy ? 50 : 0);
+
+    return score;
+}
+
+// Selector is a device UUID (dashes and case ignored) or a case insensitive
+// part of the device name
+inline bool matchesDeviceSelector(const DeviceScore& score,
+                                  const std::string& selector) {
+    auto lower{[](std::string text) {
+        std::ranges::transform(text, text.begin(), [](unsigned char c) {
+            return static_cast<char>(std::tolower(c));
+        });
+        return text;
+    }};
+
+    std::string uuid_selector{lower(selector)};
+    std::erase(uuid_selector, '-');
+    if (!score.uuid.empty() && uuid_selector == score.uuid) {
+        return true;
+    }
+
+    return lower(score.name).find(lower(selector)) != std::string::npos;
+}
+
+inline void printDeviceScore(std::ostream& out, const DeviceScore& score) {
+    out << '"' << score.name << "\" (" << deviceTypeName(score.type);
+    if (!score.uuid.empty()) {
+        out << ", UUID " << score.uuid;
+    }
+    out << "): score " << score.total << " [";
+    for (size_t i{}; i < score.breakdown.size(); ++i) {
+        out << (i > 0 ? ", " : "") << score.breakdown[i].first << ' '
+            << score.breakdown[i].second;
+    }
+    out << ']';
+}
@@ -0,0 +1,200 @@
+#pragma once
+
+#include <vulkan/vulkan_core.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+
+#include "device_memory_allocator.hpp"
+
+// Linear allocator for data written every frame, e.g. uniforms. One
+// persistently mapped buffer is split into a region per frame slot.
+// Allocations bump a pointer through the current slot's region, and the
+// region is reset in O(1) once the slot's fence has signaled.
+//
+// Shaders read allocations through one dynamic uniform buffer descriptor,
+// so the hot path never allocates or maps memory nor writes descriptors,
+// it only passes another dynamic offset. Not thread safe
+class FrameDataRing {
+   public:
+    // Bytes readable past a dynamic offset. Vulkan guarantees at least this
+    // much maxUniformBufferRange, so it is also the largest allocation
+    static constexpr VkDeviceSize kBindingRange{16384};
+
+    struct Allocation {
+        void* data{};
+        uint32_t dynamicOffset{};
+    };
+
+    FrameDataRing(VkDevice device, VkPhysicalDevice physical_device,
+                  DeviceMemoryAllocator& allocator, VkDeviceSize slot_size,
+                  uint32_t frame_slot_count)
+        : device_{device}, allocator_{allocator} {
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(physical_device, &properties);
+        alignment_ = std::max<VkDeviceSize>(
+            properties.limits.minUniformBufferOffsetAlignment, 16);
+        regionSize_ = alignUp(slot_size);
+
+        createBuffer(frame_slot_count);
+        createDescriptorSet();
+        beginFrame(0);
+    }
+    ~FrameDataRing() {
+        vkDestroyDescriptorPool(device_, descriptorPool_, nullptr);
+        vkDestroyDescriptorSetLayout(device_, setLayout_, nullptr);
+        vkDestroyBuffer(device_, buffer_, nullptr);
+        if (memory_.memory != VK_NULL_HANDLE) {
+            allocator_.free(memory_);
+        }
+    }
+
+    FrameDataRing(const FrameDataRing&) = delete;
+    FrameDataRing& operator=(const FrameDataRing&) = delete;
+    FrameDataRing(FrameDataRing&&) = delete;
+    FrameDataRing& operator=(FrameDataRing&&) = delete;
+
+    // Single VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC binding 0
+    VkDescriptorSetLayout setLayout() const { return setLayout_; }
+
+    // Drop all allocations of the slot. GPU must be done with the slot, i.e.
+    // its frame fence must have signaled
+    void beginFrame(uint32_t slot_index) {
+        head_ = slot_index * regionSize_;
+        regionEnd_ = head_ + regionSize_;
+    }
+
+    // Memory is host coherent, so writes need no flush
+    Allocation allocate(VkDeviceSize size) {
+        if (size > kBindingRange) {
+            throw std::runtime_error{
+                "Frame data allocation exceeds binding range!"};
+        }
+        if (head_ + size > regionEnd_) {
+            throw std::runtime_error{"Frame data ring slot is full!"};
+        }
+
+        Allocation allocation{static_cast<char*>(memory_.mapped) + head_,
+                              static_cast<uint32_t>(head_)};
+        head_ = std::min(alignUp(head_ + size), regionEnd_);
+        return allocation;
+    }
+    // Copy value into the current slot and return its dynamic offset
+    template <typename T>
+    uint32_t push(const T& value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        Allocation allocation{allocate(sizeof(T))};
+        std::memcpy(allocation.data, &value, sizeof(T));
+        return allocation.dynamicOffset;
+    }
+
+    void cmdBind(VkCommandBuffer command_buffer,
+                 VkPipelineBindPoint bind_point,
+                 VkPipelineLayout pipeline_layout, uint32_t set_index,
+                 uint32_t dynamic_offset) const {
+        vkCmdBindDescriptorSets(command_buffer, bind_point, pipeline_layout,
+                                set_index, 1, &descriptorSet_, 1,
+                                &dynamic_offset);
+    }
+
+   private:
+    VkDeviceSize alignUp(VkDeviceSize size) const {
+        return (size + alignment_ - 1) / alignment_ * alignment_;
+    }
+
+    void createBuffer(uint32_t frame_slot_count) {
+        VkBufferCreateInfo buffer_info{};
+        buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        // Padded, so the binding range past the last offset stays inside
+        buffer_info.size = regionSize_ * frame_slot_count + kBindingRange;
+        buffer_info.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+        buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        if (vkCreateBuffer(device_, &buffer_info, nullptr, &buffer_) !=
+            VK_SUCCESS) {
+            throw std::runtime_error{"Failed to create frame data buffer!"};
+        }
+        // Device local host visible memory (resizable BAR, integrated GPUs)
+        // keeps shader reads off PCIe
+        memory_ = allocator_.allocateForBuffer(
+            buffer_,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    }
+    void createDescriptorSet() {
+        VkDescriptorSetLayoutBinding binding{};
+        binding.binding = 0;
+        binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        binding.descriptorCount = 1;
+        binding.stageFlags =
+            VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+
+        VkDescriptorSetLayoutCreateInfo layout_info{};
+        layout_info.sType =
+            VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layout_info.bindingCount = 1;
+        layout_info.pBindings = &binding;
+
+        if (vkCreateDescriptorSetLayout(device_, &layout_info, nullptr,
+                                        &setLayout_) != VK_SUCCESS) {
+            throw std::runtime_error{
+                "Failed to create descriptor set layout!"};
+        }
+
+        VkDescriptorPoolSize pool_size{};
+        pool_size.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        pool_size.descriptorCount = 1;
+
+        VkDescriptorPoolCreateInfo pool_info{};
+        pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        pool_info.maxSets = 1;
+        pool_info.poolSizeCount = 1;
+        pool_info.pPoolSizes = &pool_size;
+
+        if (vkCreateDescriptorPool(device_, &pool_info, nullptr,
+                                   &descriptorPool_) != VK_SUCCESS) {
+            throw std::runtime_error{"Failed to create descriptor pool!"};
+        }
+
+        VkDescriptorSetAllocateInfo alloc_info{};
+        alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        alloc_info.descriptorPool = descriptorPool_;
+        alloc_info.descriptorSetCount = 1;
+        alloc_info.pSetLayouts = &setLayout_;
+
+        if (vkAllocateDescriptorSets(device_, &alloc_info, &descriptorSet_) !=
+            VK_SUCCESS) {
+            throw std::runtime_error{"Failed to allocate descriptor set!"};
+        }
+
+        // Written once, every frame only changes the dynamic offset
+        VkDescriptorBufferInfo buffer_info{buffer_, 0, kBindingRange};
+        VkWriteDescriptorSet write{};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = descriptorSet_;
+        write.dstBinding = 0;
+        write.descriptorCount = 1;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        write.pBufferInfo = &buffer_info;
+        vkUpdateDescriptorSets(device_, 1, &write, 0, nullptr);
+    }
+
+    VkDevice device_;
+    DeviceMemoryAllocator& allocator_;
+    VkDeviceSize alignment_{};
+    VkDeviceSize regionSize_{};
+
+    VkBuffer buffer_{VK_NULL_HANDLE};
+    DeviceMemoryAllocator::Allocation memory_{};
+    VkDescriptorSetLayout setLayout_{VK_NULL_HANDLE};
+    VkDescriptorPool descriptorPool_{VK_NULL_HANDLE};
+    VkDescriptorSet descriptorSet_{VK_NULL_HANDLE};
+
+    // Next free byte and end of the current slot's region
+    VkDeviceSize head_{};
+    VkDeviceSize regionEnd_{};
+};
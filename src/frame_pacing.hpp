@@ -0,0 +1,104 @@
+#pragma once
+
+#include <vulkan/vulkan_core.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+// Trade-off between input latency, throughput and power draw of presenting
+enum class LatencyPolicy {
+    // MAILBOX, one image more than the minimum
+    kBalanced,
+    // IMMEDIATE or MAILBOX with as few images as possible. May tear
+    kLowLatency,
+    // FIFO with a deeper image queue, so GPU never waits for vblank
+    kThroughput,
+    // FIFO_RELAXED and a frame limiter, so nothing renders frames nobody sees
+    kPower,
+};
+
+// Present modes in order of preference. FIFO is always supported, so it ends
+// every list
+inline std::vector<VkPresentModeKHR> presentModePreference(
+    LatencyPolicy policy) {
+    switch (policy) {
+        case LatencyPolicy::kLowLatency:
+            return {VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR,
+                    VK_PRESENT_MODE_FIFO_KHR};
+        case LatencyPolicy::kThroughput:
+            return {VK_PRESENT_MODE_FIFO_KHR};
+        case LatencyPolicy::kPower:
+            return {VK_PRESENT_MODE_FIFO_RELAXED_KHR, VK_PRESENT_MODE_FIFO_KHR};
+        case LatencyPolicy::kBalanced:
+        default:
+            return {VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_FIFO_KHR};
+    }
+}
+
+// Every queued image adds a frame of latency once GPU is ahead of display
+inline uint32_t swapChainImageCount(
+    LatencyPolicy policy, const VkSurfaceCapabilitiesKHR& capabilities) {
+    uint32_t image_count{};
+    switch (policy) {
+        case LatencyPolicy::kLowLatency:
+            // One image on screen and one being rendered
+            image_count = std::max(capabilities.minImageCount, 2U);
+            break;
+        case LatencyPolicy::kThroughput:
+            image_count = capabilities.minImageCount + 2;
+            break;
+        case LatencyPolicy::kPower:
+        case LatencyPolicy::kBalanced:
+        default:
+            image_count = capabilities.minImageCount + 1;
+            break;
+    }
+
+    if (capabilities.maxImageCount > 0) {
+        image_count = std::min(image_count, capabilities.maxImageCount);
+    }
+    return image_count;
+}
+
+// Keeps frames at least 1 / fps apart. Sleeps off most of the wait and spins
+// the rest, since sleep overshoots by up to a scheduler tick
+class FrameLimiter {
+   public:
+    // 0 disables limiting
+    explicit FrameLimiter(uint32_t fps)
+        : period_{fps > 0 ? std::chrono::duration_cast<Clock::duration>(
+                                std::chrono::duration<double>{1.0 / fps})
+                          : Clock::duration::zero()} {}
+
+    // Block until next frame may start
+    void wait() {
+        if (period_ == Clock::duration::zero()) {
+            return;
+        }
+
+        auto now{Clock::now()};
+        // First frame, or so late that catching up would burst frames
+        if (now - next_ > period_) {
+            next_ = now + period_;
+            return;
+        }
+
+        if (next_ - now > kSpinTime) {
+            std::this_thread::sleep_until(next_ - kSpinTime);
+        }
+        while (Clock::now() < next_) {
+        }
+        next_ += period_;
+    }
+
+   private:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr std::chrono::microseconds kSpinTime{500};
+
+    Clock::duration period_;
+    Clock::time_point next_{};
+};
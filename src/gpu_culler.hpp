@@ -0,0 +1,382 @@
+#pragma once
+
+#include <vulkan/vulkan_core.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+#include "compute_pipeline.hpp"
+#include "device_memory_allocator.hpp"
+#include "instance_buffer.hpp"
+#include "pipeline_feedback.hpp"
+#include "upload_manager.hpp"
+
+// GPU driven drawing of instances. A compute pass culls bounding circles of
+// all instances against the visible area and writes indexed indirect draw
+// commands for the survivors, so CPU cost per frame does not depend on
+// instance count.
+//
+// With vkCmdDrawIndexedIndirectCountKHR and multiDrawIndirect survivors are
+// compacted and their count is read by the GPU. More survivors than
+// maxDrawIndirectCount are drawn in several calls, each reading the count of
+// its own chunk. Otherwise every instance gets a command and culled ones draw
+// zero instances.
+//
+// Draws use the index buffer of a mesh passed in, or a built in one for the
+// triangle defined in shader.vert.
+//
+// Every frame slot has its own output buffers and descriptor set, matching
+// InstanceBuffer slot copies. Culling may run on another queue family than
+// drawing: outputs are then shared concurrently by families passed in.
+class GpuCuller {
+   public:
+    // Indirect draw and pipeline creation features of the device
+    struct Features {
+        // nullptr if VK_KHR_draw_indirect_count is not enabled. Only used
+        // together with multiDrawIndirect
+        PFN_vkCmdDrawIndexedIndirectCountKHR drawIndexedIndirectCount{};
+        bool multiDrawIndirect{};
+        uint32_t maxDrawIndirectCount{1};
+        // VK_EXT_pipeline_creation_feedback is enabled
+        bool pipelineCreationFeedback{};
+    };
+    // Index buffer every instance is drawn with. Default is the triangle
+    struct Geometry {
+        VkBuffer indexBuffer{VK_NULL_HANDLE};
+        VkDeviceSize indexOffset{};
+        VkIndexType indexType{VK_INDEX_TYPE_UINT16};
+        uint32_t indexCount{};
+    };
+
+    GpuCuller(VkDevice device, DeviceMemoryAllocator& allocator,
+              UploadManager& upload_manager, VkPipelineCache pipeline_cache,
+              std::span<const uint32_t> shader_code,
+              const InstanceBuffer& instances, const Geometry& geometry,
+              uint32_t frame_slot_count, const Features& features,
+              const std::vector<uint32_t>& queue_families = {})
+        : device_{device},
+          allocator_{allocator},
+          features_{features},
+          queueFamilies_{queue_families},
+          objectCount_{instances.size()},
+          geometry_{geometry},
+          pipelineFeedback_{features.pipelineCreationFeedback, 1},
+          chunkCount_{usesDrawCount()
+                          ? (objectCount_ + features_.maxDrawIndirectCount -
+                             1) / features_.maxDrawIndirectCount
+                          : 1},
+          slots_(frame_slot_count) {
+        if (geometry_.indexBuffer == VK_NULL_HANDLE) {
+            createIndexBuffer(upload_manager);
+        }
+        createPipeline(pipeline_cache, shader_code);
+        createDescriptorPool();
+
+        for (uint32_t i{}; i < frame_slot_count; ++i) {
+            slots_[i].draws = createBuffer(
+                sizeof(VkDrawIndexedIndirectCommand) * objectCount_,
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                    VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT);
+            slots_[i].count = createBuffer(
+                sizeof(uint32_t) * (chunkCount_ + 1),
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                      VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                                      VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+            createDescriptorSet(slots_[i], instances, i);
+        }
+    }
+    ~GpuCuller() {
+        for (auto& slot : slots_) {
+            destroyBuffer(slot.draws);
+            destroyBuffer(slot.count);
+        }
+        destroyBuffer(indexBuffer_);
+
+        vkDestroyDescriptorPool(device_, descriptorPool_, nullptr);
+    }
+
+    GpuCuller(const GpuCuller&) = delete;
+    GpuCuller& operator=(const GpuCuller&) = delete;
+    GpuCuller(GpuCuller&&) = delete;
+    GpuCuller& operator=(GpuCuller&&) = delete;
+
+    // Whether culling pipeline came from pipeline cache
+    const PipelineFeedback& pipelineFeedback() const {
+        return pipelineFeedback_;
+    }
+
+    bool usesDrawCount() const {
+        return features_.drawIndexedIndirectCount != nullptr &&
+               features_.multiDrawIndirect;
+    }
+
+    // Output buffers of a slot. Count buffer is VK_NULL_HANDLE without draw
+    // count support
+    VkBuffer drawBuffer(uint32_t slot_index) const {
+        return slots_[slot_index].draws.buffer;
+    }
+    VkBuffer countBuffer(uint32_t slot_index) const {
+        return usesDrawCount() ? slots_[slot_index].count.buffer
+                               : VK_NULL_HANDLE;
+    }
+
+    // Record culling of slot's instances against visible_area, in instance
+    // offset units: min x, min y, max x, max y. Must be recorded outside of
+    // render pass. Outputs are written in COMPUTE_SHADER stage, the count
+    // buffer is also cleared in TRANSFER stage. Caller makes them visible to
+    // DRAW_INDIRECT stage before cmdDraw() of the same slot
+    void cmdCull(VkCommandBuffer command_buffer, uint32_t slot_index,
+                 const std::array<float, 4>& visible_area) {
+        Slot& slot{slots_[slot_index]};
+
+        if (usesDrawCount()) {
+            vkCmdFillBuffer(command_buffer, slot.count.buffer, 0,
+                            VK_WHOLE_SIZE, 0);
+
+            VkBufferMemoryBarrier reset_barrier{};
+            reset_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+            reset_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            reset_barrier.dstAccessMask =
+                VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+            reset_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            reset_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            reset_barrier.buffer = slot.count.buffer;
+            reset_barrier.offset = 0;
+            reset_barrier.size = VK_WHOLE_SIZE;
+
+            vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                 VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0,
+                                 nullptr, 1, &reset_barrier, 0, nullptr);
+        }
+
+        pipeline_->cmdBind(command_buffer, slot.descriptorSet);
+
+        PushConstants push_constants{};
+        push_constants.frustum = visible_area;
+        push_constants.objectCount = objectCount_;
+        push_constants.indexCount = geometry_.indexCount;
+        push_constants.compact = usesDrawCount() ? 1 : 0;
+        push_constants.chunkSize =
+            chunkCount_ > 1 ? features_.maxDrawIndirectCount : 0;
+        pipeline_->cmdPushConstants(command_buffer, &push_constants,
+                                    sizeof(push_constants));
+
+        vkCmdDispatch(command_buffer,
+                      (objectCount_ + kWorkgroupSize - 1) / kWorkgroupSize, 1,
+                      1);
+    }
+
+    // Record draws written by cmdCull(). Graphics pipeline and instance
+    // vertex buffers of the slot must be bound
+    void cmdDraw(VkCommandBuffer command_buffer, uint32_t slot_index) const {
+        const Slot& slot{slots_[slot_index]};
+        constexpr uint32_t kStride{sizeof(VkDrawIndexedIndirectCommand)};
+
+        vkCmdBindIndexBuffer(command_buffer, geometry_.indexBuffer,
+                             geometry_.indexOffset, geometry_.indexType);
+
+        if (usesDrawCount() && chunkCount_ == 1) {
+            features_.drawIndexedIndirectCount(command_buffer,
+                                               slot.draws.buffer, 0,
+                                               slot.count.buffer, 0,
+                                               objectCount_, kStride);
+        } else if (usesDrawCount()) {
+            // Counts of chunks follow the total count
+            for (uint32_t chunk{}; chunk < chunkCount_; ++chunk) {
+                uint32_t first{chunk * features_.maxDrawIndirectCount};
+                features_.drawIndexedIndirectCount(
+                    command_buffer, slot.draws.buffer,
+                    VkDeviceSize{first} * kStride, slot.count.buffer,
+                    VkDeviceSize{chunk + 1} * sizeof(uint32_t),
+                    std::min(objectCount_ - first,
+                             features_.maxDrawIndirectCount),
+                    kStride);
+            }
+        } else if (features_.multiDrawIndirect) {
+            // Commands of culled instances draw nothing, but are still read
+            for (uint32_t first{}; first < objectCount_;
+                 first += features_.maxDrawIndirectCount) {
+                vkCmdDrawIndexedIndirect(
+                    command_buffer, slot.draws.buffer,
+                    VkDeviceSize{first} * kStride,
+                    std::min(objectCount_ - first,
+                             features_.maxDrawIndirectCount),
+                    kStride);
+            }
+        } else {
+            // One command per call. CPU cost grows with instance count again
+            for (uint32_t i{}; i < objectCount_; ++i) {
+                vkCmdDrawIndexedIndirect(command_buffer, slot.draws.buffer,
+                                         VkDeviceSize{i} * kStride, 1,
+                                         kStride);
+            }
+        }
+    }
+
+   private:
+    static constexpr uint32_t kWorkgroupSize{64};
+
+    // Matches Params of cull.comp
+    struct PushConstants {
+        std::array<float, 4> frustum{};
+        uint32_t objectCount{};
+        uint32_t compact{};
+        uint32_t indexCount{};
+        uint32_t chunkSize{};
+    };
+
+    struct Buffer {
+        VkBuffer buffer{VK_NULL_HANDLE};
+        DeviceMemoryAllocator::Allocation memory{};
+    };
+
+    struct Slot {
+        // VkDrawIndexedIndirectCommand per instance
+        Buffer draws{};
+        // Number of commands in draws, then number of commands in every
+        // chunk of maxDrawIndirectCount ones. Unused without draw count
+        // support
+        Buffer count{};
+        VkDescriptorSet descriptorSet{VK_NULL_HANDLE};
+    };
+
+    Buffer createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
+                        bool shared = true) {
+        Buffer buffer{};
+
+        VkBufferCreateInfo buffer_info{};
+        buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        buffer_info.size = size;
+        buffer_info.usage = usage;
+        if (shared && queueFamilies_.size() > 1) {
+            buffer_info.sharingMode = VK_SHARING_MODE_CONCURRENT;
+            buffer_info.queueFamilyIndexCount =
+                static_cast<uint32_t>(queueFamilies_.size());
+            buffer_info.pQueueFamilyIndices = queueFamilies_.data();
+        } else {
+            buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        }
+
+        if (vkCreateBuffer(device_, &buffer_info, nullptr, &buffer.buffer) !=
+            VK_SUCCESS) {
+            throw std::runtime_error{"Failed to create buffer!"};
+        }
+        buffer.memory = allocator_.allocateForBuffer(
+            buffer.buffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        return buffer;
+    }
+    void destroyBuffer(Buffer& buffer) {
+        vkDestroyBuffer(device_, buffer.buffer, nullptr);
+        if (buffer.memory.memory != VK_NULL_HANDLE) {
+            allocator_.free(buffer.memory);
+        }
+    }
+
+    // Triangle vertexes are still defined in shader.vert, so indices are just
+    // the vertex numbers
+    void createIndexBuffer(UploadManager& upload_manager) {
+        constexpr std::array<uint16_t, 3> kIndices{0, 1, 2};
+
+        indexBuffer_ = createBuffer(
+            sizeof(kIndices),
+            VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            false);
+        upload_manager.uploadBuffer(indexBuffer_.buffer, 0, kIndices.data(),
+                                    sizeof(kIndices),
+                                    VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                                    VK_ACCESS_INDEX_READ_BIT);
+        geometry_ = {indexBuffer_.buffer, 0, VK_INDEX_TYPE_UINT16,
+                     static_cast<uint32_t>(kIndices.size())};
+    }
+
+    void createPipeline(VkPipelineCache pipeline_cache,
+                        std::span<const uint32_t> shader_code) {
+        // Offsets, scales, draws, count
+        std::vector<VkDescriptorSetLayoutBinding> bindings(4);
+        for (uint32_t i{}; i < bindings.size(); ++i) {
+            bindings[i].binding = i;
+            bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            bindings[i].descriptorCount = 1;
+            bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        }
+
+        pipeline_ = std::make_unique<ComputePipeline>(
+            device_, pipeline_cache, shader_code, bindings,
+            static_cast<uint32_t>(sizeof(PushConstants)), &pipelineFeedback_);
+    }
+
+    void createDescriptorPool() {
+        VkDescriptorPoolSize pool_size{};
+        pool_size.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        pool_size.descriptorCount = static_cast<uint32_t>(slots_.size()) * 4;
+
+        VkDescriptorPoolCreateInfo pool_info{};
+        pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        pool_info.maxSets = static_cast<uint32_t>(slots_.size());
+        pool_info.poolSizeCount = 1;
+        pool_info.pPoolSizes = &pool_size;
+
+        if (vkCreateDescriptorPool(device_, &pool_info, nullptr,
+                                   &descriptorPool_) != VK_SUCCESS) {
+            throw std::runtime_error{"Failed to create descriptor pool!"};
+        }
+    }
+    void createDescriptorSet(Slot& slot, const InstanceBuffer& instances,
+                             uint32_t slot_index) {
+        VkDescriptorSetAllocateInfo alloc_info{};
+        alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        alloc_info.descriptorPool = descriptorPool_;
+        alloc_info.descriptorSetCount = 1;
+        VkDescriptorSetLayout set_layout{pipeline_->descriptorSetLayout()};
+        alloc_info.pSetLayouts = &set_layout;
+
+        if (vkAllocateDescriptorSets(device_, &alloc_info,
+                                     &slot.descriptorSet) != VK_SUCCESS) {
+            throw std::runtime_error{"Failed to allocate descriptor set!"};
+        }
+
+        // Offsets and scales regions of instance buffer, then outputs
+        std::array<VkDescriptorBufferInfo, 4> buffer_infos{
+            instances.regionInfo(slot_index, 0),
+            instances.regionInfo(slot_index, 1),
+            VkDescriptorBufferInfo{slot.draws.buffer, 0, VK_WHOLE_SIZE},
+            VkDescriptorBufferInfo{slot.count.buffer, 0, VK_WHOLE_SIZE}};
+
+        std::array<VkWriteDescriptorSet, 4> writes{};
+        for (uint32_t i{}; i < writes.size(); ++i) {
+            writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[i].dstSet = slot.descriptorSet;
+            writes[i].dstBinding = i;
+            writes[i].descriptorCount = 1;
+            writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            writes[i].pBufferInfo = &buffer_infos[i];
+        }
+
+        vkUpdateDescriptorSets(device_, static_cast<uint32_t>(writes.size()),
+                               writes.data(), 0, nullptr);
+    }
+
+    VkDevice device_;
+    DeviceMemoryAllocator& allocator_;
+    Features features_;
+    std::vector<uint32_t> queueFamilies_;
+    uint32_t objectCount_;
+    Geometry geometry_;
+    PipelineFeedback pipelineFeedback_;
+    // Draw count calls per slot, 1 without draw count support
+    uint32_t chunkCount_;
+
+    // Built in triangle indices, unused with mesh geometry. Only read by
+    // draws, so it is owned by graphics family alone
+    Buffer indexBuffer_{};
+    std::unique_ptr<ComputePipeline> pipeline_{};
+    VkDescriptorPool descriptorPool_{VK_NULL_HANDLE};
+
+    std::vector<Slot> slots_;
+};
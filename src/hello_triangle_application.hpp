@@ -0,0 +1,3281 @@
+#pragma once
+
+#include <vulkan/vulkan_core.h>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <optional>
+#include <set>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <ostream>
+
+#include "asset_pack.hpp"
+#include "bindless_heap.hpp"
+#include "checker_texture.hpp"
+#include "debug_message_sink.hpp"
+#include "device_memory_allocator.hpp"
+#include "device_scoring.hpp"
+#include "frame_data_ring.hpp"
+#include "frame_pacing.hpp"
+#include "gpu_culler.hpp"
+#include "instance_buffer.hpp"
+#include "mapped_file.hpp"
+#include "mesh.hpp"
+#include "mesh_buffer.hpp"
+#include "mesh_optimizer.hpp"
+#include "pipeline_feedback.hpp"
+#include "profiler.hpp"
+#include "render_graph.hpp"
+#include "shader_library.hpp"
+#include "statistics.hpp"
+#include "task_graph.hpp"
+#include "texture_streamer.hpp"
+#include "thread_pool.hpp"
+#include "upload_manager.hpp"
+
+// NOLINTNEXTLINE
+static std::vector<const char*> validationLayers{"VK_LAYER_KHRONOS_validation"};
+
+#ifdef NDEBUG
+const bool enableValidationLayers{false};
+#else
+// NOLINTNEXTLINE
+const bool enableValidationLayers{true};
+#endif  // NDEBUG
+
+// NOLINTNEXTLINE
+inline VkResult CreateDebugUtilsMessengerEXT(
+    VkInstance instance, const VkDebugUtilsMessengerCreateInfoEXT* pCreateInfo,
+    const VkAllocationCallbacks* pAllocator,
+    VkDebugUtilsMessengerEXT* pDebugMessenger) {
+    // NOLINTNEXTLINE
+    auto func = (PFN_vkCreateDebugUtilsMessengerEXT)vkGetInstanceProcAddr(
+        instance, "vkCreateDebugUtilsMessengerEXT");
+    if (func != nullptr) {
+        return func(instance, pCreateInfo, pAllocator, pDebugMessenger);
+    }
+    // NOLINTNEXTLINE
+    else {
+        return VK_ERROR_EXTENSION_NOT_PRESENT;
+    }
+}
+// NOLINTNEXTLINE
+inline void DestroyDebugUtilsMessengerEXT(
+    VkInstance instance, VkDebugUtilsMessengerEXT debugMessenger,
+    const VkAllocationCallbacks* pAllocator) {
+    // NOLINTNEXTLINE
+    auto func = (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(
+        instance, "vkDestroyDebugUtilsMessengerEXT");
+    if (func != nullptr) {
+        func(instance, debugMessenger, pAllocator);
+    }
+}
+// NOLINTNEXTLINE
+inline VkResult CreateHeadlessSurfaceEXT(
+    VkInstance instance, const VkHeadlessSurfaceCreateInfoEXT* pCreateInfo,
+    const VkAllocationCallbacks* pAllocator, VkSurfaceKHR* pSurface) {
+    // NOLINTNEXTLINE
+    auto func = (PFN_vkCreateHeadlessSurfaceEXT)vkGetInstanceProcAddr(
+        instance, "vkCreateHeadlessSurfaceEXT");
+    if (func != nullptr) {
+        return func(instance, pCreateInfo, pAllocator, pSurface);
+    }
+    // NOLINTNEXTLINE
+    else {
+        return VK_ERROR_EXTENSION_NOT_PRESENT;
+    }
+}
+
+// Where rendered frames go
+enum class RenderTarget {
+    // Swap chain of a GLFW window
+    kWindow,
+    // Device owned images. No window, surface or swap chain at all
+    kOffscreen,
+    // Swap chain of a VK_EXT_headless_surface surface. No window required
+    kHeadlessSurface,
+};
+
+struct AppConfig {
+    RenderTarget renderTarget{RenderTarget::kWindow};
+    // Stop after this many frames. 0 means run until window is closed.
+    // Headless targets have no window, so they use kDefaultHeadlessFrameCount
+    uint32_t frameCount{};
+    // Pipeline cache file. Empty string disables on-disk pipeline cache
+    std::string pipelineCachePath{"pipeline_cache.bin"};
+    // Record one command buffer per swap chain image once and reuse it every
+    // frame instead of recording a new one per frame
+    bool prerecordCommandBuffers{};
+    // Number of draw calls per frame
+    uint32_t drawCount{1};
+    // Triangle instances drawn by each draw call
+    uint32_t instanceCount{1};
+    // Instances rotated every frame, to exercise partial instance updates
+    uint32_t animatedInstanceCount{};
+    // Threads recording secondary command buffers in parallel.
+    // 0 records everything inline on the main thread
+    uint32_t recordThreadCount{};
+    // Per frame CPU and GPU timings file. Empty string disables profiling
+    std::string profilePath{};
+    // How many frames CPU may record ahead of GPU
+    uint32_t framesInFlight{2};
+    // Present mode to use if surface supports it. Without it latencyPolicy
+    // picks one. Ignored by offscreen target
+    std::optional<VkPresentModeKHR> presentMode{};
+    // Present mode preference and swap chain depth
+    LatencyPolicy latencyPolicy{LatencyPolicy::kBalanced};
+    // Start at most this many frames per second. 0 means unlimited, unless
+    // latencyPolicy is kPower, which uses kDefaultPowerFpsLimit
+    uint32_t fpsLimit{};
+    // Cull instances in a compute pass and draw survivors with indirect draws
+    bool gpuCulling{};
+    // Run culling on a compute only queue, overlapping rendering of the
+    // previous frame. Needs gpuCulling
+    bool asyncCompute{};
+    // Samples per pixel, a power of two. Lowered to the highest count the
+    // device supports. 1 disables multisampling
+    uint32_t msaaSamples{1};
+    // Depth test triangles against a depth buffer
+    bool depth{};
+    // Streamed procedural textures. Draw i samples texture i % textureCount.
+    // 0 disables texturing. Otherwise the device must support the bindless
+    // heap
+    uint32_t textureCount{};
+    // Memory streamed texture mips may take before fine mips are evicted
+    uint32_t textureBudgetMiB{64};
+    // Mesh drawn instead of the triangle: a mesh asset of assetPackPath, or
+    // an OBJ file, which is imported and optimized at startup. Enables depth
+    std::string mesh{};
+    // Load compiled shaders from this directory instead of the ones embedded
+    // into the binary. Lets shaders be changed without rebuilding
+    std::string shaderDirectory{};
+    // Asset pack built by the packer tool. Its shaders override
+    // shaderDirectory and the embedded ones
+    std::string assetPackPath{};
+    // Threads running independent init steps in parallel. 0 or 1 runs them
+    // one by one
+    uint32_t initThreadCount{4};
+    // Use the GPU whose UUID or name matches instead of the best scored one.
+    // Falls back to kDeviceSelectorEnv environment variable
+    std::string deviceSelector{};
+    // Least severe validation message printed in debug builds
+    VkDebugUtilsMessageSeverityFlagBitsEXT debugSeverity{
+        VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT};
+
+    static constexpr const char* kDeviceSelectorEnv{"VULKAN_TEST_DEVICE"};
+
+    static constexpr uint32_t kDefaultHeadlessFrameCount{300};
+    static constexpr uint32_t kDefaultPowerFpsLimit{60};
+
+    bool isHeadless() const { return renderTarget != RenderTarget::kWindow; }
+};
+
+// Args:
+// --headless                  render into offscreen images
+// --headless-surface          render into VK_EXT_headless_surface swap chain
+// --frames:<value>            stop after <value> frames
+// --pipeline-cache:<value>    pipeline cache file, empty to disable
+// --prerecord                 reuse pre-recorded per image command buffers
+// --draws:<value>             issue <value> draw calls per frame
+// --instances:<value>         draw <value> instances per draw call
+// --animate:<value>           rotate <value> instances every frame
+// --threads:<value>           record draws on <value> worker threads
+// --profile:<value>           write per frame timings to <value>
+// --frames-in-flight:<value>  let CPU record up to <value> frames ahead
+// --present-mode:<value>      fifo, fifo-relaxed, mailbox or immediate
+// --latency:<value>           low, balanced, throughput or power
+// --fps-limit:<value>         start at most <value> frames per second
+// --gpu-culling               cull and issue draws on GPU
+// --async-compute             cull on a separate compute queue
+// --msaa:<value>              render with <value> samples per pixel
+// --depth                     depth test against a depth buffer
+// --textures:<value>          stream <value> textures
+// --texture-budget:<value>    keep streamed textures under <value> MiB
+// --mesh:<value>              draw mesh asset or OBJ file <value>
+// --shader-dir:<value>        load compiled shaders from <value>
+// --asset-pack:<value>        load shaders and meshes from asset pack <value>
+// --init-threads:<value>      run init steps on <value> threads
+// --device:<value>            use GPU with <value> UUID or name
+// --debug-severity:<value>    verbose, info, warning or error
+inline AppConfig parseArgs(int argc, char* argv[]) {
+    AppConfig config{};
+
+    for (int i{1}; i < argc; ++i) {
+        std::string arg{argv[i]};  // NOLINT
+
+        if (arg == "--headless") {
+            config.renderTarget = RenderTarget::kOffscreen;
+        } else if (arg == "--headless-surface") {
+            config.renderTarget = RenderTarget::kHeadlessSurface;
+        } else if (arg.starts_with("--frames:")) {
+            config.frameCount = static_cast<uint32_t>(
+                std::stoul(arg.substr(std::strlen("--frames:"))));
+        } else if (arg == "--prerecord") {
+            config.prerecordCommandBuffers = true;
+        } else if (arg.starts_with("--draws:")) {
+            config.drawCount = static_cast<uint32_t>(
+                std::stoul(arg.substr(std::strlen("--draws:"))));
+        } else if (arg.starts_with("--instances:")) {
+            config.instanceCount = static_cast<uint32_t>(
+                std::stoul(arg.substr(std::strlen("--instances:"))));
+        } else if (arg.starts_with("--animate:")) {
+            config.animatedInstanceCount = static_cast<uint32_t>(
+                std::stoul(arg.substr(std::strlen("--animate:"))));
+        } else if (arg.starts_with("--threads:")) {
+            config.recordThreadCount = static_cast<uint32_t>(
+                std::stoul(arg.substr(std::strlen("--threads:"))));
+        } else if (arg.starts_with("--pipeline-cache:")) {
+            config.pipelineCachePath =
+                arg.substr(std::strlen("--pipeline-cache:"));
+        } else if (arg.starts_with("--profile:")) {
+            config.profilePath = arg.substr(std::strlen("--profile:"));
+        } else if (arg.starts_with("--frames-in-flight:")) {
+            config.framesInFlight = static_cast<uint32_t>(
+                std::stoul(arg.substr(std::strlen("--frames-in-flight:"))));
+        } else if (arg.starts_with("--present-mode:")) {
+            std::string mode{arg.substr(std::strlen("--present-mode:"))};
+            if (mode == "fifo") {
+                config.presentMode = VK_PRESENT_MODE_FIFO_KHR;
+            } else if (mode == "fifo-relaxed") {
+                config.presentMode = VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+            } else if (mode == "mailbox") {
+                config.presentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+            } else if (mode == "immediate") {
+                config.presentMode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+            } else {
+                throw std::runtime_error{"Unknown present mode: " + mode};
+            }
+        } else if (arg.starts_with("--latency:")) {
+            std::string policy{arg.substr(std::strlen("--latency:"))};
+            if (policy == "low") {
+                config.latencyPolicy = LatencyPolicy::kLowLatency;
+            } else if (policy == "balanced") {
+                config.latencyPolicy = LatencyPolicy::kBalanced;
+            } else if (policy == "throughput") {
+                config.latencyPolicy = LatencyPolicy::kThroughput;
+            } else if (policy == "power") {
+                config.latencyPolicy = LatencyPolicy::kPower;
+            } else {
+                throw std::runtime_error{"Unknown latency policy: " + policy};
+            }
+        } else if (arg.starts_with("--fps-limit:")) {
+            config.fpsLimit = static_cast<uint32_t>(
+                std::stoul(arg.substr(std::strlen("--fps-limit:"))));
+        } else if (arg == "--gpu-culling") {
+            config.gpuCulling = true;
+        } else if (arg == "--async-compute") {
+            config.asyncCompute = true;
+        } else if (arg.starts_with("--msaa:")) {
+            config.msaaSamples = static_cast<uint32_t>(
+                std::stoul(arg.substr(std::strlen("--msaa:"))));
+            if (!std::has_single_bit(config.msaaSamples) ||
+                config.msaaSamples > VK_SAMPLE_COUNT_64_BIT) {
+                throw std::runtime_error{"Unsupported MSAA sample count: " +
+                                         std::to_string(config.msaaSamples)};
+            }
+        } else if (arg == "--depth") {
+            config.depth = true;
+        } else if (arg.starts_with("--textures:")) {
+            config.textureCount = static_cast<uint32_t>(
+                std::stoul(arg.substr(std::strlen("--textures:"))));
+        } else if (arg.starts_with("--texture-budget:")) {
+            config.textureBudgetMiB = static_cast<uint32_t>(
+                std::stoul(arg.substr(std::strlen("--texture-budget:"))));
+        } else if (arg.starts_with("--mesh:")) {
+            config.mesh = arg.substr(std::strlen("--mesh:"));
+        } else if (arg.starts_with("--shader-dir:")) {
+            config.shaderDirectory = arg.substr(std::strlen("--shader-dir:"));
+        } else if (arg.starts_with("--asset-pack:")) {
+            config.assetPackPath = arg.substr(std::strlen("--asset-pack:"));
+        } else if (arg.starts_with("--device:")) {
+            config.deviceSelector = arg.substr(std::strlen("--device:"));
+        } else if (arg.starts_with("--debug-severity:")) {
+            std::string severity{arg.substr(std::strlen("--debug-severity:"))};
+            if (severity == "verbose") {
+                config.debugSeverity =
+                    VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT;
+            } else if (severity == "info") {
+                config.debugSeverity =
+                    VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT;
+            } else if (severity == "warning") {
+                config.debugSeverity =
+                    VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT;
+            } else if (severity == "error") {
+                config.debugSeverity =
+                    VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+            } else {
+                throw std::runtime_error{"Unknown debug severity: " +
+                                         severity};
+            }
+        } else if (arg.starts_with("--init-threads:")) {
+            config.initThreadCount = static_cast<uint32_t>(
+                std::stoul(arg.substr(std::strlen("--init-threads:"))));
+        } else {
+            throw std::runtime_error{"Unknown argument: " + arg};
+        }
+    }
+
+    // Secondary command buffers come from per frame pools which are reset
+    // every frame, so they can not be kept in pre-recorded command buffers
+    if (config.prerecordCommandBuffers && config.recordThreadCount > 0) {
+        throw std::runtime_error{
+            "--prerecord can not be combined with --threads"};
+    }
+    // Pre-recorded command buffers are reused across frame slots, so they
+    // all bind the same instance buffer copy, which must not change
+    if (config.prerecordCommandBuffers && config.animatedInstanceCount > 0) {
+        throw std::runtime_error{
+            "--prerecord can not be combined with --animate"};
+    }
+    // Culling writes draws into per frame slot buffers and replaces the draw
+    // loop which worker threads split
+    if (config.gpuCulling && config.prerecordCommandBuffers) {
+        throw std::runtime_error{
+            "--gpu-culling can not be combined with --prerecord"};
+    }
+    if (config.gpuCulling && config.recordThreadCount > 0) {
+        throw std::runtime_error{
+            "--gpu-culling can not be combined with --threads"};
+    }
+    // Texture slots change as mips stream in, pre-recorded command buffers
+    // would keep sampling the first ones
+    if (config.textureCount > 0 && config.prerecordCommandBuffers) {
+        throw std::runtime_error{
+            "--textures can not be combined with --prerecord"};
+    }
+    // Triangles of a mesh overlap each other
+    if (!config.mesh.empty()) {
+        config.depth = true;
+    }
+    if (config.asyncCompute && !config.gpuCulling) {
+        throw std::runtime_error{"--async-compute requires --gpu-culling"};
+    }
+    if (config.framesInFlight == 0) {
+        throw std::runtime_error{"--frames-in-flight must be at least 1"};
+    }
+
+    if (config.latencyPolicy == LatencyPolicy::kPower &&
+        config.fpsLimit == 0) {
+        config.fpsLimit = AppConfig::kDefaultPowerFpsLimit;
+    }
+
+    if (config.isHeadless() && config.frameCount == 0) {
+        config.frameCount = AppConfig::kDefaultHeadlessFrameCount;
+    }
+
+    return config;
+}
+
+class HelloTriangleApplication {
+   public:
+    explicit HelloTriangleApplication(const AppConfig& config)
+        : maxFramesInFlight_{config.framesInFlight},
+          config_{config},
+          assetPack_{config.assetPackPath.empty()
+                         ? nullptr
+                         : std::make_unique<AssetPack>(config.assetPackPath)},
+          shaders_{config.shaderDirectory, assetPack_.get()},
+          frameLimiter_{config.fpsLimit} {}
+
+    void run() {
+        runStart_ = std::chrono::steady_clock::now();
+        initWindow();
+        initVulkan();
+        initMs_ = msSinceRunStart();
+        mainLoop();
+        cleanup();
+    }
+
+    // CPU time of every frame of the last run(), in milliseconds
+    const std::vector<double>& frameTimes() const { return frameTimes_; }
+    // Time from the start of run() until Vulkan init finished and until the
+    // first frame was submitted for presentation, in milliseconds
+    double initMs() const { return initMs_; }
+    double timeToFirstFrameMs() const { return timeToFirstFrameMs_; }
+    // Time from sampling input until the frame built from it was handed to
+    // presentation engine, or submitted for offscreen target, in
+    // milliseconds. Frames which were not presented are left out
+    const std::vector<double>& inputToPresentTimes() const {
+        return inputToPresentTimes_;
+    }
+    // VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT messages of the last
+    // run(). Always 0 without validation layers
+    uint64_t performanceWarningCount() const {
+        return performanceWarningCount_;
+    }
+    // Samples per pixel actually used, may be below config.msaaSamples
+    uint32_t msaaSamples() const { return sampleCount_; }
+    // Triangles drawn per instance, 1 without a mesh
+    uint32_t trianglesPerInstance() const {
+        return meshBuffer_ ? meshBuffer_->indexCount() / 3 : 1;
+    }
+
+   private:
+    void initWindow() {
+        // Headless targets never touch GLFW, so no display is required
+        if (config_.isHeadless()) {
+            return;
+        }
+
+        glfwInit();
+        glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+        glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
+
+        window_ = glfwCreateWindow(kWidth_, kHeight_, "My Vulkan test app",
+                                   nullptr, nullptr);
+        glfwSetWindowUserPointer(window_, this);
+        glfwSetFramebufferSizeCallback(window_, framebufferResizeCallback);
+    };
+    // Not all drivers report VK_ERROR_OUT_OF_DATE_KHR on resize, so track
+    // resizes explicitly
+    static void framebufferResizeCallback(GLFWwindow* window, int /*width*/,
+                                          int /*height*/) {
+        auto* app{reinterpret_cast<HelloTriangleApplication*>(
+            glfwGetWindowUserPointer(window))};
+        app->framebufferResized_ = true;
+    }
+    // Init steps form a task graph, so steps which do not depend on each
+    // other run in parallel. E.g. pipelines compile while swap chain and
+    // framebuffers are created: render pass only needs the surface format.
+    // Steps write disjoint members, and graph orders writes before reads.
+    // Steps may run on any thread, so GLFW functions which must be called
+    // from the main thread run before the graph
+    void initVulkan() {
+        readFramebufferExtent();
+
+        TaskGraph init{};
+        using Deps = std::vector<TaskGraph::TaskId>;
+
+        auto instance{init.add("instance", [this] { createInstance(); })};
+        init.add("debug messenger", [this] { setupDebugMessenger(); },
+                 Deps{instance});
+        auto surface{
+            init.add("surface", [this] { createSurface(); }, Deps{instance})};
+        auto physical_device{init.add(
+            "physical device", [this] { pickPhysicalDevice(); },
+            Deps{surface})};
+        auto device{init.add(
+            "logical device", [this] { createLogicalDevice(); },
+            Deps{physical_device})};
+
+        auto allocator{init.add(
+            "memory allocator", [this] { createMemoryAllocator(); },
+            Deps{device})};
+        auto uploads{init.add(
+            "upload manager", [this] { createUploadManager(); },
+            Deps{allocator})};
+        init.add("profiler", [this] { createProfiler(); }, Deps{device});
+        auto bindless_heap{init.add(
+            "bindless heap", [this] { createBindlessHeap(); }, Deps{device})};
+        init.add("texture streamer", [this] { createTextureStreamer(); },
+                 Deps{uploads, bindless_heap});
+        auto instances{init.add(
+            "instance buffer", [this] { createInstanceBuffer(); },
+            Deps{allocator})};
+        auto pipeline_cache{init.add(
+            "pipeline cache", [this] { createPipelineCache(); },
+            Deps{device})};
+        auto mesh{init.add("mesh", [this] { createMeshBuffer(); },
+                            Deps{uploads})};
+        auto gpu_culler{init.add(
+            "gpu culler", [this] { createGpuCuller(); },
+            Deps{uploads, instances, pipeline_cache, mesh})};
+
+        auto format{init.add(
+            "surface format", [this] { selectSwapChainFormat(); },
+            Deps{physical_device})};
+        auto images{
+            config_.renderTarget == RenderTarget::kOffscreen
+                ? init.add(
+                      "offscreen images", [this] { createOffscreenImages(); },
+                      Deps{allocator, format})
+                : init.add("swap chain", [this] { createSwapChain(); },
+                           Deps{device, format})};
+        auto image_views{init.add(
+            "image views", [this] { createImageViews(); }, Deps{images})};
+        auto frame_data{init.add(
+            "frame data ring", [this] { createFrameDataRing(); },
+            Deps{allocator, images})};
+        auto attachments{init.add(
+            "attachment formats", [this] { selectAttachmentFormats(); },
+            Deps{physical_device})};
+        auto render_pass{init.add(
+            "render pass", [this] { createRenderPass(); },
+            Deps{device, format, attachments})};
+        init.add("graphics pipeline", [this] { createGraphicsPipeline(); },
+                 Deps{render_pass, pipeline_cache, bindless_heap, frame_data});
+        auto render_graph{init.add(
+            "render graph", [this] { createRenderGraph(); },
+            Deps{allocator, images, attachments, gpu_culler})};
+        auto framebuffers{init.add(
+            "framebuffers", [this] { createFramebuffers(); },
+            Deps{image_views, render_pass, render_graph})};
+
+        auto command_pool{init.add(
+            "command pool", [this] { createCommandPool(); }, Deps{device})};
+        init.add("command buffers", [this] { createCommandBuffers(); },
+                 Deps{command_pool, framebuffers, mesh});
+        init.add("worker command pools",
+                 [this] { createWorkerCommandPools(); }, Deps{device});
+        init.add("sync objects", [this] { createSyncObjects(); },
+                 Deps{images});
+
+        init.run(config_.initThreadCount);
+
+        for (const auto& timing : init.timings()) {
+            std::cout << "Init " << timing.name << ": started at "
+                      << timing.startMs << " ms, took " << timing.durationMs
+                      << " ms on thread " << timing.thread << '\n';
+        }
+        renderGraph_->printStatistics(std::cout);
+    }
+    void mainLoop() {
+        frameTimes_.clear();
+        frameTimes_.reserve(config_.frameCount);
+        inputToPresentTimes_.clear();
+        inputToPresentTimes_.reserve(config_.frameCount);
+
+        for (uint32_t frame{};
+             config_.frameCount == 0 || frame < config_.frameCount;) {
+            {
+                CpuScope scope{profiler_.get(), "frame limiter"};
+                frameLimiter_.wait();
+            }
+            auto frame_start{std::chrono::steady_clock::now()};
+
+            // Events are polled by drawFrame(), as late as possible
+            if (window_ != nullptr && glfwWindowShouldClose(window_)) {
+                break;
+            }
+            // Out of date swap chain was recreated instead, so nothing is
+            // counted and the frame is retried
+            if (!drawFrame()) {
+                continue;
+            }
+            if (frame == 0) {
+                timeToFirstFrameMs_ = msSinceRunStart();
+                std::cout << "Init took " << initMs_
+                          << " ms, first frame submitted after "
+                          << timeToFirstFrameMs_ << " ms\n";
+            }
+
+            frameTimes_.push_back(std::chrono::duration<double, std::milli>(
+                                      std::chrono::steady_clock::now() -
+                                      frame_start)
+                                      .count());
+            ++frame;
+        }
+
+        vkDeviceWaitIdle(device_);
+
+        if (recordedFrameCount_ > 0) {
+            std::cout << "Average command buffer recording time: "
+                      << recordTime_.count() /
+                             static_cast<double>(recordedFrameCount_)
+                      << " ms (" << config_.drawCount << " draws, "
+                      << config_.recordThreadCount << " threads)\n";
+        }
+        if (!inputToPresentTimes_.empty()) {
+            std::vector<double> sorted{inputToPresentTimes_};
+            std::ranges::sort(sorted);
+            double total_ms{};
+            for (double time : sorted) {
+                total_ms += time;
+            }
+            std::cout << "Input to present: "
+                      << total_ms / static_cast<double>(sorted.size())
+                      << " ms average, "
+                      << percentile(sorted, 99.0) << " ms p99\n";
+        }
+        memoryAllocator_->printStatistics(std::cout);
+
+        if (profiler_ && profiler_->droppedEvents() > 0) {
+            std::cout << "Profiler dropped " << profiler_->droppedEvents()
+                      << " events\n";
+        }
+    }
+    void cleanup() {
+        for (uint32_t i{}; i < maxFramesInFlight_; ++i) {
+            vkDestroySemaphore(device_, imageAvailableSemaphores_[i], nullptr);
+            vkDestroySemaphore(device_, renderFinishedSemaphores_[i], nullptr);
+            vkDestroyFence(device_, inFlightFences_[i], nullptr);
+        }
+        for (auto* semaphore : computeFinishedSemaphores_) {
+            vkDestroySemaphore(device_, semaphore, nullptr);
+        }
+
+        // Join workers before destroying pools they record into
+        recordThreadPool_.reset();
+        for (auto* command_pool : workerCommandPools_) {
+            vkDestroyCommandPool(device_, command_pool, nullptr);
+        }
+        vkDestroyCommandPool(device_, commandPool_, nullptr);
+        vkDestroyCommandPool(device_, computeCommandPool_, nullptr);
+
+        destroyRetiredSwapChains(true);
+        for (auto* framebuffer : swapChainFramebuffers_) {
+            vkDestroyFramebuffer(device_, framebuffer, nullptr);
+        }
+
+        vkDestroyPipeline(device_, graphicsPipeline_, nullptr);
+        vkDestroyPipelineLayout(device_, pipelineLayout_, nullptr);
+        vkDestroyDescriptorSetLayout(device_, emptySetLayout_, nullptr);
+        vkDestroyRenderPass(device_, renderPass_, nullptr);
+
+        for (auto* image_view : swapChainImageViews_) {
+            vkDestroyImageView(device_, image_view, nullptr);
+        }
+        vkDestroyImageView(device_, msaaColorView_, nullptr);
+        vkDestroyImageView(device_, depthView_, nullptr);
+
+        for (size_t i{}; i < offscreenImageMemory_.size(); ++i) {
+            vkDestroyImage(device_, swapChainImages_[i], nullptr);
+            memoryAllocator_->free(offscreenImageMemory_[i]);
+        }
+
+        vkDestroySwapchainKHR(device_, swapChain_, nullptr);
+
+        savePipelineCache();
+        vkDestroyPipelineCache(device_, pipelineCache_, nullptr);
+
+        renderGraph_.reset();
+        textureStreamer_.reset();
+        bindlessHeap_.reset();
+        vkDestroySampler(device_, defaultSampler_, nullptr);
+        frameDataRing_.reset();
+        profiler_.reset();
+        gpuCuller_.reset();
+        meshBuffer_.reset();
+        instanceBuffer_.reset();
+        uploadManager_.reset();
+        memoryAllocator_.reset();
+        vkDestroyDevice(device_, nullptr);
+
+        if (enableValidationLayers) {
+            DestroyDebugUtilsMessengerEXT(instance_, debugMessenger_, nullptr);
+        }
+        vkDestroySurfaceKHR(instance_, surface_, nullptr);
+        vkDestroyInstance(instance_, nullptr);
+
+        // Instance reports its own destruction, so sink goes after it
+        if (debugMessageSink_) {
+            performanceWarningCount_ =
+                debugMessageSink_->performanceWarningCount();
+            debugMessageSink_.reset();
+        }
+
+        if (window_ != nullptr) {
+            glfwDestroyWindow(window_);
+            glfwTerminate();
+        }
+    }
+
+    // Highest version the loader supports, up to 1.2. Features of later
+    // versions are used through extensions, so 1.0 works as well
+    static uint32_t instanceApiVersion() {
+        // nullptr for a 1.0 loader
+        auto enumerate_version{
+            reinterpret_cast<PFN_vkEnumerateInstanceVersion>(
+                vkGetInstanceProcAddr(nullptr, "vkEnumerateInstanceVersion"))};
+        uint32_t version{VK_API_VERSION_1_0};
+        if (enumerate_version != nullptr &&
+            enumerate_version(&version) != VK_SUCCESS) {
+            version = VK_API_VERSION_1_0;
+        }
+        return std::min<uint32_t>(version, VK_API_VERSION_1_2);
+    }
+
+    void createInstance() {
+        if (enableValidationLayers && !checkValidationLayerSupport()) {
+            throw std::runtime_error(
+                "validation layers requested, but not available!");
+        }
+
+        VkApplicationInfo app_info{};
+        app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+        app_info.pApplicationName = "Hello triangle";
+        app_info.applicationVersion = VK_MAKE_VERSION(0, 0, 1);
+        app_info.pEngineName = "No engine";
+        app_info.engineVersion = VK_MAKE_VERSION(1, 0, 0);
+        app_info.apiVersion = instanceApiVersion();
+
+        VkInstanceCreateInfo create_info{};
+        create_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+        create_info.pApplicationInfo = &app_info;
+
+        std::vector<const char*> extensions{getRequiredExtensions(config_)};
+        create_info.enabledExtensionCount =
+            static_cast<uint32_t>(extensions.size());
+        create_info.ppEnabledExtensionNames = extensions.data();
+
+        VkDebugUtilsMessengerCreateInfoEXT debug_create_info{};
+        if (enableValidationLayers) {
+            create_info.enabledLayerCount =
+                static_cast<uint32_t>(validationLayers.size());
+            create_info.ppEnabledLayerNames = validationLayers.data();
+
+            DebugMessageSink::Filter filter{};
+            filter.minSeverity = config_.debugSeverity;
+            debugMessageSink_ =
+                std::make_unique<DebugMessageSink>(std::cerr, filter);
+
+            // Covers messages of vkCreateInstance and vkDestroyInstance
+            debugMessageSink_->populateCreateInfo(debug_create_info);
+            create_info.pNext = &debug_create_info;
+        } else {
+            create_info.enabledLayerCount = 0;
+
+            create_info.pNext = nullptr;
+        }
+
+        // printExtensionSupport(true);
+
+        if (vkCreateInstance(&create_info, nullptr, &instance_) != VK_SUCCESS) {
+            throw std::runtime_error{"Failed to create instance"};
+        };
+    }
+    static void printExtensionSupport(bool verbose) {
+        // Supported extension list
+        uint32_t extension_count{};
+        vkEnumerateInstanceExtensionProperties(nullptr, &extension_count,
+                                               nullptr);
+        std::vector<VkExtensionProperties> extensions(extension_count);
+        vkEnumerateInstanceExtensionProperties(nullptr, &extension_count,
+                                               extensions.data());
+
+        std::cout << "Total supported extension count: " << extension_count
+                  << '\n';
+        if (verbose) {
+            for (const auto& i : extensions) {
+                std::cout << '\t' << i.extensionName << '\n';
+            }
+        }
+
+        // GLFW extension list
+        uint32_t glfw_extension_count{};
+        const char** glfw_extensions{
+            glfwGetRequiredInstanceExtensions(&glfw_extension_count)};
+
+        std::cout << "GLFW required extension count: " << glfw_extension_count
+                  << '\n';
+        if (verbose) {
+            for (int i{0}; i < glfw_extension_count; ++i) {
+                std::cout << '\t' << glfw_extensions[i] << '\n';
+            }
+        }
+    }
+    static std::vector<const char*> getRequiredExtensions(
+        const AppConfig& config) {
+        std::vector<const char*> extensions{};
+
+        switch (config.renderTarget) {
+            case RenderTarget::kWindow: {
+                uint32_t glfw_extension_count = 0;
+                const char** glfw_extensions{
+                    glfwGetRequiredInstanceExtensions(&glfw_extension_count)};
+
+                extensions.assign(glfw_extensions,
+                                  glfw_extensions + glfw_extension_count);
+                break;
+            }
+            case RenderTarget::kOffscreen:
+                break;
+            case RenderTarget::kHeadlessSurface:
+                extensions.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
+                extensions.push_back(VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME);
+                break;
+        }
+
+        if (enableValidationLayers) {
+            extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+        }
+        // Reads device UUIDs and descriptor indexing features. Without it no
+        // device supports the bindless heap
+        if (isInstanceExtensionSupported(
+                VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME)) {
+            extensions.push_back(
+                VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+        }
+
+        return extensions;
+    }
+    static bool isInstanceExtensionSupported(const char* name) {
+        uint32_t extension_count{};
+        vkEnumerateInstanceExtensionProperties(nullptr, &extension_count,
+                                               nullptr);
+        std::vector<VkExtensionProperties> extensions(extension_count);
+        vkEnumerateInstanceExtensionProperties(nullptr, &extension_count,
+                                               extensions.data());
+
+        return std::any_of(extensions.begin(), extensions.end(),
+                           [name](const VkExtensionProperties& extension) {
+                               return std::strcmp(extension.extensionName,
+                                                  name) == 0;
+                           });
+    }
+
+    void setupDebugMessenger() {
+        if (!enableValidationLayers) {
+            return;
+        }
+
+        VkDebugUtilsMessengerCreateInfoEXT create_info{};
+        debugMessageSink_->populateCreateInfo(create_info);
+
+        if (CreateDebugUtilsMessengerEXT(instance_, &create_info, nullptr,
+                                         &debugMessenger_) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to set up debug messenger!");
+        }
+    }
+    static bool checkValidationLayerSupport() {
+        uint32_t layer_count;
+        vkEnumerateInstanceLayerProperties(&layer_count, nullptr);
+
+        std::vector<VkLayerProperties> available_layers(layer_count);
+        vkEnumerateInstanceLayerProperties(&layer_count,
+                                           available_layers.data());
+
+        for (const char* layer_name : validationLayers) {
+            bool layer_found = false;
+
+            for (const auto& layer_properties : available_layers) {
+                if (strcmp(layer_name, layer_properties.layerName) == 0) {
+                    layer_found = true;
+                    break;
+                }
+            }
+
+            if (!layer_found) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    void pickPhysicalDevice() {
+        uint32_t device_count{};
+
+        vkEnumeratePhysicalDevices(instance_, &device_count, nullptr);
+
+        if (device_count == 0) {
+            throw std::runtime_error{
+                "Failed to find GPUs with Vulkan support!"};
+        }
+
+        std::vector<VkPhysicalDevice> devices(device_count);
+        vkEnumeratePhysicalDevices(instance_, &device_count, devices.data());
+
+        // nullptr if VK_KHR_get_physical_device_properties2 is not enabled
+        auto get_properties2{
+            reinterpret_cast<PFN_vkGetPhysicalDeviceProperties2KHR>(
+                vkGetInstanceProcAddr(instance_,
+                                      "vkGetPhysicalDeviceProperties2KHR"))};
+
+        std::vector<DeviceScore> candidates{};
+        for (const VkPhysicalDevice& i : devices) {
+            DeviceScore score{scorePhysicalDevice(i, get_properties2)};
+            if (isDeviceSuitable(i)) {
+                candidates.push_back(std::move(score));
+            } else {
+                std::cout << "GPU \"" << score.name << "\" is not suitable\n";
+            }
+        }
+
+        if (candidates.empty()) {
+            throw std::runtime_error{
+                config_.textureCount > 0
+                    ? "Failed to find a suitable GPU! --textures requires "
+                      "descriptor indexing support"
+                    : "Failed to find a suitable GPU!"};
+        }
+
+        // Command line wins over environment
+        std::string selector{config_.deviceSelector};
+        if (const char* env{std::getenv(AppConfig::kDeviceSelectorEnv)};
+            selector.empty() && env != nullptr) {
+            selector = env;
+        }
+
+        // Highest score wins, ties go to the first enumerated device
+        auto chosen{std::ranges::max_element(
+            candidates, {}, [](const DeviceScore& score) {
+                return score.total;
+            })};
+        if (!selector.empty()) {
+            chosen = std::ranges::find_if(
+                candidates, [&selector](const DeviceScore& score) {
+                    return matchesDeviceSelector(score, selector);
+                });
+            if (chosen == candidates.end()) {
+                throw std::runtime_error{
+                    "No suitable GPU matches device selector: " + selector};
+            }
+        }
+
+        for (auto it{candidates.begin()}; it != candidates.end(); ++it) {
+            std::cout << (it == chosen ? "* GPU " : "  GPU ");
+            printDeviceScore(std::cout, *it);
+            std::cout << '\n';
+        }
+        std::cout << "Using GPU \"" << chosen->name << '"'
+                  << (selector.empty() ? " with the highest score"
+                                       : " matching \"" + selector + '"')
+                  << '\n';
+
+        physicalDevice_ = chosen->device;
+    }
+    // Check if GPU suitable for this app
+    bool isDeviceSuitable(const VkPhysicalDevice& device) {
+        bool extensions_supported{checkDeviceExtensionSupport(device)};
+
+        QueueFamilyIndices indices{findQueueFamilyIndices(device)};
+
+        // Offscreen target does not need a swap chain
+        bool swap_chain_adequate{config_.renderTarget ==
+                                 RenderTarget::kOffscreen};
+        if (extensions_supported && !swap_chain_adequate) {
+            SwapChainSupportDetails swap_chain_support{
+                querySwapChainSupport(device)};
+            swap_chain_adequate = !swap_chain_support.formats.empty() &&
+                                  !swap_chain_support.presentModes.empty();
+        }
+
+        // nullptr if VK_KHR_get_physical_device_properties2 is not enabled
+        auto get_features2{
+            reinterpret_cast<PFN_vkGetPhysicalDeviceFeatures2KHR>(
+                vkGetInstanceProcAddr(instance_,
+                                      "vkGetPhysicalDeviceFeatures2KHR"))};
+        // Only textures are read through the heap
+        bool bindless_supported{
+            config_.textureCount == 0 ||
+            (extensions_supported &&
+             BindlessHeap::isSupported(device, get_features2))};
+
+        return indices.isComplete() && extensions_supported &&
+               swap_chain_adequate && bindless_supported;
+    }
+
+    std::vector<const char*> getRequiredDeviceExtensions() const {
+        std::vector<const char*> extensions{};
+        if (config_.textureCount > 0) {
+            extensions.assign(BindlessHeap::kDeviceExtensions.begin(),
+                              BindlessHeap::kDeviceExtensions.end());
+        }
+        if (config_.renderTarget != RenderTarget::kOffscreen) {
+            extensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+        }
+
+        return extensions;
+    }
+
+    // Check if a GPU supports all extension required for this program
+    bool checkDeviceExtensionSupport(const VkPhysicalDevice& device) {
+        uint32_t extension_count{};
+        vkEnumerateDeviceExtensionProperties(device, nullptr, &extension_count,
+                                             nullptr);
+
+        // All GPU supported extensions
+        std::vector<VkExtensionProperties> available_extensions(
+            extension_count);
+        vkEnumerateDeviceExtensionProperties(device, nullptr, &extension_count,
+                                             available_extensions.data());
+
+        // Extensions required for the current program
+        std::vector<const char*> device_extensions{
+            getRequiredDeviceExtensions()};
+        std::set<std::string> required_extensions{device_extensions.begin(),
+                                                  device_extensions.end()};
+
+        for (const auto& extension : available_extensions) {
+            required_extensions.erase(extension.extensionName);
+        }
+
+        return required_extensions.empty();
+    }
+
+    static bool isDeviceExtensionSupported(const VkPhysicalDevice& device,
+                                           const char* name) {
+        uint32_t extension_count{};
+        vkEnumerateDeviceExtensionProperties(device, nullptr, &extension_count,
+                                             nullptr);
+        std::vector<VkExtensionProperties> available_extensions(
+            extension_count);
+        vkEnumerateDeviceExtensionProperties(device, nullptr, &extension_count,
+                                             available_extensions.data());
+
+        return std::any_of(available_extensions.begin(),
+                           available_extensions.end(),
+                           [name](const VkExtensionProperties& extension) {
+                               return std::strcmp(extension.extensionName,
+                                                  name) == 0;
+                           });
+    }
+
+    struct QueueFamilyIndices {
+        std::optional<uint32_t> graphicsFamily;
+        std::optional<uint32_t> presentFamily;
+        // Transfer only family if device has one, graphics family otherwise
+        std::optional<uint32_t> transferFamily;
+        // Compute family without graphics if device has one, graphics family
+        // otherwise
+        std::optional<uint32_t> computeFamily;
+
+        bool isComplete() const {
+            return graphicsFamily.has_value() && presentFamily.has_value();
+        }
+        void reset() {
+            graphicsFamily.reset();
+            presentFamily.reset();
+            transferFamily.reset();
+            computeFamily.reset();
+        }
+    };
+    QueueFamilyIndices findQueueFamilyIndices(const VkPhysicalDevice& device) {
+        QueueFamilyIndices indices{};
+
+        uint32_t queue_family_count{};
+
+        vkGetPhysicalDeviceQueueFamilyProperties(device, &queue_family_count,
+                                                 nullptr);
+
+        std::vector<VkQueueFamilyProperties> queue_families(queue_family_count);
+        vkGetPhysicalDeviceQueueFamilyProperties(device, &queue_family_count,
+                                                 queue_families.data());
+
+        int i{};
+
+        for (const auto& queue_family : queue_families) {
+            // indices.reset();
+
+            // Transfer only families usually map to dedicated DMA engines
+            if ((queue_family.queueFlags & VK_QUEUE_TRANSFER_BIT) &&
+                !(queue_family.queueFlags &
+                  (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) &&
+                !indices.transferFamily.has_value()) {
+                indices.transferFamily = i;
+            }
+            // Compute families without graphics usually run asynchronously to
+            // the graphics one
+            if ((queue_family.queueFlags & VK_QUEUE_COMPUTE_BIT) &&
+                !(queue_family.queueFlags & VK_QUEUE_GRAPHICS_BIT) &&
+                !indices.computeFamily.has_value()) {
+                indices.computeFamily = i;
+            }
+
+            if (indices.isComplete()) {
+                ++i;
+                continue;
+            }
+
+            if (queue_family.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+                indices.graphicsFamily = i;
+            }
+
+            VkBool32 present_support{};
+            // Nothing is presented without a surface, so graphics queue is
+            // used in place of present queue
+            if (surface_ == VK_NULL_HANDLE) {
+                present_support =
+                    static_cast<VkBool32>(indices.graphicsFamily == i);
+            } else {
+                vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface_,
+                                                     &present_support);
+            }
+            if (present_support) {
+                indices.presentFamily = i;
+            }
+
+            ++i;
+        }
+
+        // Graphics queues support transfers too
+        if (!indices.transferFamily.has_value()) {
+            indices.transferFamily = indices.graphicsFamily;
+        }
+        // Graphics families must support compute too
+        if (!indices.computeFamily.has_value()) {
+            indices.computeFamily = indices.graphicsFamily;
+        }
+
+        return indices;
+    }
+
+    void createLogicalDevice() {
+        QueueFamilyIndices indices{findQueueFamilyIndices(physicalDevice_)};
+
+        std::vector<VkDeviceQueueCreateInfo> queue_create_infos{};
+        std::set<uint32_t> unique_queue_families{
+            indices.graphicsFamily.value(), indices.presentFamily.value(),
+            indices.transferFamily.value(), indices.computeFamily.value()};
+
+        float queue_priority{1.0};
+
+        for (uint32_t queue_family : unique_queue_families) {
+            VkDeviceQueueCreateInfo queue_create_info{};
+            queue_create_info.sType =
+                VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+            queue_create_info.queueFamilyIndex = queue_family;
+            queue_create_info.queueCount = 1;
+            queue_create_info.pQueuePriorities = &queue_priority;
+
+            queue_create_infos.push_back(queue_create_info);
+        }
+
+        VkPhysicalDeviceFeatures device_features{};
+        std::vector<const char*> device_extensions{
+            getRequiredDeviceExtensions()};
+        if (config_.gpuCulling) {
+            enableIndirectDrawFeatures(device_features, device_extensions);
+        }
+        // Only reports whether pipelines came from the pipeline cache
+        pipelineFeedbackSupported_ = isDeviceExtensionSupported(
+            physicalDevice_, VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME);
+        if (pipelineFeedbackSupported_) {
+            device_extensions.push_back(
+                VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME);
+        }
+        cullerFeatures_.pipelineCreationFeedback = pipelineFeedbackSupported_;
+        VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexing_features{};
+        if (config_.textureCount > 0) {
+            BindlessHeap::enableFeatures(device_features, indexing_features);
+            enableTextureCompressionFeatures(device_features);
+        }
+
+        VkDeviceCreateInfo create_info{};
+        create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+        create_info.pNext =
+            config_.textureCount > 0 ? &indexing_features : nullptr;
+        create_info.pQueueCreateInfos = queue_create_infos.data();
+        create_info.queueCreateInfoCount =
+            static_cast<uint32_t>(queue_create_infos.size());
+        create_info.pEnabledFeatures = &device_features;
+
+        create_info.enabledExtensionCount =
+            static_cast<uint32_t>(device_extensions.size());
+        create_info.ppEnabledExtensionNames = device_extensions.data();
+
+        if (enableValidationLayers) {
+            create_info.enabledLayerCount =
+                static_cast<uint32_t>(validationLayers.size());
+            create_info.ppEnabledLayerNames = validationLayers.data();
+        } else {
+            create_info.enabledLayerCount = 0;
+        }
+
+        if (vkCreateDevice(physicalDevice_, &create_info, nullptr, &device_) !=
+            VK_SUCCESS) {
+            throw std::runtime_error{"Failed to create logical device!"};
+        }
+
+        vkGetDeviceQueue(device_, indices.graphicsFamily.value(), 0,
+                         &graphicsQueue_);
+        vkGetDeviceQueue(device_, indices.presentFamily.value(), 0,
+                         &presentQueue_);
+        vkGetDeviceQueue(device_, indices.transferFamily.value(), 0,
+                         &transferQueue_);
+        vkGetDeviceQueue(device_, indices.computeFamily.value(), 0,
+                         &computeQueue_);
+
+        // Work submitted to the graphics queue runs in order anyway
+        if (config_.asyncCompute) {
+            asyncCompute_ = indices.computeFamily != indices.graphicsFamily;
+            if (!asyncCompute_) {
+                std::cout << "Device has no compute only queue family, "
+                             "culling runs on graphics queue\n";
+            }
+        }
+
+        if (config_.gpuCulling && drawIndirectCountSupported_ &&
+            cullerFeatures_.multiDrawIndirect) {
+            cullerFeatures_.drawIndexedIndirectCount =
+                reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(
+                    vkGetDeviceProcAddr(device_,
+                                        "vkCmdDrawIndexedIndirectCountKHR"));
+        }
+    }
+    // Culled instances are drawn by instance index through firstInstance of
+    // indirect commands, so that feature is required. Batching commands into
+    // one call and reading their count on GPU are optional. A count is only
+    // read together with batching, as it would draw one command otherwise
+    void enableIndirectDrawFeatures(
+        VkPhysicalDeviceFeatures& device_features,
+        std::vector<const char*>& device_extensions) {
+        VkPhysicalDeviceFeatures supported{};
+        vkGetPhysicalDeviceFeatures(physicalDevice_, &supported);
+
+        if (supported.drawIndirectFirstInstance != VK_TRUE) {
+            throw std::runtime_error{
+                "GPU culling requires drawIndirectFirstInstance feature!"};
+        }
+        device_features.drawIndirectFirstInstance = VK_TRUE;
+        device_features.multiDrawIndirect = supported.multiDrawIndirect;
+
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(physicalDevice_, &properties);
+
+        cullerFeatures_.multiDrawIndirect =
+            supported.multiDrawIndirect == VK_TRUE;
+        cullerFeatures_.maxDrawIndirectCount =
+            cullerFeatures_.multiDrawIndirect
+                ? std::max(properties.limits.maxDrawIndirectCount, 1U)
+                : 1;
+
+        drawIndirectCountSupported_ =
+            cullerFeatures_.multiDrawIndirect &&
+            isDeviceExtensionSupported(
+                physicalDevice_, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+        if (drawIndirectCountSupported_) {
+            device_extensions.push_back(
+                VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+        }
+    }
+
+    // Streamed textures fall back to uncompressed formats, so both features
+    // are optional
+    void enableTextureCompressionFeatures(
+        VkPhysicalDeviceFeatures& device_features) {
+        VkPhysicalDeviceFeatures supported{};
+        vkGetPhysicalDeviceFeatures(physicalDevice_, &supported);
+
+        device_features.textureCompressionBC = supported.textureCompressionBC;
+        device_features.textureCompressionETC2 =
+            supported.textureCompressionETC2;
+        textureFeatures_.textureCompressionBC =
+            supported.textureCompressionBC == VK_TRUE;
+        textureFeatures_.textureCompressionETC2 =
+            supported.textureCompressionETC2 == VK_TRUE;
+    }
+
+    // All buffer and image memory is sub-allocated from large blocks
+    void createMemoryAllocator() {
+        memoryAllocator_ =
+            std::make_unique<DeviceMemoryAllocator>(physicalDevice_, device_);
+    }
+
+    // Uploads run on transfer queue and are handed over to graphics queue
+    void createUploadManager() {
+        QueueFamilyIndices indices{findQueueFamilyIndices(physicalDevice_)};
+
+        uploadManager_ = std::make_unique<UploadManager>(
+            device_, *memoryAllocator_, transferQueue_,
+            indices.transferFamily.value(), indices.graphicsFamily.value());
+    }
+
+    // Families which share buffers written or read by async compute. Empty
+    // when everything runs on graphics queue
+    std::vector<uint32_t> asyncComputeQueueFamilies() {
+        if (!asyncCompute_) {
+            return {};
+        }
+
+        QueueFamilyIndices indices{findQueueFamilyIndices(physicalDevice_)};
+        return {indices.graphicsFamily.value(), indices.computeFamily.value()};
+    }
+
+    // Lay instances of all draw calls out on a grid covering the screen.
+    // A single instance covers the screen like the original triangle
+    void createInstanceBuffer() {
+        uint64_t total{static_cast<uint64_t>(config_.drawCount) *
+                       config_.instanceCount};
+        if (total == 0 || total > std::numeric_limits<uint32_t>::max()) {
+            throw std::runtime_error{"Invalid instance count!"};
+        }
+
+        instanceBuffer_ = std::make_unique<InstanceBuffer>(
+            device_, *memoryAllocator_, static_cast<uint32_t>(total),
+            maxFramesInFlight_, asyncComputeQueueFamilies());
+
+        auto side{static_cast<uint32_t>(
+            std::ceil(std::sqrt(static_cast<double>(total))))};
+        float cell{2.0F / static_cast<float>(side)};
+
+        for (uint32_t i{}; i < instanceBuffer_->size(); ++i) {
+            instanceBuffer_->setOffset(
+                i, {-1.0F + cell * (static_cast<float>(i % side) + 0.5F),
+                    -1.0F + cell * (static_cast<float>(i / side) + 0.5F)});
+            instanceBuffer_->setScale(i, cell / 2.0F);
+            if (total > 1) {
+                // Cheap hash, so neighbours get different tints
+                instanceBuffer_->setColor(i, (i * 2654435761U) | 0xFF808080U);
+            }
+        }
+    }
+    void animateInstances() {
+        uint32_t count{
+            std::min(config_.animatedInstanceCount, instanceBuffer_->size())};
+        for (uint32_t i{}; i < count; ++i) {
+            instanceBuffer_->setRotation(i,
+                                         instanceBuffer_->rotation(i) + 0.02F);
+        }
+    }
+
+    // GPU timestamps need a query pool, so profiler lives as long as device
+    void createProfiler() {
+        if (config_.profilePath.empty()) {
+            return;
+        }
+
+        QueueFamilyIndices indices{findQueueFamilyIndices(physicalDevice_)};
+
+        uint32_t queue_family_count{};
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice_,
+                                                 &queue_family_count, nullptr);
+        std::vector<VkQueueFamilyProperties> queue_families(queue_family_count);
+        vkGetPhysicalDeviceQueueFamilyProperties(
+            physicalDevice_, &queue_family_count, queue_families.data());
+
+        // 0 valid bits means graphics queue does not support timestamps. Only
+        // CPU scopes are recorded then
+        profiler_ = std::make_unique<FrameProfiler>(
+            physicalDevice_, device_, maxFramesInFlight_,
+            queue_families[indices.graphicsFamily.value()].timestampValidBits,
+            config_.profilePath);
+    }
+
+    void createSurface() {
+        switch (config_.renderTarget) {
+            case RenderTarget::kWindow:
+                if (glfwCreateWindowSurface(instance_, window_, nullptr,
+                                            &surface_) != VK_SUCCESS) {
+                    throw std::runtime_error{
+                        "Failed to create window surface!"};
+                }
+                break;
+            case RenderTarget::kOffscreen:
+                // No surface. Frames are rendered into offscreen images
+                break;
+            case RenderTarget::kHeadlessSurface: {
+                VkHeadlessSurfaceCreateInfoEXT create_info{};
+                create_info.sType =
+                    VK_STRUCTURE_TYPE_HEADLESS_SURFACE_CREATE_INFO_EXT;
+
+                if (CreateHeadlessSurfaceEXT(instance_, &create_info, nullptr,
+                                             &surface_) != VK_SUCCESS) {
+                    throw std::runtime_error{
+                        "Failed to create headless surface!"};
+                }
+                break;
+            }
+        }
+    }
+
+    struct SwapChainSupportDetails {
+        VkSurfaceCapabilitiesKHR capabilities;
+        std::vector<VkSurfaceFormatKHR> formats;
+        std::vector<VkPresentModeKHR> presentModes;
+    };
+    // Check if swapchain is compatible with window surface
+    SwapChainSupportDetails querySwapChainSupport(
+        const VkPhysicalDevice& device) {
+        SwapChainSupportDetails details{};
+
+        // Capabilities
+        vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, surface_,
+                                                  &details.capabilities);
+
+        // Formats
+        uint32_t format_count{};
+        vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface_, &format_count,
+                                             nullptr);
+        if (format_count != 0) {
+            details.formats.resize(format_count);
+            vkGetPhysicalDeviceSurfaceFormatsKHR(
+                device, surface_, &format_count, details.formats.data());
+        }
+
+        // Present modes
+        uint32_t present_mode_count{};
+        vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface_,
+                                                  &present_mode_count, nullptr);
+        if (present_mode_count != 0) {
+            details.presentModes.resize(present_mode_count);
+            vkGetPhysicalDeviceSurfacePresentModesKHR(
+                device, surface_, &present_mode_count,
+                details.presentModes.data());
+        }
+
+        return details;
+    }
+
+    // Choose "best" available format
+    static VkSurfaceFormatKHR chooseSwapSurfaceFormat(
+        const std::vector<VkSurfaceFormatKHR>& available_formats) {
+        // Returns "best" format or the first one in the list
+        for (const auto& format : available_formats) {
+            if (format.format == VK_FORMAT_B8G8R8A8_SRGB &&
+                format.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
+                return format;
+            }
+        }
+
+        return available_formats[0];
+    }
+    // Choose "best" presentation mode
+    VkPresentModeKHR chooseSwapPresentMode(
+        const std::vector<VkPresentModeKHR>& available_present_modes) {
+        // Returns requested mode if available, otherwise the first available
+        // mode preferred by latency policy. Policies end with
+        // VK_PRESENT_MODE_FIFO_KHR, which every surface supports
+        if (config_.presentMode.has_value()) {
+            if (std::ranges::find(available_present_modes,
+                                  config_.presentMode.value()) !=
+                available_present_modes.end()) {
+                return config_.presentMode.value();
+            }
+            std::cout << "Requested present mode is not supported. Falling "
+                         "back to latency policy\n";
+        }
+
+        for (auto preferred_mode :
+             presentModePreference(config_.latencyPolicy)) {
+            if (std::ranges::find(available_present_modes, preferred_mode) !=
+                available_present_modes.end()) {
+                return preferred_mode;
+            }
+        }
+        return VK_PRESENT_MODE_FIFO_KHR;
+    }
+    // Choose "best" resolution
+    // For more info see:
+    // https://docs.vulkan.org/tutorial/latest/03_Drawing_a_triangle/01_Presentation/01_Swap_chain.html#_swap_extent
+    // Main thread only, as glfwGetFramebufferSize() is
+    void readFramebufferExtent() {
+        if (window_ == nullptr) {
+            return;
+        }
+        int width{};
+        int height{};
+        glfwGetFramebufferSize(window_, &width, &height);
+        framebufferExtent_ = {static_cast<uint32_t>(width),
+                              static_cast<uint32_t>(height)};
+    }
+    // Runs in an init step, so it uses the framebuffer size read on the
+    // main thread
+    VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities) {
+        if (capabilities.currentExtent.width !=
+            std::numeric_limits<uint32_t>::max()) {
+            return capabilities.currentExtent;
+        }
+
+        VkExtent2D actual_extent{framebufferExtent_};
+
+        actual_extent.width =
+            std::clamp(actual_extent.width, capabilities.minImageExtent.width,
+                       capabilities.maxImageExtent.width);
+        actual_extent.height =
+            std::clamp(actual_extent.height, capabilities.minImageExtent.height,
+                       capabilities.maxImageExtent.height);
+
+        return actual_extent;
+    }
+
+    // Render pass depends only on the image format, so it is picked before
+    // swap chain is created and kept across swap chain recreation
+    void selectSwapChainFormat() {
+        if (config_.renderTarget == RenderTarget::kOffscreen) {
+            swapChainImageFormat_ = kOffscreenImageFormat_;
+            return;
+        }
+
+        SwapChainSupportDetails swap_chain_details{
+            querySwapChainSupport(physicalDevice_)};
+        surfaceFormat_ = chooseSwapSurfaceFormat(swap_chain_details.formats);
+        swapChainImageFormat_ = surfaceFormat_.format;
+    }
+
+    void createSwapChain() {
+        SwapChainSupportDetails swap_chain_details{
+            querySwapChainSupport(physicalDevice_)};
+
+        VkSurfaceFormatKHR surface_format{surfaceFormat_};
+        VkPresentModeKHR present_mode =
+            chooseSwapPresentMode(swap_chain_details.presentModes);
+        VkExtent2D extent = chooseSwapExtent(swap_chain_details.capabilities);
+
+        uint32_t image_count{swapChainImageCount(
+            config_.latencyPolicy, swap_chain_details.capabilities)};
+
+        VkSwapchainCreateInfoKHR create_info{};
+        create_info.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+        create_info.surface = surface_;
+        create_info.minImageCount = image_count;
+        create_info.imageFormat = surface_format.format;
+        create_info.imageColorSpace = surface_format.colorSpace;
+        create_info.imageExtent = extent;
+        create_info.imageArrayLayers = 1;
+        create_info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+
+        QueueFamilyIndices indices = findQueueFamilyIndices(physicalDevice_);
+        uint32_t queue_family_indices[] = {indices.graphicsFamily.value(),
+                                           indices.presentFamily.value()};
+
+        // If graphics queue and presentation queue are NOT the same family
+        if (indices.graphicsFamily != indices.presentFamily) {
+            create_info.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
+            create_info.queueFamilyIndexCount = 2;
+            create_info.pQueueFamilyIndices = queue_family_indices;
+        }
+        // If graphics queue and presentation queue ARE the same family
+        else {
+            create_info.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+            create_info.queueFamilyIndexCount = 0;      // Optional
+            create_info.pQueueFamilyIndices = nullptr;  // Optional
+        }
+
+        create_info.preTransform =
+            swap_chain_details.capabilities.currentTransform;
+        create_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+        create_info.presentMode = present_mode;
+        create_info.clipped = VK_TRUE;
+        // Let driver reuse resources of the swap chain being replaced. Images
+        // of old swap chain which are already acquired stay valid until old
+        // swap chain is destroyed
+        create_info.oldSwapchain = swapChain_;
+
+        if (vkCreateSwapchainKHR(device_, &create_info, nullptr, &swapChain_) !=
+            VK_SUCCESS) {
+            throw std::runtime_error{"Failed to create swap chain!"};
+        }
+
+        vkGetSwapchainImagesKHR(device_, swapChain_, &image_count, nullptr);
+        swapChainImages_.resize(image_count);
+        vkGetSwapchainImagesKHR(device_, swapChain_, &image_count,
+                                swapChainImages_.data());
+
+        swapChainExtent_ = extent;
+    }
+
+    // Replace swap chain and everything that depends on its images without
+    // waiting for device to go idle. Old resources may still be used by frames
+    // in flight, so they are retired and destroyed once those frames complete
+    void recreateSwapChain() {
+        // Window is minimized. Nothing to render into until it is restored
+        if (window_ != nullptr) {
+            int width{};
+            int height{};
+            glfwGetFramebufferSize(window_, &width, &height);
+            while (width == 0 || height == 0) {
+                glfwGetFramebufferSize(window_, &width, &height);
+                glfwWaitEvents();
+            }
+            framebufferExtent_ = {static_cast<uint32_t>(width),
+                                  static_cast<uint32_t>(height)};
+        }
+
+        RetiredSwapChain retired{};
+        retired.swapChain = swapChain_;
+        retired.imageViews = std::move(swapChainImageViews_);
+        for (VkImageView* view : {&msaaColorView_, &depthView_}) {
+            if (*view != VK_NULL_HANDLE) {
+                retired.imageViews.push_back(*view);
+                *view = VK_NULL_HANDLE;
+            }
+        }
+        retired.framebuffers = std::move(swapChainFramebuffers_);
+        retired.commandBuffers = std::move(imageCommandBuffers_);
+        retired.renderGraph = std::move(renderGraph_);
+        retired.retireFrame = submittedFrameCount_;
+
+        // Old swap chain is passed as oldSwapchain, so it must still be alive
+        createSwapChain();
+        retiredSwapChains_.push_back(std::move(retired));
+
+        createImageViews();
+        createRenderGraph();
+        createFramebuffers();
+        if (config_.prerecordCommandBuffers) {
+            // Every pending frame reads the uniforms of pre-recorded command
+            // buffers, which change with the viewport. Resizes are rare
+            vkDeviceWaitIdle(device_);
+            writeFrameUniforms();
+            createImageCommandBuffers();
+        }
+        imagesInFlight_.assign(swapChainImages_.size(), VK_NULL_HANDLE);
+    }
+    // Frames known to have finished on GPU. A slot's earlier frames are done,
+    // since its fence was waited before the slot was reused
+    uint64_t completedFrameCount() {
+        uint64_t completed{submittedFrameCount_};
+        for (uint32_t i{}; i < maxFramesInFlight_; ++i) {
+            if (slotSubmittedFrame_[i] > 0 &&
+                vkGetFenceStatus(device_, inFlightFences_[i]) != VK_SUCCESS) {
+                completed = std::min(completed, slotSubmittedFrame_[i] - 1);
+            }
+        }
+        return completed;
+    }
+    // Destroy retired swap chains whose frames have all completed. A frame
+    // slot is done with retired resources once it was reused after retirement
+    // (its fence was waited before reuse) or its fence is signaled
+    void destroyRetiredSwapChains(bool force) {
+        std::erase_if(retiredSwapChains_, [&](RetiredSwapChain& retired) {
+            for (uint32_t i{}; !force && i < maxFramesInFlight_; ++i) {
+                if (slotSubmittedFrame_[i] <= retired.retireFrame &&
+                    vkGetFenceStatus(device_, inFlightFences_[i]) !=
+                        VK_SUCCESS) {
+                    return false;
+                }
+            }
+
+            if (!retired.commandBuffers.empty()) {
+                vkFreeCommandBuffers(
+                    device_, commandPool_,
+                    static_cast<uint32_t>(retired.commandBuffers.size()),
+                    retired.commandBuffers.data());
+            }
+            for (auto* framebuffer : retired.framebuffers) {
+                vkDestroyFramebuffer(device_, framebuffer, nullptr);
+            }
+            for (auto* image_view : retired.imageViews) {
+                vkDestroyImageView(device_, image_view, nullptr);
+            }
+            vkDestroySwapchainKHR(device_, retired.swapChain, nullptr);
+
+            return true;
+        });
+    }
+
+    // Create device owned images which replace swap chain images when
+    // rendering offscreen. They are stored in swapChainImages_ so the rest of
+    // the pipeline does not care where frames go
+    void createOffscreenImages() {
+        swapChainExtent_ = {static_cast<uint32_t>(kWidth_),
+                            static_cast<uint32_t>(kHeight_)};
+
+        // One image per frame in flight is enough since nothing holds images
+        // for presentation
+        swapChainImages_.resize(maxFramesInFlight_);
+        offscreenImageMemory_.resize(maxFramesInFlight_);
+
+        for (size_t i{}; i < swapChainImages_.size(); ++i) {
+            VkImageCreateInfo image_info{};
+            image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+            image_info.imageType = VK_IMAGE_TYPE_2D;
+            image_info.format = swapChainImageFormat_;
+            image_info.extent = {swapChainExtent_.width,
+                                 swapChainExtent_.height, 1};
+            image_info.mipLevels = 1;
+            image_info.arrayLayers = 1;
+            image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+            image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+            // Transfer source so rendered frames can be read back
+            image_info.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+                               VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+            image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+            image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+            if (vkCreateImage(device_, &image_info, nullptr,
+                              &swapChainImages_[i]) != VK_SUCCESS) {
+                throw std::runtime_error{"Failed to create offscreen image!"};
+            }
+
+            offscreenImageMemory_[i] = memoryAllocator_->allocateForImage(
+                swapChainImages_[i], VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        }
+    }
+
+    void createImageViews() {
+        swapChainImageViews_.resize(swapChainImages_.size());
+
+        for (size_t i{}; i < swapChainImages_.size(); ++i) {
+            swapChainImageViews_[i] =
+                createImageView(swapChainImages_[i], swapChainImageFormat_,
+                                VK_IMAGE_ASPECT_COLOR_BIT);
+        }
+    }
+    VkImageView createImageView(VkImage image, VkFormat format,
+                                VkImageAspectFlags aspect) {
+        VkImageViewCreateInfo create_info{};
+        create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        create_info.image = image;
+        create_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        create_info.format = format;
+
+        create_info.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+        create_info.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+        create_info.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+        create_info.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+
+        create_info.subresourceRange.aspectMask = aspect;
+        create_info.subresourceRange.baseMipLevel = 0;
+        create_info.subresourceRange.levelCount = 1;
+        create_info.subresourceRange.baseArrayLayer = 0;
+        create_info.subresourceRange.layerCount = 1;
+
+        VkImageView image_view{};
+        if (vkCreateImageView(device_, &create_info, nullptr, &image_view) !=
+            VK_SUCCESS) {
+            throw std::runtime_error{"Failed to create image view!"};
+        }
+        return image_view;
+    }
+
+    // Picks sample count and depth format used by render pass, pipeline and
+    // render graph
+    void selectAttachmentFormats() {
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(physicalDevice_, &properties);
+        VkSampleCountFlags supported{
+            properties.limits.framebufferColorSampleCounts};
+        if (config_.depth) {
+            supported &= properties.limits.framebufferDepthSampleCounts;
+        }
+
+        uint32_t samples{config_.msaaSamples};
+        while (samples > 1 && (supported & samples) == 0) {
+            samples /= 2;
+        }
+        if (samples != config_.msaaSamples) {
+            std::cout << "MSAA x" << config_.msaaSamples
+                      << " is not supported, using x" << samples << '\n';
+        }
+        sampleCount_ = static_cast<VkSampleCountFlagBits>(samples);
+
+        if (!config_.depth) {
+            return;
+        }
+        // Stencil is never used, so formats without it come first
+        for (VkFormat format :
+             {VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT,
+              VK_FORMAT_D24_UNORM_S8_UINT}) {
+            VkFormatProperties format_properties{};
+            vkGetPhysicalDeviceFormatProperties(physicalDevice_, format,
+                                                &format_properties);
+            if ((format_properties.optimalTilingFeatures &
+                 VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) != 0) {
+                depthFormat_ = format;
+                return;
+            }
+        }
+        throw std::runtime_error{"Failed to find a depth format!"};
+    }
+    VkImageAspectFlags depthAspect() const {
+        return depthFormat_ == VK_FORMAT_D32_SFLOAT
+                   ? VK_IMAGE_ASPECT_DEPTH_BIT
+                   : VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+    }
+
+    void createGraphicsPipeline() {
+        bool mesh{!config_.mesh.empty()};
+        VkShaderModule vert_shader_module{createShaderModule(shaders_.code(
+            mesh ? ShaderId::kMeshVert : ShaderId::kTriangleVert))};
+        VkShaderModule frag_shader_module{createShaderModule(shaders_.code(
+            bindlessHeap_ ? ShaderId::kTriangleFrag : ShaderId::kColorFrag))};
+
+        VkPipelineShaderStageCreateInfo vert_shader_stage_info{};
+        vert_shader_stage_info.sType =
+            VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        vert_shader_stage_info.stage = VK_SHADER_STAGE_VERTEX_BIT;
+        vert_shader_stage_info.module = vert_shader_module;
+        vert_shader_stage_info.pName = "main";
+
+        VkPipelineShaderStageCreateInfo frag_shader_stage_info{};
+        frag_shader_stage_info.sType =
+            VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        frag_shader_stage_info.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+        frag_shader_stage_info.module = frag_shader_module;
+        frag_shader_stage_info.pName = "main";
+
+        VkPipelineShaderStageCreateInfo shader_stages[]{vert_shader_stage_info,
+                                                        frag_shader_stage_info};
+
+        VkPipelineVertexInputStateCreateInfo vertex_input_info{};
+        vertex_input_info.sType =
+            VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+        // Triangle vertexes are defined in shader.vert, so only instances
+        // are fetched. Mesh vertexes come after them
+        auto instance_bindings{InstanceBuffer::bindingDescriptions()};
+        auto instance_attributes{InstanceBuffer::attributeDescriptions()};
+        std::vector<VkVertexInputBindingDescription> binding_descriptions(
+            instance_bindings.begin(), instance_bindings.end());
+        std::vector<VkVertexInputAttributeDescription> attribute_descriptions(
+            instance_attributes.begin(), instance_attributes.end());
+        if (mesh) {
+            binding_descriptions.push_back(MeshBuffer::bindingDescription());
+            for (const auto& attribute : MeshBuffer::attributeDescriptions()) {
+                attribute_descriptions.push_back(attribute);
+            }
+        }
+        vertex_input_info.vertexBindingDescriptionCount =
+            static_cast<uint32_t>(binding_descriptions.size());
+        vertex_input_info.pVertexBindingDescriptions =
+            binding_descriptions.data();
+        vertex_input_info.vertexAttributeDescriptionCount =
+            static_cast<uint32_t>(attribute_descriptions.size());
+        vertex_input_info.pVertexAttributeDescriptions =
+            attribute_descriptions.data();
+
+        VkPipelineInputAssemblyStateCreateInfo input_assembly{};
+        input_assembly.sType =
+            VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+        input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+        input_assembly.primitiveRestartEnable = VK_FALSE;
+
+        VkPipelineViewportStateCreateInfo viewport_state{};
+        viewport_state.sType =
+            VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+        viewport_state.viewportCount = 1;
+        viewport_state.scissorCount = 1;
+
+        VkPipelineRasterizationStateCreateInfo rasterizer{};
+        rasterizer.sType =
+            VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+        rasterizer.depthClampEnable = VK_FALSE;
+        rasterizer.rasterizerDiscardEnable = VK_FALSE;
+        rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+        rasterizer.lineWidth = 1.0F;
+        rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
+        // Meshes are counter clockwise seen from +z, and mesh.vert keeps
+        // that winding on screen
+        rasterizer.frontFace = mesh ? VK_FRONT_FACE_COUNTER_CLOCKWISE
+                                    : VK_FRONT_FACE_CLOCKWISE;
+        rasterizer.depthBiasEnable = VK_FALSE;
+        rasterizer.depthBiasConstantFactor = 0.0F;  // Optional
+        rasterizer.depthBiasClamp = 0.0F;           // Optional
+        rasterizer.depthBiasSlopeFactor = 0.0F;     // Optional
+
+        VkPipelineMultisampleStateCreateInfo multisampling{};
+        multisampling.sType =
+            VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+        multisampling.sampleShadingEnable = VK_FALSE;
+        multisampling.rasterizationSamples = sampleCount_;
+        multisampling.minSampleShading = 1.0F;           // Optional
+        multisampling.pSampleMask = nullptr;             // Optional
+        multisampling.alphaToCoverageEnable = VK_FALSE;  // Optional
+        multisampling.alphaToOneEnable = VK_FALSE;       // Optional
+
+        // Every triangle lies at the same depth, so LESS_OR_EQUAL keeps draw
+        // order deciding which one is visible
+        VkPipelineDepthStencilStateCreateInfo depth_stencil{};
+        depth_stencil.sType =
+            VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+        depth_stencil.depthTestEnable = VK_TRUE;
+        depth_stencil.depthWriteEnable = VK_TRUE;
+        depth_stencil.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+
+        VkPipelineColorBlendAttachmentState color_blend_attachment{};
+        color_blend_attachment.colorWriteMask =
+            VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+            VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+        color_blend_attachment.blendEnable = VK_FALSE;
+        color_blend_attachment.srcColorBlendFactor =
+            VK_BLEND_FACTOR_ONE;  // Optional
+        color_blend_attachment.dstColorBlendFactor =
+            VK_BLEND_FACTOR_ZERO;                               // Optional
+        color_blend_attachment.colorBlendOp = VK_BLEND_OP_ADD;  // Optional
+        color_blend_attachment.srcAlphaBlendFactor =
+            VK_BLEND_FACTOR_ONE;  // Optional
+        color_blend_attachment.dstAlphaBlendFactor =
+            VK_BLEND_FACTOR_ZERO;                               // Optional
+        color_blend_attachment.alphaBlendOp = VK_BLEND_OP_ADD;  // Optional
+
+        VkPipelineColorBlendStateCreateInfo color_blending{};
+        color_blending.sType =
+            VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+        color_blending.logicOpEnable = VK_FALSE;
+        color_blending.logicOp = VK_LOGIC_OP_COPY;  // Optional
+        color_blending.attachmentCount = 1;
+        color_blending.pAttachments = &color_blend_attachment;
+        color_blending.blendConstants[0] = 0.0F;  // Optional
+        color_blending.blendConstants[1] = 0.0F;  // Optional
+        color_blending.blendConstants[2] = 0.0F;  // Optional
+        color_blending.blendConstants[3] = 0.0F;  // Optional
+
+        std::vector<VkDynamicState> dynamic_states = {VK_DYNAMIC_STATE_VIEWPORT,
+                                                      VK_DYNAMIC_STATE_SCISSOR};
+        VkPipelineDynamicStateCreateInfo dynamic_state{};
+        dynamic_state.sType =
+            VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+        dynamic_state.dynamicStateCount =
+            static_cast<uint32_t>(dynamic_states.size());
+        dynamic_state.pDynamicStates = dynamic_states.data();
+
+        VkPipelineLayoutCreateInfo pipeline_layout_info{};
+        pipeline_layout_info.sType =
+            VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        // Draws pick resources from the bindless heap through push
+        // constants. Per frame data comes through a dynamic offset of set 1.
+        // Without heap set 0 is an empty placeholder, which is never bound
+        if (!bindlessHeap_) {
+            VkDescriptorSetLayoutCreateInfo empty_layout_info{};
+            empty_layout_info.sType =
+                VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+            if (vkCreateDescriptorSetLayout(device_, &empty_layout_info,
+                                            nullptr, &emptySetLayout_) !=
+                VK_SUCCESS) {
+                throw std::runtime_error{
+                    "Failed to create descriptor set layout!"};
+            }
+        }
+        std::array<VkDescriptorSetLayout, 2> set_layouts{
+            bindlessHeap_ ? bindlessHeap_->setLayout() : emptySetLayout_,
+            frameDataRing_->setLayout()};
+        VkPushConstantRange push_constant_range{};
+        push_constant_range.stageFlags =
+            VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+        push_constant_range.offset = 0;
+        push_constant_range.size = sizeof(DrawConstants);
+
+        pipeline_layout_info.setLayoutCount =
+            static_cast<uint32_t>(set_layouts.size());
+        pipeline_layout_info.pSetLayouts = set_layouts.data();
+        pipeline_layout_info.pushConstantRangeCount = 1;
+        pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+
+        if (vkCreatePipelineLayout(device_, &pipeline_layout_info, nullptr,
+                                   &pipelineLayout_) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create pipeline layout!");
+        }
+
+        VkGraphicsPipelineCreateInfo pipeline_info{};
+        pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        pipeline_info.stageCount = 2;
+        pipeline_info.pStages = shader_stages;
+        pipeline_info.pVertexInputState = &vertex_input_info;
+        pipeline_info.pInputAssemblyState = &input_assembly;
+        pipeline_info.pViewportState = &viewport_state;
+        pipeline_info.pRasterizationState = &rasterizer;
+        pipeline_info.pMultisampleState = &multisampling;
+        pipeline_info.pDepthStencilState =
+            depthFormat_ != VK_FORMAT_UNDEFINED ? &depth_stencil : nullptr;
+        pipeline_info.pColorBlendState = &color_blending;
+        pipeline_info.pDynamicState = &dynamic_state;
+        pipeline_info.layout = pipelineLayout_;
+        pipeline_info.renderPass = renderPass_;
+        pipeline_info.subpass = 0;
+        pipeline_info.basePipelineHandle = VK_NULL_HANDLE;  // Optional
+        pipeline_info.basePipelineIndex = -1;               // Optional
+
+        PipelineFeedback feedback{pipelineFeedbackSupported_,
+                                  pipeline_info.stageCount};
+        pipeline_info.pNext = feedback.chain(nullptr);
+
+        auto start{std::chrono::steady_clock::now()};
+        if (vkCreateGraphicsPipelines(device_, pipelineCache_, 1,
+                                      &pipeline_info, nullptr,
+                                      &graphicsPipeline_) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create graphics pipeline!");
+        }
+        std::chrono::duration<double, std::milli> elapsed{
+            std::chrono::steady_clock::now() - start};
+
+        std::cout << "Graphics pipeline created in " << elapsed.count()
+                  << " ms (" << feedback.describe(pipelineCacheLoaded_)
+                  << ")\n";
+
+        // Clean up
+        vkDestroyShaderModule(device_, vert_shader_module, nullptr);
+        vkDestroyShaderModule(device_, frag_shader_module, nullptr);
+    };
+
+    // Create pipeline cache, pre-populated from disk if the file on disk was
+    // created by the same driver and device. Driver reads the mapped file
+    // directly, it is copied nowhere else
+    void createPipelineCache() {
+        std::optional<MappedFile> cache_file{};
+        std::span<const std::byte> cache_data{};
+        if (!config_.pipelineCachePath.empty() &&
+            std::filesystem::exists(config_.pipelineCachePath)) {
+            cache_file.emplace(config_.pipelineCachePath);
+            cache_data = cache_file->bytes();
+
+            if (!isPipelineCacheCompatible(cache_data)) {
+                std::cout << "Pipeline cache " << config_.pipelineCachePath
+                          << " is stale or corrupt. Ignoring it\n";
+                cache_data = {};
+            }
+        }
+
+        VkPipelineCacheCreateInfo create_info{};
+        create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+        create_info.initialDataSize = cache_data.size();
+        create_info.pInitialData = cache_data.data();
+
+        if (vkCreatePipelineCache(device_, &create_info, nullptr,
+                                  &pipelineCache_) != VK_SUCCESS) {
+            throw std::runtime_error{"Failed to create pipeline cache!"};
+        }
+
+        pipelineCacheLoaded_ = !cache_data.empty();
+    }
+    // Drivers are free to reject foreign cache data, but some of them do not
+    // validate it. So check header before handing data to the driver.
+    // For more info see:
+    // https://registry.khronos.org/vulkan/specs/1.3-extensions/man/html/VkPipelineCacheHeaderVersionOne.html
+    bool isPipelineCacheCompatible(std::span<const std::byte> cache_data) {
+        VkPipelineCacheHeaderVersionOne header{};
+        if (cache_data.size() < sizeof(header)) {
+            return false;
+        }
+        std::memcpy(&header, cache_data.data(), sizeof(header));
+
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(physicalDevice_, &properties);
+
+        return header.headerSize >= sizeof(header) &&
+               header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+               header.vendorID == properties.vendorID &&
+               header.deviceID == properties.deviceID &&
+               std::memcmp(header.pipelineCacheUUID,
+                           properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+    }
+    // Write pipeline cache to a temporary file and rename it over the old one,
+    // so an interrupted write never leaves a truncated cache behind
+    void savePipelineCache() {
+        if (config_.pipelineCachePath.empty() ||
+            pipelineCache_ == VK_NULL_HANDLE) {
+            return;
+        }
+
+        size_t data_size{};
+        vkGetPipelineCacheData(device_, pipelineCache_, &data_size, nullptr);
+        std::vector<char> data(data_size);
+        if (vkGetPipelineCacheData(device_, pipelineCache_, &data_size,
+                                   data.data()) != VK_SUCCESS) {
+            std::cerr << "Failed to get pipeline cache data!\n";
+            return;
+        }
+
+        std::string tmp_path{config_.pipelineCachePath + ".tmp"};
+        {
+            std::ofstream file{tmp_path, std::ios::binary | std::ios::trunc};
+            file.write(data.data(), static_cast<std::streamsize>(data_size));
+            if (!file) {
+                std::cerr << "Failed to write pipeline cache!\n";
+                return;
+            }
+        }
+
+        std::error_code error{};
+        std::filesystem::rename(tmp_path, config_.pipelineCachePath, error);
+        if (error) {
+            std::cerr << "Failed to save pipeline cache: " << error.message()
+                      << '\n';
+        }
+    }
+
+    // Default sampler takes the first sampler slot. Only textures use the
+    // heap, so it is not created without them
+    void createBindlessHeap() {
+        if (config_.textureCount == 0) {
+            return;
+        }
+
+        auto get_properties2{
+            reinterpret_cast<PFN_vkGetPhysicalDeviceProperties2KHR>(
+                vkGetInstanceProcAddr(instance_,
+                                      "vkGetPhysicalDeviceProperties2KHR"))};
+        bindlessHeap_ = std::make_unique<BindlessHeap>(
+            device_, BindlessHeap::clampCapacity({}, physicalDevice_,
+                                                 get_properties2));
+
+        VkSamplerCreateInfo sampler_info{};
+        sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        sampler_info.magFilter = VK_FILTER_LINEAR;
+        sampler_info.minFilter = VK_FILTER_LINEAR;
+        sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+        sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        sampler_info.maxLod = VK_LOD_CLAMP_NONE;
+
+        if (vkCreateSampler(device_, &sampler_info, nullptr,
+                            &defaultSampler_) != VK_SUCCESS) {
+            throw std::runtime_error{"Failed to create sampler!"};
+        }
+        drawConstants_.samplerSlot = bindlessHeap_->addSampler(defaultSampler_);
+    }
+
+    // Textures get heap slots once their mip tails are uploaded, until then
+    // draws sample nothing
+    void createTextureStreamer() {
+        if (config_.textureCount == 0) {
+            return;
+        }
+
+        TextureStreamer::Config streamer_config{};
+        streamer_config.budget =
+            static_cast<VkDeviceSize>(config_.textureBudgetMiB) * 1024 * 1024;
+        streamer_config.loaderThreadCount = kTextureLoaderThreadCount;
+        textureStreamer_ = std::make_unique<TextureStreamer>(
+            device_, physicalDevice_, *memoryAllocator_, *uploadManager_,
+            *bindlessHeap_, textureFeatures_, streamer_config);
+
+        for (uint32_t i{}; i < config_.textureCount; ++i) {
+            textureStreamer_->add(checkerTexture(i, kStreamedTextureSize));
+        }
+    }
+    // Every texture is drawn every frame. Must run before uploads are
+    // flushed, so this frame samples the new slots
+    void updateTextures() {
+        for (uint32_t i{}; i < config_.textureCount; ++i) {
+            textureStreamer_->touch(i, submittedFrameCount_ + 1);
+        }
+        textureStreamer_->update(submittedFrameCount_, completedFrameCount());
+    }
+
+    // Pre-recorded command buffers are reused by every frame slot, so they
+    // keep reading the uniforms written here until the swap chain is
+    // recreated. Shaders only read view values from them
+    void createFrameDataRing() {
+        frameDataRing_ = std::make_unique<FrameDataRing>(
+            device_, physicalDevice_, *memoryAllocator_, kFrameDataSlotSize,
+            maxFramesInFlight_);
+        writeFrameUniforms();
+    }
+    // Bound as set 1 at frameUniformsOffset_. Slot of currentFrame_ must be
+    // unused by GPU
+    void writeFrameUniforms() {
+        frameDataRing_->beginFrame(currentFrame_);
+
+        FrameUniforms uniforms{};
+        uniforms.viewportWidth = static_cast<float>(swapChainExtent_.width);
+        uniforms.viewportHeight = static_cast<float>(swapChainExtent_.height);
+        uniforms.timeSeconds = std::chrono::duration<float>(
+                                   std::chrono::steady_clock::now() - runStart_)
+                                   .count();
+        uniforms.frameNumber = static_cast<uint32_t>(submittedFrameCount_ + 1);
+        uniforms.viewScale = viewScale();
+        frameUniformsOffset_ = frameDataRing_->push(uniforms);
+    }
+
+    // Mesh assets are uploaded straight from the mapped pack. OBJ files are
+    // imported the way the packer does it, see src/asset_packer.cpp
+    void createMeshBuffer() {
+        if (config_.mesh.empty()) {
+            return;
+        }
+
+        if (config_.mesh.ends_with(".obj")) {
+            MappedFile file{config_.mesh};
+            Mesh mesh{importObj(std::string_view{
+                static_cast<const char*>(file.data()), file.size()})};
+            normalizeMesh(mesh);
+            mesh_optimizer::optimizeMesh(mesh);
+            std::vector<std::byte> blob{writeMeshAsset(mesh)};
+            meshBuffer_ = std::make_unique<MeshBuffer>(
+                device_, *memoryAllocator_, *uploadManager_,
+                parseMeshAsset(blob));
+            return;
+        }
+
+        if (!assetPack_) {
+            throw std::runtime_error{"--mesh:" + config_.mesh +
+                                     " needs --asset-pack or an OBJ file"};
+        }
+        AssetPack::Asset asset{assetPack_->get(config_.mesh)};
+        if (asset.type != asset_pack::AssetType::kMesh) {
+            throw std::runtime_error{"Asset is not a mesh: " + config_.mesh};
+        }
+        meshBuffer_ = std::make_unique<MeshBuffer>(
+            device_, *memoryAllocator_, *uploadManager_,
+            parseMeshAsset(asset.data));
+    }
+
+    // Culling reads instance buffer slots, so it uses the same slot count
+    void createGpuCuller() {
+        if (!config_.gpuCulling) {
+            return;
+        }
+
+        GpuCuller::Geometry geometry{};
+        if (meshBuffer_) {
+            geometry = {meshBuffer_->buffer(), meshBuffer_->indexOffset(),
+                        meshBuffer_->indexType(), meshBuffer_->indexCount()};
+        }
+        gpuCuller_ = std::make_unique<GpuCuller>(
+            device_, *memoryAllocator_, *uploadManager_, pipelineCache_,
+            shaders_.code(ShaderId::kCull), *instanceBuffer_, geometry,
+            maxFramesInFlight_, cullerFeatures_, asyncComputeQueueFamilies());
+        std::cout << "Culling pipeline created ("
+                  << gpuCuller_->pipelineFeedback().describe(
+                         pipelineCacheLoaded_)
+                  << ")\n";
+
+        if (!gpuCuller_->usesDrawCount()) {
+            std::cout << "VK_KHR_draw_indirect_count or multiDrawIndirect is "
+                         "not supported, culled instances are drawn with zero "
+                         "instance commands\n";
+        }
+    }
+
+    VkShaderModule createShaderModule(std::span<const uint32_t> code) {
+        VkShaderModuleCreateInfo create_info{};
+        create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        create_info.codeSize = code.size_bytes();
+        create_info.pCode = code.data();
+
+        VkShaderModule shader_module;
+        if (vkCreateShaderModule(device_, &create_info, nullptr,
+                                 &shader_module) != VK_SUCCESS) {
+            throw std::runtime_error{"Failed to create shader module!"};
+        }
+
+        return shader_module;
+    }
+
+    // Attachment order: color target, MSAA color, depth. MSAA color and depth
+    // are only needed while the subpass runs, so they are never stored.
+    // MSAA color is resolved into the color target at the end of the subpass
+    void createRenderPass() {
+        bool msaa{sampleCount_ != VK_SAMPLE_COUNT_1_BIT};
+        std::vector<VkAttachmentDescription> attachments{};
+
+        VkAttachmentDescription color_attachment{};
+        color_attachment.format = swapChainImageFormat_;
+        color_attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+        // Resolve overwrites every pixel
+        color_attachment.loadOp = msaa ? VK_ATTACHMENT_LOAD_OP_DONT_CARE
+                                       : VK_ATTACHMENT_LOAD_OP_CLEAR;
+        color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        color_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        color_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        // Render graph transitions every attachment around the render pass
+        color_attachment.initialLayout =
+            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        color_attachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        attachments.push_back(color_attachment);
+
+        VkAttachmentReference color_attachment_ref{};
+        color_attachment_ref.attachment = 0;
+        color_attachment_ref.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+        VkSubpassDescription subpass{};
+        subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        subpass.colorAttachmentCount = 1;
+        subpass.pColorAttachments = &color_attachment_ref;
+
+        VkAttachmentReference resolve_attachment_ref{};
+        if (msaa) {
+            VkAttachmentDescription msaa_attachment{color_attachment};
+            msaa_attachment.samples = sampleCount_;
+            msaa_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+            msaa_attachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+
+            resolve_attachment_ref = color_attachment_ref;
+            color_attachment_ref.attachment =
+                static_cast<uint32_t>(attachments.size());
+            attachments.push_back(msaa_attachment);
+            subpass.pResolveAttachments = &resolve_attachment_ref;
+        }
+
+        VkAttachmentReference depth_attachment_ref{};
+        if (depthFormat_ != VK_FORMAT_UNDEFINED) {
+            VkAttachmentDescription depth_attachment{};
+            depth_attachment.format = depthFormat_;
+            depth_attachment.samples = sampleCount_;
+            depth_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+            depth_attachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+            depth_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+            depth_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+            depth_attachment.initialLayout =
+                VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+            depth_attachment.finalLayout =
+                VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+            depth_attachment_ref.attachment =
+                static_cast<uint32_t>(attachments.size());
+            depth_attachment_ref.layout =
+                VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+            attachments.push_back(depth_attachment);
+            subpass.pDepthStencilAttachment = &depth_attachment_ref;
+        }
+
+        VkRenderPassCreateInfo render_pass_info{};
+        render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+        render_pass_info.attachmentCount =
+            static_cast<uint32_t>(attachments.size());
+        render_pass_info.pAttachments = attachments.data();
+        render_pass_info.subpassCount = 1;
+        render_pass_info.pSubpasses = &subpass;
+        render_pass_info.dependencyCount = 0;
+
+        if (vkCreateRenderPass(device_, &render_pass_info, nullptr,
+                               &renderPass_) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create render pass!");
+        }
+    }
+
+    // Needs the render graph, which creates MSAA color and depth images
+    void createFramebuffers() {
+        if (sampleCount_ != VK_SAMPLE_COUNT_1_BIT) {
+            msaaColorView_ = createImageView(renderGraph_->image(msaaColor_),
+                                             swapChainImageFormat_,
+                                             VK_IMAGE_ASPECT_COLOR_BIT);
+        }
+        if (depthFormat_ != VK_FORMAT_UNDEFINED) {
+            // Depth attachment views must only have the depth aspect
+            depthView_ =
+                createImageView(renderGraph_->image(depthBuffer_), depthFormat_,
+                                VK_IMAGE_ASPECT_DEPTH_BIT);
+        }
+
+        swapChainFramebuffers_.resize(swapChainImageViews_.size());
+
+        for (size_t i = 0; i < swapChainImageViews_.size(); i++) {
+            std::vector<VkImageView> attachments{swapChainImageViews_[i]};
+            if (msaaColorView_ != VK_NULL_HANDLE) {
+                attachments.push_back(msaaColorView_);
+            }
+            if (depthView_ != VK_NULL_HANDLE) {
+                attachments.push_back(depthView_);
+            }
+
+            VkFramebufferCreateInfo framebuffer_info{};
+            framebuffer_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+            framebuffer_info.renderPass = renderPass_;
+            framebuffer_info.attachmentCount =
+                static_cast<uint32_t>(attachments.size());
+            framebuffer_info.pAttachments = attachments.data();
+            framebuffer_info.width = swapChainExtent_.width;
+            framebuffer_info.height = swapChainExtent_.height;
+            framebuffer_info.layers = 1;
+
+            if (vkCreateFramebuffer(device_, &framebuffer_info, nullptr,
+                                    &swapChainFramebuffers_[i]) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to create framebuffer!");
+            }
+        }
+    }
+
+    // Passes of a frame and the resources they share. Barriers between them
+    // come from the graph, so passes only record their own work
+    void createRenderGraph() {
+        using Access = RenderGraph::Access;
+        renderGraph_ =
+            std::make_unique<RenderGraph>(device_, *memoryAllocator_);
+
+        // Swap chain images are ready once acquire semaphore wait passes this
+        // stage. Offscreen images are never presented, so they are left
+        // ready for readback
+        Access final_access{VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+                            VK_IMAGE_LAYOUT_PRESENT_SRC_KHR};
+        if (config_.renderTarget == RenderTarget::kOffscreen) {
+            final_access = {VK_PIPELINE_STAGE_TRANSFER_BIT,
+                            VK_ACCESS_TRANSFER_READ_BIT,
+                            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL};
+        }
+        colorTarget_ = renderGraph_->importImage(
+            "color target", swapChainImages_, VK_IMAGE_ASPECT_COLOR_BIT,
+            {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0,
+             VK_IMAGE_LAYOUT_UNDEFINED},
+            final_access);
+
+        // With async compute culling runs in another submission, which the
+        // graphics submission waits for
+        Access cull_write{VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                          VK_ACCESS_SHADER_WRITE_BIT};
+        Access draw_read{VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+                         VK_ACCESS_INDIRECT_COMMAND_READ_BIT};
+        if (gpuCuller_) {
+            culledDraws_ = renderGraph_->importBuffer("culled draws");
+            culledDrawCount_ = renderGraph_->importBuffer("culled draw count");
+        }
+        if (gpuCuller_ && !asyncCompute_) {
+            auto cull{renderGraph_->addPass(
+                "cull", [this](VkCommandBuffer command_buffer, uint32_t) {
+                    recordCull(command_buffer);
+                })};
+            renderGraph_->write(cull, culledDraws_, cull_write);
+            if (gpuCuller_->usesDrawCount()) {
+                renderGraph_->write(
+                    cull, culledDrawCount_,
+                    {VK_PIPELINE_STAGE_TRANSFER_BIT |
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                     VK_ACCESS_TRANSFER_WRITE_BIT |
+                         VK_ACCESS_SHADER_WRITE_BIT});
+            }
+        }
+
+        auto main{renderGraph_->addPass(
+            "render pass",
+            [this](VkCommandBuffer command_buffer, uint32_t image_index) {
+                recordRenderPass(command_buffer, image_index);
+            })};
+        if (gpuCuller_) {
+            renderGraph_->read(main, culledDraws_, draw_read);
+            if (gpuCuller_->usesDrawCount()) {
+                renderGraph_->read(main, culledDrawCount_, draw_read);
+            }
+        }
+        // Written by the resolve with MSAA
+        Access color_write{VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                           VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                           VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+        renderGraph_->write(main, colorTarget_, color_write);
+
+        // Never leave the render pass, so tile based GPUs can keep them in
+        // tile memory and back them with lazily allocated memory
+        if (sampleCount_ != VK_SAMPLE_COUNT_1_BIT) {
+            msaaColor_ = renderGraph_->createImage(
+                "msaa color", {swapChainImageFormat_, swapChainExtent_,
+                               VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+                                   VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT,
+                               sampleCount_, VK_IMAGE_ASPECT_COLOR_BIT});
+            renderGraph_->write(main, msaaColor_, color_write);
+        }
+        if (depthFormat_ != VK_FORMAT_UNDEFINED) {
+            depthBuffer_ = renderGraph_->createImage(
+                "depth", {depthFormat_, swapChainExtent_,
+                          VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+                              VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT,
+                          sampleCount_, depthAspect()});
+            renderGraph_->write(
+                main, depthBuffer_,
+                {VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+                     VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                 VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                     VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                 VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL});
+        }
+
+        renderGraph_->compile();
+    }
+
+    void createCommandPool() {
+        QueueFamilyIndices queue_family_indices =
+            findQueueFamilyIndices(physicalDevice_);
+
+        VkCommandPoolCreateInfo pool_info{};
+        pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+        pool_info.queueFamilyIndex =
+            queue_family_indices.graphicsFamily.value();
+
+        if (vkCreateCommandPool(device_, &pool_info, nullptr, &commandPool_) !=
+            VK_SUCCESS) {
+            throw std::runtime_error("Failed to create command pool!");
+        }
+
+        if (asyncCompute_) {
+            pool_info.queueFamilyIndex =
+                queue_family_indices.computeFamily.value();
+
+            if (vkCreateCommandPool(device_, &pool_info, nullptr,
+                                    &computeCommandPool_) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to create command pool!");
+            }
+        }
+    }
+
+    // One command buffer per frame in flight
+    void createCommandBuffers() {
+        commandBuffers_.resize(maxFramesInFlight_);
+
+        VkCommandBufferAllocateInfo alloc_info{};
+        alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        alloc_info.commandPool = commandPool_;
+        alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        alloc_info.commandBufferCount =
+            static_cast<uint32_t>(commandBuffers_.size());
+
+        if (vkAllocateCommandBuffers(device_, &alloc_info,
+                                     commandBuffers_.data()) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate command buffers!");
+        }
+
+        if (config_.prerecordCommandBuffers) {
+            createImageCommandBuffers();
+        }
+        if (asyncCompute_) {
+            computeCommandBuffers_.resize(maxFramesInFlight_);
+
+            alloc_info.commandPool = computeCommandPool_;
+            alloc_info.commandBufferCount =
+                static_cast<uint32_t>(computeCommandBuffers_.size());
+
+            if (vkAllocateCommandBuffers(device_, &alloc_info,
+                                         computeCommandBuffers_.data()) !=
+                VK_SUCCESS) {
+                throw std::runtime_error(
+                    "Failed to allocate command buffers!");
+            }
+        }
+    }
+    // One command buffer per framebuffer. Contents depend only on image index,
+    // so each one is recorded on first use and then reused until invalidated
+    void createImageCommandBuffers() {
+        imageCommandBuffers_.resize(swapChainFramebuffers_.size());
+
+        VkCommandBufferAllocateInfo alloc_info{};
+        alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        alloc_info.commandPool = commandPool_;
+        alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        alloc_info.commandBufferCount =
+            static_cast<uint32_t>(imageCommandBuffers_.size());
+
+        if (vkAllocateCommandBuffers(device_, &alloc_info,
+                                     imageCommandBuffers_.data()) !=
+            VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate command buffers!");
+        }
+
+        invalidateCommandBuffers();
+    }
+    // Must be called whenever anything recorded into pre-recorded command
+    // buffers changes: scene, pipeline, framebuffers or swap chain extent
+    void invalidateCommandBuffers() {
+        imageCommandBuffersDirty_.assign(imageCommandBuffers_.size(), true);
+    }
+
+    // Command pools are not thread safe, so each worker gets its own pool per
+    // frame in flight. Whole pool is reset at once when its frame comes around
+    // again, which is cheaper than resetting individual command buffers
+    void createWorkerCommandPools() {
+        if (config_.recordThreadCount == 0) {
+            return;
+        }
+
+        QueueFamilyIndices queue_family_indices =
+            findQueueFamilyIndices(physicalDevice_);
+
+        size_t pool_count{static_cast<size_t>(maxFramesInFlight_) *
+                          config_.recordThreadCount};
+        workerCommandPools_.resize(pool_count);
+        workerCommandBuffers_.resize(pool_count);
+
+        for (size_t i{}; i < pool_count; ++i) {
+            VkCommandPoolCreateInfo pool_info{};
+            pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+            pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+            pool_info.queueFamilyIndex =
+                queue_family_indices.graphicsFamily.value();
+
+            if (vkCreateCommandPool(device_, &pool_info, nullptr,
+                                    &workerCommandPools_[i]) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to create command pool!");
+            }
+
+            VkCommandBufferAllocateInfo alloc_info{};
+            alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            alloc_info.commandPool = workerCommandPools_[i];
+            alloc_info.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+            alloc_info.commandBufferCount = 1;
+
+            if (vkAllocateCommandBuffers(device_, &alloc_info,
+                                         &workerCommandBuffers_[i]) !=
+                VK_SUCCESS) {
+                throw std::runtime_error(
+                    "Failed to allocate command buffers!");
+            }
+        }
+
+        recordThreadPool_ =
+            std::make_unique<ThreadPool>(config_.recordThreadCount);
+    }
+
+    // Record worker's share of draws into its secondary command buffer of the
+    // current frame
+    void recordSecondaryCommandBuffer(uint32_t worker_index,
+                                      uint32_t image_index) {
+        size_t slot{static_cast<size_t>(currentFrame_) *
+                        config_.recordThreadCount +
+                    worker_index};
+        VkCommandBuffer command_buffer{workerCommandBuffers_[slot]};
+
+        // Fence of the current frame has signaled, so nothing allocated from
+        // this pool is pending anymore
+        vkResetCommandPool(device_, workerCommandPools_[slot], 0);
+
+        VkCommandBufferInheritanceInfo inheritance_info{};
+        inheritance_info.sType =
+            VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+        inheritance_info.renderPass = renderPass_;
+        inheritance_info.subpass = 0;
+        inheritance_info.framebuffer = swapChainFramebuffers_[image_index];
+
+        VkCommandBufferBeginInfo begin_info{};
+        begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        begin_info.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT |
+                           VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        begin_info.pInheritanceInfo = &inheritance_info;
+
+        if (vkBeginCommandBuffer(command_buffer, &begin_info) != VK_SUCCESS) {
+            throw std::runtime_error(
+                "Failed to begin recording command buffer!");
+        }
+
+        // Split draws evenly. First workers take the remainder
+        uint32_t per_worker{config_.drawCount / config_.recordThreadCount};
+        uint32_t remainder{config_.drawCount % config_.recordThreadCount};
+        uint32_t first_draw{worker_index * per_worker +
+                            std::min(worker_index, remainder)};
+        uint32_t draw_count{per_worker + (worker_index < remainder ? 1U : 0U)};
+
+        recordDraws(command_buffer, first_draw, draw_count);
+
+        if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to record command buffer!");
+        }
+    }
+
+    // Record state setup and draws [first_draw, first_draw + draw_count).
+    // Secondary command buffers inherit no state, so this is recorded into
+    // each of them
+    void recordDraws(VkCommandBuffer command_buffer, uint32_t first_draw,
+                     uint32_t draw_count) {
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                          graphicsPipeline_);
+        if (bindlessHeap_) {
+            bindlessHeap_->cmdBind(command_buffer,
+                                   VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                   pipelineLayout_);
+        }
+        frameDataRing_->cmdBind(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                pipelineLayout_, 1, frameUniformsOffset_);
+        vkCmdPushConstants(
+            command_buffer, pipelineLayout_,
+            VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0,
+            sizeof(DrawConstants), &drawConstants_);
+
+        // Note: we did specify viewport and scissor state for this pipeline to
+        // be dynamic. So we need to set them in the command buffer before
+        // issuing our draw command.
+        VkViewport viewport{};
+        viewport.x = 0.0F;
+        viewport.y = 0.0F;
+        viewport.width = static_cast<float>(swapChainExtent_.width);
+        viewport.height = static_cast<float>(swapChainExtent_.height);
+        viewport.minDepth = 0.0F;
+        viewport.maxDepth = 1.0F;
+        vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+
+        VkRect2D scissor{};
+        scissor.offset = {0, 0};
+        scissor.extent = swapChainExtent_;
+        vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+
+        // Pre-recorded command buffers outlive frame slots. Their instances
+        // never change, so any slot copy does
+        instanceBuffer_->bind(command_buffer, config_.prerecordCommandBuffers
+                                                  ? 0
+                                                  : currentFrame_);
+        // Culler binds the index buffer again, which is harmless
+        if (meshBuffer_) {
+            meshBuffer_->bind(command_buffer);
+        }
+
+        // Culling already turned every draw into indirect commands, so they
+        // all sample the first texture
+        if (gpuCuller_) {
+            if (textureStreamer_) {
+                pushTextureSlot(command_buffer, 0);
+            }
+            gpuCuller_->cmdDraw(command_buffer, currentFrame_);
+            return;
+        }
+
+        // Draw the mesh, or 3 vertexes defined in shader.vert, once per
+        // instance of the draw
+        for (uint32_t i{}; i < draw_count; ++i) {
+            if (textureStreamer_) {
+                pushTextureSlot(command_buffer,
+                                (first_draw + i) % config_.textureCount);
+            }
+            if (meshBuffer_) {
+                vkCmdDrawIndexed(command_buffer, meshBuffer_->indexCount(),
+                                 config_.instanceCount, 0, 0,
+                                 (first_draw + i) * config_.instanceCount);
+            } else {
+                vkCmdDraw(command_buffer, 3, config_.instanceCount, 0,
+                          (first_draw + i) * config_.instanceCount);
+            }
+        }
+    }
+
+    // Streamer is only updated between frames, so worker threads may read
+    // slots while recording
+    void pushTextureSlot(VkCommandBuffer command_buffer,
+                         TextureStreamer::TextureId texture) {
+        uint32_t slot{textureStreamer_->slot(texture)};
+        vkCmdPushConstants(
+            command_buffer, pipelineLayout_,
+            VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+            offsetof(DrawConstants, textureSlot), sizeof(slot), &slot);
+    }
+
+    void recordCommandBuffer(VkCommandBuffer command_buffer,
+                             uint32_t image_index) {
+        VkCommandBufferBeginInfo begin_info{};
+        begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        begin_info.flags = 0;                   // Optional
+        begin_info.pInheritanceInfo = nullptr;  // Optional
+
+        if (vkBeginCommandBuffer(command_buffer, &begin_info) != VK_SUCCESS) {
+            throw std::runtime_error(
+                "Failed to begin recording command buffer!");
+        }
+
+        if (FrameProfiler* gpu_profiler{gpuProfiler()}) {
+            gpu_profiler->cmdResetQueries(command_buffer);
+        }
+
+        if (gpuCuller_) {
+            renderGraph_->bindBuffer(culledDraws_,
+                                     gpuCuller_->drawBuffer(currentFrame_));
+            if (gpuCuller_->usesDrawCount()) {
+                renderGraph_->bindBuffer(
+                    culledDrawCount_, gpuCuller_->countBuffer(currentFrame_));
+            }
+        }
+        renderGraph_->execute(command_buffer, image_index);
+
+        if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to record command buffer!");
+        }
+    }
+    // Queries belong to frame slots, while pre-recorded command buffers
+    // belong to images and are reused across slots. So those are only timed
+    // on CPU
+    FrameProfiler* gpuProfiler() const {
+        return config_.prerecordCommandBuffers ? nullptr : profiler_.get();
+    }
+    // Scale from instance offsets to clip space, passed to shaders in
+    // FrameUniforms. Keeps instances square, the shorter side of the
+    // viewport spans [-1, 1]
+    std::array<float, 2> viewScale() const {
+        auto width{static_cast<float>(swapChainExtent_.width)};
+        auto height{static_cast<float>(swapChainExtent_.height)};
+        if (width > height) {
+            return {height / width, 1.0F};
+        }
+        return {1.0F, width / height};
+    }
+    // Area of instance offsets which ends up on screen, as min x, min y,
+    // max x, max y
+    std::array<float, 4> visibleArea() const {
+        std::array<float, 2> scale{viewScale()};
+        return {-1.0F / scale[0], -1.0F / scale[1], 1.0F / scale[0],
+                1.0F / scale[1]};
+    }
+    void recordCull(VkCommandBuffer command_buffer) {
+        FrameProfiler* gpu_profiler{gpuProfiler()};
+        uint32_t gpu_scope{};
+        if (gpu_profiler != nullptr) {
+            gpu_scope = gpu_profiler->cmdBeginGpuScope(command_buffer, "cull");
+        }
+        gpuCuller_->cmdCull(command_buffer, currentFrame_, visibleArea());
+        if (gpu_profiler != nullptr) {
+            gpu_profiler->cmdEndGpuScope(command_buffer, gpu_scope);
+        }
+    }
+    void recordRenderPass(VkCommandBuffer command_buffer,
+                          uint32_t image_index) {
+        VkRenderPassBeginInfo render_pass_info{};
+        render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        render_pass_info.renderPass = renderPass_;
+        render_pass_info.framebuffer = swapChainFramebuffers_[image_index];
+        render_pass_info.renderArea.offset = {0, 0};
+        render_pass_info.renderArea.extent = swapChainExtent_;
+
+        // Indexed by attachment, see createRenderPass()
+        std::array<VkClearValue, 3> clear_values{};
+        uint32_t clear_value_count{};
+        clear_values[clear_value_count++].color = {{0.0F, 0.0F, 0.0F, 1.0F}};
+        if (msaaColorView_ != VK_NULL_HANDLE) {
+            clear_values[clear_value_count++].color = {
+                {0.0F, 0.0F, 0.0F, 1.0F}};
+        }
+        if (depthView_ != VK_NULL_HANDLE) {
+            clear_values[clear_value_count++].depthStencil = {1.0F, 0};
+        }
+        render_pass_info.clearValueCount = clear_value_count;
+        render_pass_info.pClearValues = clear_values.data();
+
+        FrameProfiler* gpu_profiler{gpuProfiler()};
+        uint32_t gpu_scope{};
+        if (gpu_profiler != nullptr) {
+            gpu_scope =
+                gpu_profiler->cmdBeginGpuScope(command_buffer, "render pass");
+        }
+
+        if (recordThreadPool_) {
+            vkCmdBeginRenderPass(command_buffer, &render_pass_info,
+                                 VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+            recordThreadPool_->runOnAll([this, image_index](uint32_t worker) {
+                recordSecondaryCommandBuffer(worker, image_index);
+            });
+
+            vkCmdExecuteCommands(
+                command_buffer, config_.recordThreadCount,
+                &workerCommandBuffers_[static_cast<size_t>(currentFrame_) *
+                                       config_.recordThreadCount]);
+        } else {
+            vkCmdBeginRenderPass(command_buffer, &render_pass_info,
+                                 VK_SUBPASS_CONTENTS_INLINE);
+            recordDraws(command_buffer, 0, config_.drawCount);
+        }
+
+        vkCmdEndRenderPass(command_buffer);
+
+        if (gpu_profiler != nullptr) {
+            gpu_profiler->cmdEndGpuScope(command_buffer, gpu_scope);
+        }
+    }
+
+    void createSyncObjects() {
+        imageAvailableSemaphores_.resize(maxFramesInFlight_);
+        renderFinishedSemaphores_.resize(maxFramesInFlight_);
+        inFlightFences_.resize(maxFramesInFlight_);
+        // No swap chain image is in use yet
+        imagesInFlight_.resize(swapChainImages_.size(), VK_NULL_HANDLE);
+        slotSubmittedFrame_.resize(maxFramesInFlight_);
+
+        VkSemaphoreCreateInfo semaphore_info{};
+        semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+        VkFenceCreateInfo fence_info{};
+        fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+        for (uint32_t i{}; i < maxFramesInFlight_; ++i) {
+            if (vkCreateSemaphore(device_, &semaphore_info, nullptr,
+                                  &imageAvailableSemaphores_[i]) !=
+                    VK_SUCCESS ||
+                vkCreateSemaphore(device_, &semaphore_info, nullptr,
+                                  &renderFinishedSemaphores_[i]) !=
+                    VK_SUCCESS ||
+                vkCreateFence(device_, &fence_info, nullptr,
+                              &inFlightFences_[i]) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to create semaphores!");
+            }
+        }
+
+        computeFinishedSemaphores_.resize(asyncCompute_ ? maxFramesInFlight_
+                                                        : 0);
+        for (auto& semaphore : computeFinishedSemaphores_) {
+            if (vkCreateSemaphore(device_, &semaphore_info, nullptr,
+                                  &semaphore) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to create semaphores!");
+            }
+        }
+    }
+
+    // Returns false if no frame was submitted, because the swap chain was out
+    // of date and had to be recreated first
+    bool drawFrame() {
+        // Wait until the GPU is done with the resources of this frame slot.
+        // Other frame slots may still be in flight.
+        {
+            CpuScope scope{profiler_.get(), "fence wait"};
+            vkWaitForFences(device_, 1, &inFlightFences_[currentFrame_],
+                            VK_TRUE, UINT64_MAX);
+        }
+        if (profiler_) {
+            profiler_->beginFrame(currentFrame_, submittedFrameCount_ + 1);
+        }
+
+        destroyRetiredSwapChains(false);
+        if (bindlessHeap_) {
+            bindlessHeap_->recycle(completedFrameCount());
+        }
+
+        const bool offscreen{config_.renderTarget == RenderTarget::kOffscreen};
+
+        uint32_t image_index{};
+        if (offscreen) {
+            image_index = currentFrame_;
+        } else {
+            VkResult result{};
+            {
+                CpuScope scope{profiler_.get(), "acquire"};
+                result = vkAcquireNextImageKHR(
+                    device_, swapChain_, UINT64_MAX,
+                    imageAvailableSemaphores_[currentFrame_], VK_NULL_HANDLE,
+                    &image_index);
+            }
+
+            // Semaphore is not signaled and fence is not reset yet, so this
+            // frame slot can simply be retried with the new swap chain.
+            // Suboptimal swap chain can still be presented to, so it is
+            // recreated after present
+            if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+                recreateSwapChain();
+                return false;
+            }
+            if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
+                throw std::runtime_error{"Failed to acquire swap chain image!"};
+            }
+        }
+
+        // Acquired image may still be used by another frame in flight if the
+        // swap chain returns images out of order
+        if (imagesInFlight_[image_index] != VK_NULL_HANDLE) {
+            vkWaitForFences(device_, 1, &imagesInFlight_[image_index], VK_TRUE,
+                            UINT64_MAX);
+        }
+        imagesInFlight_[image_index] = inFlightFences_[currentFrame_];
+
+        vkResetFences(device_, 1, &inFlightFences_[currentFrame_]);
+
+        // Input is sampled only once this frame can no longer block on GPU or
+        // swap chain, so recorded commands see the freshest input
+        if (window_ != nullptr) {
+            CpuScope scope{profiler_.get(), "poll events"};
+            glfwPollEvents();
+        }
+        auto input_sample_time{std::chrono::steady_clock::now()};
+
+        if (textureStreamer_) {
+            CpuScope scope{profiler_.get(), "texture streaming"};
+            updateTextures();
+        }
+
+        // Hand uploads queued since last frame over to graphics queue before
+        // this frame is submitted
+        uploadManager_->flush(graphicsQueue_);
+
+        // Fence of this slot has signaled, so its instance copy is unused
+        animateInstances();
+        instanceBuffer_->update(currentFrame_);
+        if (!config_.prerecordCommandBuffers) {
+            writeFrameUniforms();
+        }
+
+        auto record_start{std::chrono::steady_clock::now()};
+        VkCommandBuffer command_buffer{};
+        {
+            CpuScope scope{profiler_.get(), "record"};
+            if (config_.prerecordCommandBuffers) {
+                // Fence of this image was waited above, so its command buffer
+                // is no longer pending and can be re-recorded if needed
+                command_buffer = imageCommandBuffers_[image_index];
+                if (imageCommandBuffersDirty_[image_index]) {
+                    vkResetCommandBuffer(command_buffer, 0);
+                    recordCommandBuffer(command_buffer, image_index);
+                    imageCommandBuffersDirty_[image_index] = false;
+                }
+            } else {
+                command_buffer = commandBuffers_[currentFrame_];
+                vkResetCommandBuffer(command_buffer, 0);
+                recordCommandBuffer(command_buffer, image_index);
+            }
+        }
+        recordTime_ += std::chrono::steady_clock::now() - record_start;
+        ++recordedFrameCount_;
+
+        if (asyncCompute_) {
+            submitCompute();
+        }
+
+        VkSubmitInfo submit_info{};
+        submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+
+        std::vector<VkSemaphore> wait_semaphores{};
+        std::vector<VkPipelineStageFlags> wait_stages{};
+        // Offscreen images are available as soon as their fence signals
+        if (!offscreen) {
+            wait_semaphores.push_back(imageAvailableSemaphores_[currentFrame_]);
+            wait_stages.push_back(
+                VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+        }
+        // Only indirect draws consume culling results, so everything before
+        // them may overlap with compute
+        if (asyncCompute_) {
+            wait_semaphores.push_back(
+                computeFinishedSemaphores_[currentFrame_]);
+            wait_stages.push_back(VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT);
+        }
+        submit_info.waitSemaphoreCount =
+            static_cast<uint32_t>(wait_semaphores.size());
+        submit_info.pWaitSemaphores = wait_semaphores.data();
+        submit_info.pWaitDstStageMask = wait_stages.data();
+        submit_info.commandBufferCount = 1;
+        submit_info.pCommandBuffers = &command_buffer;
+
+        VkSemaphore signal_semaphores[] = {
+            renderFinishedSemaphores_[currentFrame_]};
+        submit_info.signalSemaphoreCount = offscreen ? 0 : 1;
+        submit_info.pSignalSemaphores = signal_semaphores;
+
+        {
+            CpuScope scope{profiler_.get(), "submit"};
+            if (vkQueueSubmit(graphicsQueue_, 1, &submit_info,
+                              inFlightFences_[currentFrame_]) != VK_SUCCESS) {
+                throw std::runtime_error(
+                    "Failed to submit draw command buffer!");
+            }
+        }
+        if (profiler_) {
+            profiler_->endFrame();
+        }
+        slotSubmittedFrame_[currentFrame_] = ++submittedFrameCount_;
+
+        if (offscreen) {
+            inputToPresentTimes_.push_back(
+                std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - input_sample_time)
+                    .count());
+            currentFrame_ = (currentFrame_ + 1) % maxFramesInFlight_;
+            return true;
+        }
+
+        VkPresentInfoKHR present_info{};
+        present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+
+        present_info.waitSemaphoreCount = 1;
+        present_info.pWaitSemaphores = signal_semaphores;
+
+        VkSwapchainKHR swap_chains[] = {swapChain_};
+        present_info.swapchainCount = 1;
+        present_info.pSwapchains = swap_chains;
+        present_info.pImageIndices = &image_index;
+        present_info.pResults = nullptr;  // Optional
+
+        VkResult result{};
+        {
+            CpuScope scope{profiler_.get(), "present"};
+            result = vkQueuePresentKHR(presentQueue_, &present_info);
+        }
+        if (result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR) {
+            inputToPresentTimes_.push_back(
+                std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - input_sample_time)
+                    .count());
+        }
+
+        if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR ||
+            framebufferResized_) {
+            framebufferResized_ = false;
+            recreateSwapChain();
+        } else if (result != VK_SUCCESS) {
+            throw std::runtime_error{"Failed to present swap chain image!"};
+        }
+
+        currentFrame_ = (currentFrame_ + 1) % maxFramesInFlight_;
+        return true;
+    }
+
+    // Cull this frame slot's instances on compute queue. Graphics submit of
+    // the frame waits for it, so fence of the frame slot covers this command
+    // buffer too
+    void submitCompute() {
+        VkCommandBuffer command_buffer{computeCommandBuffers_[currentFrame_]};
+        {
+            CpuScope scope{profiler_.get(), "record compute"};
+            vkResetCommandBuffer(command_buffer, 0);
+
+            VkCommandBufferBeginInfo begin_info{};
+            begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+            if (vkBeginCommandBuffer(command_buffer, &begin_info) !=
+                VK_SUCCESS) {
+                throw std::runtime_error(
+                    "Failed to begin recording command buffer!");
+            }
+            gpuCuller_->cmdCull(command_buffer, currentFrame_, visibleArea());
+            if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to record command buffer!");
+            }
+        }
+
+        VkSubmitInfo submit_info{};
+        submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submit_info.commandBufferCount = 1;
+        submit_info.pCommandBuffers = &command_buffer;
+        submit_info.signalSemaphoreCount = 1;
+        submit_info.pSignalSemaphores =
+            &computeFinishedSemaphores_[currentFrame_];
+
+        CpuScope scope{profiler_.get(), "submit compute"};
+        if (vkQueueSubmit(computeQueue_, 1, &submit_info, VK_NULL_HANDLE) !=
+            VK_SUCCESS) {
+            throw std::runtime_error(
+                "Failed to submit compute command buffer!");
+        }
+    }
+
+    double msSinceRunStart() const {
+        return std::chrono::duration<double, std::milli>(
+                   std::chrono::steady_clock::now() - runStart_)
+            .count();
+    }
+
+    const int32_t kWidth_{800};
+    const int32_t kHeight_{600};
+    // How many frames CPU may record ahead of GPU
+    const uint32_t maxFramesInFlight_;
+    const VkFormat kOffscreenImageFormat_{VK_FORMAT_B8G8R8A8_SRGB};
+
+    AppConfig config_;
+    // Before shaders_, which reads shaders from it
+    std::unique_ptr<AssetPack> assetPack_;
+    ShaderLibrary shaders_;
+    GLFWwindow* window_{nullptr};
+    bool framebufferResized_{};
+    // Window framebuffer size in pixels, read on the main thread
+    VkExtent2D framebufferExtent_{static_cast<uint32_t>(kWidth_),
+                                  static_cast<uint32_t>(kHeight_)};
+
+    VkInstance instance_{};
+    VkDebugUtilsMessengerEXT debugMessenger_{};
+    // Only with validation layers
+    std::unique_ptr<DebugMessageSink> debugMessageSink_{};
+    VkPhysicalDevice physicalDevice_{VK_NULL_HANDLE};
+    VkDevice device_{};
+    VkQueue graphicsQueue_{};
+    VkQueue presentQueue_{};
+    // Same as graphicsQueue_ if device has no transfer only family
+    VkQueue transferQueue_{};
+    // Same as graphicsQueue_ if device has no compute only family
+    VkQueue computeQueue_{};
+    // Culling is submitted to computeQueue_, which differs from graphics
+    bool asyncCompute_{};
+    // VK_NULL_HANDLE for offscreen target
+    VkSurfaceKHR surface_{VK_NULL_HANDLE};
+
+    std::unique_ptr<DeviceMemoryAllocator> memoryAllocator_{};
+    std::unique_ptr<UploadManager> uploadManager_{};
+    // nullptr unless profiling is enabled
+    std::unique_ptr<FrameProfiler> profiler_{};
+    // Instances of all draw calls, draw i uses [i, i + 1) * instanceCount
+    std::unique_ptr<InstanceBuffer> instanceBuffer_{};
+    // Drawn by every instance instead of the triangle. nullptr without mesh
+    std::unique_ptr<MeshBuffer> meshBuffer_{};
+    std::unique_ptr<GpuCuller> gpuCuller_{};
+    GpuCuller::Features cullerFeatures_{};
+    // nullptr unless textures are enabled
+    std::unique_ptr<BindlessHeap> bindlessHeap_{};
+    VkSampler defaultSampler_{VK_NULL_HANDLE};
+    // Set 0 of pipelineLayout_ without bindless heap
+    VkDescriptorSetLayout emptySetLayout_{VK_NULL_HANDLE};
+    // Heap slots of a draw. Matches push constants of shaders/shader.frag
+    struct DrawConstants {
+        uint32_t textureSlot{BindlessHeap::kInvalidSlot};
+        uint32_t samplerSlot{BindlessHeap::kInvalidSlot};
+    };
+    DrawConstants drawConstants_{};
+
+    static constexpr uint32_t kStreamedTextureSize{1024};
+    static constexpr uint32_t kTextureLoaderThreadCount{2};
+    // nullptr unless textures are enabled
+    std::unique_ptr<TextureStreamer> textureStreamer_{};
+    TextureStreamer::Features textureFeatures_{};
+
+    static constexpr VkDeviceSize kFrameDataSlotSize{64 * 1024};
+    std::unique_ptr<FrameDataRing> frameDataRing_{};
+    // Values every draw of a frame shares. std140 layout
+    struct FrameUniforms {
+        float viewportWidth{};
+        float viewportHeight{};
+        float timeSeconds{};
+        uint32_t frameNumber{};
+        // See viewScale()
+        std::array<float, 2> viewScale{};
+    };
+    // Dynamic offset of this frame's FrameUniforms
+    uint32_t frameUniformsOffset_{};
+    bool drawIndirectCountSupported_{};
+
+    // VK_NULL_HANDLE for offscreen target
+    VkSwapchainKHR swapChain_{VK_NULL_HANDLE};
+    // SwapChain buffer. Holds device owned images for offscreen target
+    std::vector<VkImage> swapChainImages_{};
+    // Backing memory of offscreen images. Empty for swap chain targets
+    std::vector<DeviceMemoryAllocator::Allocation> offscreenImageMemory_{};
+    VkSurfaceFormatKHR surfaceFormat_{};
+    VkFormat swapChainImageFormat_{};
+    VkExtent2D swapChainExtent_{};
+
+    std::vector<VkImageView> swapChainImageViews_{};
+
+    // Swap chain and resources created for its images, replaced by
+    // recreateSwapChain() but possibly still used by frames in flight
+    struct RetiredSwapChain {
+        VkSwapchainKHR swapChain{VK_NULL_HANDLE};
+        std::vector<VkImageView> imageViews{};
+        std::vector<VkFramebuffer> framebuffers{};
+        std::vector<VkCommandBuffer> commandBuffers{};
+        std::unique_ptr<RenderGraph> renderGraph{};
+        // Number of frames submitted before retirement
+        uint64_t retireFrame{};
+    };
+    std::vector<RetiredSwapChain> retiredSwapChains_{};
+
+    VkPipelineCache pipelineCache_{VK_NULL_HANDLE};
+    // Whether pipeline cache was populated from disk
+    bool pipelineCacheLoaded_{};
+    // VK_EXT_pipeline_creation_feedback is enabled
+    bool pipelineFeedbackSupported_{};
+
+    VkRenderPass renderPass_{};
+    std::unique_ptr<RenderGraph> renderGraph_{};
+    RenderGraph::ResourceId colorTarget_{};
+    RenderGraph::ResourceId culledDraws_{};
+    RenderGraph::ResourceId culledDrawCount_{};
+    // VK_SAMPLE_COUNT_1_BIT disables multisampling
+    VkSampleCountFlagBits sampleCount_{VK_SAMPLE_COUNT_1_BIT};
+    // VK_FORMAT_UNDEFINED without depth buffer
+    VkFormat depthFormat_{VK_FORMAT_UNDEFINED};
+    // Transient render graph images, views are VK_NULL_HANDLE when unused
+    RenderGraph::ResourceId msaaColor_{};
+    RenderGraph::ResourceId depthBuffer_{};
+    VkImageView msaaColorView_{VK_NULL_HANDLE};
+    VkImageView depthView_{VK_NULL_HANDLE};
+    VkPipelineLayout pipelineLayout_{};
+    VkPipeline graphicsPipeline_{};
+
+    std::vector<VkFramebuffer> swapChainFramebuffers_{};
+
+    VkCommandPool commandPool_{};
+    // Per frame in flight resources
+    std::vector<VkCommandBuffer> commandBuffers_{};
+    std::vector<VkSemaphore> imageAvailableSemaphores_{};
+    std::vector<VkSemaphore> renderFinishedSemaphores_{};
+    std::vector<VkFence> inFlightFences_{};
+    // Async compute command buffers and semaphores graphics submits wait on.
+    // Empty without async compute
+    VkCommandPool computeCommandPool_{VK_NULL_HANDLE};
+    std::vector<VkCommandBuffer> computeCommandBuffers_{};
+    std::vector<VkSemaphore> computeFinishedSemaphores_{};
+    // Fence of the frame that currently uses each swap chain image
+    std::vector<VkFence> imagesInFlight_{};
+    // Pre-recorded per swap chain image command buffers. Empty unless
+    // prerecordCommandBuffers is set
+    std::vector<VkCommandBuffer> imageCommandBuffers_{};
+    std::vector<bool> imageCommandBuffersDirty_{};
+    // Parallel recording. Pools and secondary command buffers are indexed by
+    // frame * recordThreadCount + worker
+    std::unique_ptr<ThreadPool> recordThreadPool_{};
+    std::vector<VkCommandPool> workerCommandPools_{};
+    std::vector<VkCommandBuffer> workerCommandBuffers_{};
+    uint32_t currentFrame_{};
+    // Frames submitted so far and number of the last frame submitted from
+    // each frame slot. Used to find out when retired resources are unused
+    uint64_t submittedFrameCount_{};
+    std::vector<uint64_t> slotSubmittedFrame_{};
+
+    // Total CPU time spent recording command buffers
+    std::chrono::duration<double, std::milli> recordTime_{};
+    uint64_t recordedFrameCount_{};
+    std::vector<double> frameTimes_{};
+    std::vector<double> inputToPresentTimes_{};
+    FrameLimiter frameLimiter_;
+    std::chrono::steady_clock::time_point runStart_{};
+    double initMs_{};
+    double timeToFirstFrameMs_{};
+    uint64_t performanceWarningCount_{};
+};
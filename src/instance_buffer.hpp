@@ -0,0 +1,299 @@
+#pragma once
+
+#include <vulkan/vulkan_core.h>
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include "device_memory_allocator.hpp"
+
+// Per instance attributes in structure of arrays layout: every attribute lives
+// in its own tightly packed region and is bound as its own vertex buffer
+// binding with instance input rate. A partial update then touches only the
+// attributes that changed, and vertex fetch reads only what shader uses.
+// Changes are tracked per attribute of every instance, so e.g. animating
+// rotations never rewrites offsets or colors.
+//
+// Every frame slot has its own persistently mapped copy, so a slot can be
+// written while other slots are still read by the GPU. Changes are recorded
+// on CPU and written into each slot copy the next time that slot is updated.
+// Copies are shared concurrently by queue families passed in, if there are
+// several, so compute queues may read them without ownership transfers.
+class InstanceBuffer {
+   public:
+    static constexpr uint32_t kBindingCount{4};
+
+    struct Offset {
+        float x{};
+        float y{};
+    };
+
+    InstanceBuffer(VkDevice device, DeviceMemoryAllocator& allocator,
+                   uint32_t instance_count, uint32_t frame_slot_count,
+                   const std::vector<uint32_t>& queue_families = {})
+        : device_{device},
+          allocator_{allocator},
+          offsets_(instance_count),
+          scales_(instance_count, 1.0F),
+          rotations_(instance_count),
+          colors_(instance_count, kWhite),
+          dirtySlots_(instance_count),
+          slots_(frame_slot_count) {
+        if (frame_slot_count == 0 || frame_slot_count > 32) {
+            throw std::runtime_error{"Unsupported frame slot count!"};
+        }
+        allSlotsMask_ = frame_slot_count == 32
+                            ? ~uint32_t{}
+                            : (uint32_t{1} << frame_slot_count) - 1;
+
+        // Regions are aligned generously, vertex fetch only needs 4 bytes
+        regionOffsets_[0] = 0;
+        regionOffsets_[1] = alignUp(regionOffsets_[0] + bytes(offsets_));
+        regionOffsets_[2] = alignUp(regionOffsets_[1] + bytes(scales_));
+        regionOffsets_[3] = alignUp(regionOffsets_[2] + bytes(rotations_));
+        VkDeviceSize buffer_size{regionOffsets_[3] + bytes(colors_)};
+
+        for (auto& slot : slots_) {
+            VkBufferCreateInfo buffer_info{};
+            buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+            buffer_info.size = buffer_size;
+            // Storage usage lets compute passes read instances too
+            buffer_info.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+                                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+            if (queue_families.size() > 1) {
+                buffer_info.sharingMode = VK_SHARING_MODE_CONCURRENT;
+                buffer_info.queueFamilyIndexCount =
+                    static_cast<uint32_t>(queue_families.size());
+                buffer_info.pQueueFamilyIndices = queue_families.data();
+            } else {
+                buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+            }
+
+            if (vkCreateBuffer(device_, &buffer_info, nullptr, &slot.buffer) !=
+                VK_SUCCESS) {
+                throw std::runtime_error{"Failed to create instance buffer!"};
+            }
+            // Device local host visible memory (resizable BAR, integrated
+            // GPUs) avoids reading instances over PCIe every frame
+            slot.memory = allocator_.allocateForBuffer(
+                slot.buffer,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                    VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        }
+
+        // Nothing is written into slots yet
+        markAllDirty();
+    }
+    ~InstanceBuffer() {
+        for (auto& slot : slots_) {
+            vkDestroyBuffer(device_, slot.buffer, nullptr);
+            if (slot.memory.memory != VK_NULL_HANDLE) {
+                allocator_.free(slot.memory);
+            }
+        }
+    }
+
+    InstanceBuffer(const InstanceBuffer&) = delete;
+    InstanceBuffer& operator=(const InstanceBuffer&) = delete;
+    InstanceBuffer(InstanceBuffer&&) = delete;
+    InstanceBuffer& operator=(InstanceBuffer&&) = delete;
+
+    uint32_t size() const { return static_cast<uint32_t>(offsets_.size()); }
+
+    void setOffset(uint32_t instance, Offset offset) {
+        offsets_[instance] = offset;
+        markDirty(instance, kOffset);
+    }
+    void setScale(uint32_t instance, float scale) {
+        scales_[instance] = scale;
+        markDirty(instance, kScale);
+    }
+    // Radians, counter clockwise
+    void setRotation(uint32_t instance, float rotation) {
+        rotations_[instance] = rotation;
+        markDirty(instance, kRotation);
+    }
+    // R8G8B8A8 unorm, red in the lowest byte
+    void setColor(uint32_t instance, uint32_t color) {
+        colors_[instance] = color;
+        markDirty(instance, kColor);
+    }
+    float rotation(uint32_t instance) const { return rotations_[instance]; }
+
+    // Write instances changed since this slot was last updated. GPU must be
+    // done with the slot, i.e. its frame fence must have signaled
+    void update(uint32_t slot_index) {
+        Slot& slot{slots_[slot_index]};
+        uint32_t slot_bit{uint32_t{1} << slot_index};
+
+        // Scattered writes of most instances are slower than writing whole
+        // regions of the attributes which changed
+        bool write_all{dirtyInstances_.size() * 4 >= offsets_.size()};
+        uint32_t dirty_regions{};
+
+        // Drop instances which are now up to date in every slot
+        size_t kept{};
+        for (uint32_t instance : dirtyInstances_) {
+            DirtyMasks& masks{dirtySlots_[instance]};
+            for (uint32_t region{}; region < kBindingCount; ++region) {
+                if ((masks[region] & slot_bit) == 0) {
+                    continue;
+                }
+                if (write_all) {
+                    dirty_regions |= uint32_t{1} << region;
+                } else {
+                    writeValues(slot, region, instance, 1);
+                }
+                masks[region] &= ~slot_bit;
+            }
+            if (masks != DirtyMasks{}) {
+                dirtyInstances_[kept++] = instance;
+            }
+        }
+        dirtyInstances_.resize(kept);
+
+        for (uint32_t region{}; region < kBindingCount; ++region) {
+            if ((dirty_regions & (uint32_t{1} << region)) != 0) {
+                writeValues(slot, region, 0, size());
+            }
+        }
+    }
+
+    // Bind slot copy to bindings [0, kBindingCount)
+    void bind(VkCommandBuffer command_buffer, uint32_t slot_index) const {
+        std::array<VkBuffer, kBindingCount> buffers{};
+        buffers.fill(slots_[slot_index].buffer);
+
+        vkCmdBindVertexBuffers(command_buffer, 0, kBindingCount,
+                               buffers.data(), regionOffsets_.data());
+    }
+
+    // Region of one attribute in slot copy, for use as a storage buffer.
+    // Regions are 256 byte aligned, which satisfies any
+    // minStorageBufferOffsetAlignment
+    VkDescriptorBufferInfo regionInfo(uint32_t slot_index,
+                                      uint32_t region) const {
+        VkDeviceSize end{region + 1 < kBindingCount
+                             ? regionOffsets_[region + 1]
+                             : regionOffsets_[region] + bytes(colors_)};
+
+        return {slots_[slot_index].buffer, regionOffsets_[region],
+                end - regionOffsets_[region]};
+    }
+
+    // Vertex input state of shaders which consume instances.
+    // Locations: 0 vec2 offset, 1 float scale, 2 float rotation, 3 vec4 color
+    static std::array<VkVertexInputBindingDescription, kBindingCount>
+    bindingDescriptions() {
+        std::array<VkVertexInputBindingDescription, kBindingCount>
+            descriptions{};
+        for (uint32_t i{}; i < kBindingCount; ++i) {
+            descriptions[i].binding = i;
+            descriptions[i].stride = kStrides[i];
+            descriptions[i].inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+        }
+        return descriptions;
+    }
+    static std::array<VkVertexInputAttributeDescription, kBindingCount>
+    attributeDescriptions() {
+        std::array<VkFormat, kBindingCount> formats{
+            VK_FORMAT_R32G32_SFLOAT, VK_FORMAT_R32_SFLOAT,
+            VK_FORMAT_R32_SFLOAT, VK_FORMAT_R8G8B8A8_UNORM};
+
+        std::array<VkVertexInputAttributeDescription, kBindingCount>
+            descriptions{};
+        for (uint32_t i{}; i < kBindingCount; ++i) {
+            descriptions[i].location = i;
+            descriptions[i].binding = i;
+            descriptions[i].format = formats[i];
+            descriptions[i].offset = 0;
+        }
+        return descriptions;
+    }
+
+   private:
+    static constexpr uint32_t kWhite{0xFFFFFFFF};
+    static constexpr VkDeviceSize kRegionAlignment{256};
+
+    // Regions in binding order
+    enum Region : uint32_t { kOffset, kScale, kRotation, kColor };
+    static constexpr std::array<uint32_t, kBindingCount> kStrides{
+        sizeof(Offset), sizeof(float), sizeof(float), sizeof(uint32_t)};
+
+    // Slot mask of every region of one instance
+    using DirtyMasks = std::array<uint32_t, kBindingCount>;
+
+    struct Slot {
+        VkBuffer buffer{VK_NULL_HANDLE};
+        DeviceMemoryAllocator::Allocation memory{};
+    };
+
+    static VkDeviceSize alignUp(VkDeviceSize value) {
+        return (value + kRegionAlignment - 1) & ~(kRegionAlignment - 1);
+    }
+    template <typename T>
+    static VkDeviceSize bytes(const std::vector<T>& values) {
+        return values.size() * sizeof(T);
+    }
+
+    void markDirty(uint32_t instance, Region region) {
+        if (dirtySlots_[instance] == DirtyMasks{}) {
+            dirtyInstances_.push_back(instance);
+        }
+        dirtySlots_[instance][region] = allSlotsMask_;
+    }
+    void markAllDirty() {
+        dirtyInstances_.resize(offsets_.size());
+        for (uint32_t i{}; i < size(); ++i) {
+            dirtyInstances_[i] = i;
+        }
+        DirtyMasks all{};
+        all.fill(allSlotsMask_);
+        dirtySlots_.assign(offsets_.size(), all);
+    }
+
+    const void* regionData(uint32_t region) const {
+        switch (region) {
+            case kOffset:
+                return offsets_.data();
+            case kScale:
+                return scales_.data();
+            case kRotation:
+                return rotations_.data();
+            default:
+                return colors_.data();
+        }
+    }
+    // Copy count values of one attribute, starting at first instance
+    void writeValues(Slot& slot, uint32_t region, uint32_t first,
+                     uint32_t count) {
+        VkDeviceSize offset{VkDeviceSize{first} * kStrides[region]};
+        std::memcpy(static_cast<char*>(slot.memory.mapped) +
+                        regionOffsets_[region] + offset,
+                    static_cast<const char*>(regionData(region)) + offset,
+                    VkDeviceSize{count} * kStrides[region]);
+    }
+
+    VkDevice device_;
+    DeviceMemoryAllocator& allocator_;
+
+    // CPU copy of every attribute
+    std::vector<Offset> offsets_;
+    std::vector<float> scales_;
+    std::vector<float> rotations_;
+    std::vector<uint32_t> colors_;
+    std::array<VkDeviceSize, kBindingCount> regionOffsets_{};
+
+    // Bit i of a region mask is set while slot i has not seen the latest
+    // value of that attribute. dirtyInstances_ lists every instance with a
+    // non zero mask
+    std::vector<DirtyMasks> dirtySlots_;
+    std::vector<uint32_t> dirtyInstances_{};
+    uint32_t allSlotsMask_{};
+
+    std::vector<Slot> slots_;
+};
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+// Read only memory mapping of a whole file. Pages are loaded by the kernel on
+// first access, so opening costs no reads and no copies
+class MappedFile {
+   public:
+    explicit MappedFile(const std::string& path) {
+        int fd{::open(path.c_str(), O_RDONLY | O_CLOEXEC)};  // NOLINT
+        if (fd < 0) {
+            throw std::runtime_error{"Failed to open file: " + path};
+        }
+
+        struct stat file_stat {};
+        if (::fstat(fd, &file_stat) != 0) {
+            ::close(fd);
+            throw std::runtime_error{"Failed to stat file: " + path};
+        }
+        size_ = static_cast<size_t>(file_stat.st_size);
+
+        // Zero length mappings are invalid, empty file maps to empty span
+        if (size_ > 0) {
+            data_ = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        // Mapping keeps its own reference to the file
+        ::close(fd);
+
+        if (data_ == MAP_FAILED) {  // NOLINT
+            data_ = nullptr;
+            throw std::runtime_error{"Failed to map file: " + path};
+        }
+    }
+    ~MappedFile() {
+        if (data_ != nullptr) {
+            ::munmap(data_, size_);
+        }
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept
+        : data_{std::exchange(other.data_, nullptr)},
+          size_{std::exchange(other.size_, 0)} {}
+    MappedFile& operator=(MappedFile&& other) noexcept {
+        std::swap(data_, other.data_);
+        std::swap(size_, other.size_);
+        return *this;
+    }
+
+    // Mapping is page aligned
+    const void* data() const { return data_; }
+    size_t size() const { return size_; }
+    std::span<const std::byte> bytes() const {
+        return {static_cast<const std::byte*>(data_), size_};
+    }
+
+    // Asks the kernel to read pages of range, a subspan of bytes(), ahead of
+    // their first access. Only a hint, so failures are ignored
+    void prefetch(std::span<const std::byte> range) const {
+        if (range.empty()) {
+            return;
+        }
+        auto page_size{static_cast<uintptr_t>(::sysconf(_SC_PAGESIZE))};
+        auto begin{reinterpret_cast<uintptr_t>(range.data()) &
+                   ~(page_size - 1)};
+        auto end{reinterpret_cast<uintptr_t>(range.data() + range.size())};
+        ::madvise(reinterpret_cast<void*>(begin), end - begin,  // NOLINT
+                  MADV_WILLNEED);
+    }
+
+   private:
+    void* data_{nullptr};
+    size_t size_{};
+};
@@ -0,0 +1,437 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <charconv>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Triangle meshes: OBJ import, quantization and the mesh asset layout.
+// Optimization lives in mesh_optimizer.hpp, GPU buffers in mesh_buffer.hpp.
+
+// Vertex as imported, before quantization
+struct MeshVertex {
+    std::array<float, 3> position{};
+    std::array<float, 3> normal{};
+    std::array<float, 2> uv{};
+};
+
+struct Mesh {
+    std::vector<MeshVertex> vertices{};
+    // Triangle list
+    std::vector<uint32_t> indices{};
+};
+
+// 16 bytes instead of 32. Mesh is scaled into the [-1, 1] cube on import, so
+// positions need no per mesh dequantization constants
+struct QuantizedVertex {
+    // Snorm16, w is padding
+    std::array<int16_t, 4> position{};
+    // Octahedral encoded unit normal, snorm16
+    std::array<int16_t, 2> normal{};
+    // Half floats, so tiling UVs outside [0, 1] survive
+    std::array<uint16_t, 2> uv{};
+};
+static_assert(sizeof(QuantizedVertex) == 16);
+
+// Mesh asset blob: MeshAssetHeader, vertexCount QuantizedVertex, then
+// indexCount indices of indexSize bytes. Every part is 16 byte aligned
+struct MeshAssetHeader {
+    uint32_t vertexCount{};
+    uint32_t indexCount{};
+    // 2 when every index fits, 4 otherwise
+    uint32_t indexSize{};
+    uint32_t reserved{};
+};
+static_assert(sizeof(MeshAssetHeader) == 16);
+
+// Parts of a mesh asset blob, pointing into the blob
+struct MeshView {
+    uint32_t vertexCount{};
+    uint32_t indexCount{};
+    uint32_t indexSize{};
+    std::span<const std::byte> vertices{};
+    std::span<const std::byte> indices{};
+};
+
+namespace mesh_detail {
+
+// Round to nearest, ties away from zero. Overflow becomes infinity
+inline uint16_t floatToHalf(float value) {
+    auto bits{std::bit_cast<uint32_t>(value)};
+    auto sign{static_cast<uint16_t>((bits >> 16U) & 0x8000U)};
+    uint32_t exponent_bits{(bits >> 23U) & 0xFFU};
+    uint32_t mantissa{bits & 0x7FFFFFU};
+
+    if (exponent_bits == 0xFF) {
+        return static_cast<uint16_t>(sign | 0x7C00U |
+                                     (mantissa != 0 ? 0x200U : 0U));
+    }
+    int32_t exponent{static_cast<int32_t>(exponent_bits) - 127 + 15};
+    if (exponent >= 31) {
+        return static_cast<uint16_t>(sign | 0x7C00U);
+    }
+    if (exponent <= 0) {
+        // Subnormal half, or zero when too small even for that
+        if (exponent < -10) {
+            return sign;
+        }
+        mantissa |= 0x800000U;
+        auto shift{static_cast<uint32_t>(14 - exponent)};
+        uint32_t half{mantissa >> shift};
+        half += (mantissa >> (shift - 1)) & 1U;
+        return static_cast<uint16_t>(sign | half);
+    }
+
+    // Rounding carry may overflow into exponent, which is still correct
+    uint32_t half{(static_cast<uint32_t>(exponent) << 10U) | (mantissa >> 13U)};
+    half += (mantissa >> 12U) & 1U;
+    return static_cast<uint16_t>(sign | half);
+}
+
+inline int16_t toSnorm16(float value) {
+    return static_cast<int16_t>(
+        std::lround(std::clamp(value, -1.0F, 1.0F) * 32767.0F));
+}
+
+// Unit normal onto the octahedron |x| + |y| + |z| = 1, lower half folded
+// over the upper one. Decoded by decodeOctahedral() of shaders/mesh.vert
+inline std::array<int16_t, 2> encodeOctahedral(
+    const std::array<float, 3>& normal) {
+    float length{std::abs(normal[0]) + std::abs(normal[1]) +
+                 std::abs(normal[2])};
+    if (length == 0.0F) {
+        return {0, 0};
+    }
+
+    float x{normal[0] / length};
+    float y{normal[1] / length};
+    if (normal[2] < 0.0F) {
+        float folded_x{(1.0F - std::abs(y)) * (x >= 0.0F ? 1.0F : -1.0F)};
+        float folded_y{(1.0F - std::abs(x)) * (y >= 0.0F ? 1.0F : -1.0F)};
+        x = folded_x;
+        y = folded_y;
+    }
+    return {toSnorm16(x), toSnorm16(y)};
+}
+
+inline std::string_view nextToken(std::string_view& line) {
+    size_t begin{line.find_first_not_of(" \t\r")};
+    if (begin == std::string_view::npos) {
+        line = {};
+        return {};
+    }
+    line.remove_prefix(begin);
+    size_t end{std::min(line.find_first_of(" \t\r"), line.size())};
+    std::string_view token{line.substr(0, end)};
+    line.remove_prefix(end);
+    return token;
+}
+
+inline float parseFloat(std::string_view token) {
+    float value{};
+    auto [end, error]{
+        std::from_chars(token.data(), token.data() + token.size(), value)};
+    if (error != std::errc{} || end != token.data() + token.size()) {
+        throw std::runtime_error{"Invalid OBJ number: " + std::string{token}};
+    }
+    return value;
+}
+
+// 1-based, or negative counting back from the last element. 0 means absent
+inline int64_t parseIndex(std::string_view token, size_t count) {
+    if (token.empty()) {
+        return -1;
+    }
+    int64_t value{};
+    auto [end, error]{
+        std::from_chars(token.data(), token.data() + token.size(), value)};
+    if (error != std::errc{} || end != token.data() + token.size() ||
+        value == 0) {
+        throw std::runtime_error{"Invalid OBJ index: " + std::string{token}};
+    }
+
+    int64_t index{value > 0 ? value - 1
+                            : static_cast<int64_t>(count) + value};
+    if (index < 0 || index >= static_cast<int64_t>(count)) {
+        throw std::runtime_error{"OBJ index out of range: " +
+                                 std::string{token}};
+    }
+    return index;
+}
+
+struct CornerKey {
+    int64_t position{};
+    int64_t uv{};
+    int64_t normal{};
+
+    bool operator==(const CornerKey&) const = default;
+};
+struct CornerKeyHash {
+    size_t operator()(const CornerKey& key) const {
+        auto hash{static_cast<uint64_t>(key.position) * 0x9E3779B97F4A7C15ULL};
+        hash ^= static_cast<uint64_t>(key.uv) + 0x632BE59BD9B4E019ULL +
+                (hash << 6U) + (hash >> 2U);
+        hash ^= static_cast<uint64_t>(key.normal) + 0x632BE59BD9B4E019ULL +
+                (hash << 6U) + (hash >> 2U);
+        return static_cast<size_t>(hash);
+    }
+};
+
+// Area weighted face normals summed per vertex position
+inline void generateNormals(Mesh& mesh,
+                            const std::vector<int64_t>& vertex_positions,
+                            size_t position_count) {
+    std::vector<std::array<float, 3>> sums(position_count);
+    for (size_t i{}; i + 2 < mesh.indices.size(); i += 3) {
+        const auto& a{mesh.vertices[mesh.indices[i]].position};
+        const auto& b{mesh.vertices[mesh.indices[i + 1]].position};
+        const auto& c{mesh.vertices[mesh.indices[i + 2]].position};
+        std::array<float, 3> ab{b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+        std::array<float, 3> ac{c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+        std::array<float, 3> face{ab[1] * ac[2] - ab[2] * ac[1],
+                                  ab[2] * ac[0] - ab[0] * ac[2],
+                                  ab[0] * ac[1] - ab[1] * ac[0]};
+        for (size_t k{}; k < 3; ++k) {
+            auto position{static_cast<size_t>(
+                vertex_positions[mesh.indices[i + k]])};
+            for (size_t axis{}; axis < 3; ++axis) {
+                sums[position][axis] += face[axis];
+            }
+        }
+    }
+
+    for (size_t i{}; i < mesh.vertices.size(); ++i) {
+        const auto& sum{sums[static_cast<size_t>(vertex_positions[i])]};
+        float length{std::sqrt(sum[0] * sum[0] + sum[1] * sum[1] +
+                               sum[2] * sum[2])};
+        mesh.vertices[i].normal =
+            length > 0.0F ? std::array<float, 3>{sum[0] / length,
+                                                 sum[1] / length,
+                                                 sum[2] / length}
+                          : std::array<float, 3>{0.0F, 0.0F, 1.0F};
+    }
+}
+
+}  // namespace mesh_detail
+
+// Parses positions, UVs, normals and faces of Wavefront OBJ text. Polygons
+// are triangulated as fans, and corners sharing position, UV and normal
+// become one vertex. Normals are generated when the file has none. UV origin
+// is moved to the top left corner, like Vulkan's. Everything else (groups,
+// materials, lines) is ignored
+inline Mesh importObj(std::string_view text) {
+    using namespace mesh_detail;
+
+    std::vector<std::array<float, 3>> positions{};
+    std::vector<std::array<float, 2>> uvs{};
+    std::vector<std::array<float, 3>> normals{};
+    std::unordered_map<CornerKey, uint32_t, CornerKeyHash> vertex_ids{};
+    // Position of every vertex, for normal generation
+    std::vector<int64_t> vertex_positions{};
+    bool missing_normals{};
+
+    Mesh mesh{};
+    std::vector<uint32_t> polygon{};
+    while (!text.empty()) {
+        size_t line_end{std::min(text.find('\n'), text.size())};
+        std::string_view line{text.substr(0, line_end)};
+        text.remove_prefix(std::min(line_end + 1, text.size()));
+
+        std::string_view keyword{nextToken(line)};
+        if (keyword == "v") {
+            positions.push_back({parseFloat(nextToken(line)),
+                                 parseFloat(nextToken(line)),
+                                 parseFloat(nextToken(line))});
+        } else if (keyword == "vt") {
+            float u{parseFloat(nextToken(line))};
+            std::string_view v{nextToken(line)};
+            uvs.push_back({u, 1.0F - (v.empty() ? 0.0F : parseFloat(v))});
+        } else if (keyword == "vn") {
+            normals.push_back({parseFloat(nextToken(line)),
+                               parseFloat(nextToken(line)),
+                               parseFloat(nextToken(line))});
+        } else if (keyword == "f") {
+            polygon.clear();
+            for (std::string_view corner{nextToken(line)}; !corner.empty();
+                 corner = nextToken(line)) {
+                // p, p/t, p//n or p/t/n
+                size_t first_slash{corner.find('/')};
+                size_t second_slash{
+                    first_slash == std::string_view::npos
+                        ? std::string_view::npos
+                        : corner.find('/', first_slash + 1)};
+                CornerKey key{
+                    parseIndex(corner.substr(0, first_slash),
+                               positions.size()),
+                    first_slash == std::string_view::npos
+                        ? -1
+                        : parseIndex(corner.substr(first_slash + 1,
+                                                   second_slash -
+                                                       first_slash - 1),
+                                     uvs.size()),
+                    second_slash == std::string_view::npos
+                        ? -1
+                        : parseIndex(corner.substr(second_slash + 1),
+                                     normals.size())};
+                if (key.position < 0) {
+                    throw std::runtime_error{"OBJ face without position!"};
+                }
+
+                auto [it, inserted]{vertex_ids.try_emplace(
+                    key, static_cast<uint32_t>(mesh.vertices.size()))};
+                if (inserted) {
+                    MeshVertex vertex{};
+                    vertex.position =
+                        positions[static_cast<size_t>(key.position)];
+                    if (key.uv >= 0) {
+                        vertex.uv = uvs[static_cast<size_t>(key.uv)];
+                    }
+                    if (key.normal >= 0) {
+                        vertex.normal =
+                            normals[static_cast<size_t>(key.normal)];
+                    } else {
+                        missing_normals = true;
+                    }
+                    mesh.vertices.push_back(vertex);
+                    vertex_positions.push_back(key.position);
+                }
+                polygon.push_back(it->second);
+            }
+
+            for (size_t i{2}; i < polygon.size(); ++i) {
+                mesh.indices.insert(mesh.indices.end(),
+                                    {polygon[0], polygon[i - 1], polygon[i]});
+            }
+        }
+    }
+
+    if (mesh.indices.empty()) {
+        throw std::runtime_error{"OBJ has no faces!"};
+    }
+    if (missing_normals) {
+        generateNormals(mesh, vertex_positions, positions.size());
+    }
+    return mesh;
+}
+
+// Centers mesh on its bounding box and scales it uniformly into [-1, 1]
+inline void normalizeMesh(Mesh& mesh) {
+    std::array<float, 3> min{mesh.vertices.front().position};
+    std::array<float, 3> max{min};
+    for (const MeshVertex& vertex : mesh.vertices) {
+        for (size_t axis{}; axis < 3; ++axis) {
+            min[axis] = std::min(min[axis], vertex.position[axis]);
+            max[axis] = std::max(max[axis], vertex.position[axis]);
+        }
+    }
+
+    float half_extent{};
+    for (size_t axis{}; axis < 3; ++axis) {
+        half_extent = std::max(half_extent, (max[axis] - min[axis]) / 2.0F);
+    }
+    float scale{half_extent > 0.0F ? 1.0F / half_extent : 1.0F};
+    for (MeshVertex& vertex : mesh.vertices) {
+        for (size_t axis{}; axis < 3; ++axis) {
+            vertex.position[axis] =
+                (vertex.position[axis] - (min[axis] + max[axis]) / 2.0F) *
+                scale;
+        }
+    }
+}
+
+// Quantizes a normalized mesh into a mesh asset blob
+inline std::vector<std::byte> writeMeshAsset(const Mesh& mesh) {
+    using namespace mesh_detail;
+
+    MeshAssetHeader header{};
+    header.vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+    header.indexCount = static_cast<uint32_t>(mesh.indices.size());
+    header.indexSize = mesh.vertices.size() <= UINT16_MAX + 1 ? 2 : 4;
+
+    size_t vertices_size{mesh.vertices.size() * sizeof(QuantizedVertex)};
+    size_t indices_size{mesh.indices.size() * header.indexSize};
+    std::vector<std::byte> blob(sizeof(header) + vertices_size +
+                                (indices_size + 15) / 16 * 16);
+    std::memcpy(blob.data(), &header, sizeof(header));
+
+    std::byte* vertex_data{blob.data() + sizeof(header)};
+    for (const MeshVertex& vertex : mesh.vertices) {
+        QuantizedVertex quantized{};
+        for (size_t axis{}; axis < 3; ++axis) {
+            quantized.position[axis] = toSnorm16(vertex.position[axis]);
+        }
+        quantized.normal = encodeOctahedral(vertex.normal);
+        quantized.uv = {floatToHalf(vertex.uv[0]), floatToHalf(vertex.uv[1])};
+
+        std::memcpy(vertex_data, &quantized, sizeof(quantized));
+        vertex_data += sizeof(quantized);
+    }
+
+    std::byte* index_data{blob.data() + sizeof(header) + vertices_size};
+    for (uint32_t index : mesh.indices) {
+        if (header.indexSize == 2) {
+            auto index16{static_cast<uint16_t>(index)};
+            std::memcpy(index_data, &index16, sizeof(index16));
+        } else {
+            std::memcpy(index_data, &index, sizeof(index));
+        }
+        index_data += header.indexSize;
+    }
+    return blob;
+}
+
+// Checks sizes and indices of a mesh asset blob and splits it into its
+// parts
+inline MeshView parseMeshAsset(std::span<const std::byte> blob) {
+    MeshAssetHeader header{};
+    if (blob.size() < sizeof(header)) {
+        throw std::runtime_error{"Invalid mesh asset!"};
+    }
+    std::memcpy(&header, blob.data(), sizeof(header));
+
+    uint64_t vertices_size{uint64_t{header.vertexCount} *
+                           sizeof(QuantizedVertex)};
+    uint64_t indices_size{uint64_t{header.indexCount} * header.indexSize};
+    if ((header.indexSize != 2 && header.indexSize != 4) ||
+        header.indexCount % 3 != 0 ||
+        sizeof(header) + vertices_size + indices_size > blob.size()) {
+        throw std::runtime_error{"Invalid mesh asset!"};
+    }
+
+    MeshView view{};
+    view.vertexCount = header.vertexCount;
+    view.indexCount = header.indexCount;
+    view.indexSize = header.indexSize;
+    view.vertices = blob.subspan(sizeof(header), vertices_size);
+    view.indices = blob.subspan(sizeof(header) + vertices_size, indices_size);
+
+    // Indices past the vertices would make the GPU read out of bounds
+    uint32_t max_index{};
+    for (size_t offset{}; offset < view.indices.size();
+         offset += header.indexSize) {
+        uint32_t index{};
+        if (header.indexSize == 2) {
+            uint16_t index16{};
+            std::memcpy(&index16, view.indices.data() + offset,
+                        sizeof(index16));
+            index = index16;
+        } else {
+            std::memcpy(&index, view.indices.data() + offset, sizeof(index));
+        }
+        max_index = std::max(max_index, index);
+    }
+    if (header.indexCount > 0 && max_index >= header.vertexCount) {
+        throw std::runtime_error{"Invalid mesh asset!"};
+    }
+    return view;
+}
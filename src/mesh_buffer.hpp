@@ -0,0 +1,129 @@
+#pragma once
+
+#include <vulkan/vulkan_core.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+
+#include "device_memory_allocator.hpp"
+#include "instance_buffer.hpp"
+#include "mesh.hpp"
+#include "upload_manager.hpp"
+
+// Device local vertices and indices of one quantized mesh, in one buffer.
+// Uploaded straight from the mesh asset, which for an asset pack are the
+// mapped file pages. Vertices are bound after the instance bindings, so
+// shaders see per instance attributes and per vertex ones side by side
+class MeshBuffer {
+   public:
+    static constexpr uint32_t kBinding{InstanceBuffer::kBindingCount};
+    static constexpr uint32_t kFirstLocation{InstanceBuffer::kBindingCount};
+    static constexpr uint32_t kAttributeCount{3};
+
+    MeshBuffer(VkDevice device, DeviceMemoryAllocator& allocator,
+               UploadManager& upload_manager, const MeshView& mesh)
+        : device_{device},
+          allocator_{allocator},
+          indexCount_{mesh.indexCount},
+          indexType_{mesh.indexSize == 2 ? VK_INDEX_TYPE_UINT16
+                                         : VK_INDEX_TYPE_UINT32},
+          indexOffset_{(mesh.vertices.size() + kIndexAlignment - 1) &
+                       ~(kIndexAlignment - 1)} {
+        if (mesh.indexCount == 0) {
+            throw std::runtime_error{"Mesh has no triangles!"};
+        }
+
+        VkBufferCreateInfo buffer_info{};
+        buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        buffer_info.size = indexOffset_ + mesh.indices.size();
+        buffer_info.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+                            VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
+                            VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        if (vkCreateBuffer(device_, &buffer_info, nullptr, &buffer_) !=
+            VK_SUCCESS) {
+            throw std::runtime_error{"Failed to create mesh buffer!"};
+        }
+        memory_ = allocator_.allocateForBuffer(
+            buffer_, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        upload_manager.uploadBuffer(buffer_, 0, mesh.vertices.data(),
+                                    mesh.vertices.size(),
+                                    VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                                    VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+        upload_manager.uploadBuffer(buffer_, indexOffset_, mesh.indices.data(),
+                                    mesh.indices.size(),
+                                    VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                                    VK_ACCESS_INDEX_READ_BIT);
+    }
+    ~MeshBuffer() {
+        vkDestroyBuffer(device_, buffer_, nullptr);
+        if (memory_.memory != VK_NULL_HANDLE) {
+            allocator_.free(memory_);
+        }
+    }
+
+    MeshBuffer(const MeshBuffer&) = delete;
+    MeshBuffer& operator=(const MeshBuffer&) = delete;
+    MeshBuffer(MeshBuffer&&) = delete;
+    MeshBuffer& operator=(MeshBuffer&&) = delete;
+
+    uint32_t indexCount() const { return indexCount_; }
+    VkIndexType indexType() const { return indexType_; }
+
+    // Bind vertices to kBinding and indices
+    void bind(VkCommandBuffer command_buffer) const {
+        VkDeviceSize offset{};
+        vkCmdBindVertexBuffers(command_buffer, kBinding, 1, &buffer_, &offset);
+        vkCmdBindIndexBuffer(command_buffer, buffer_, indexOffset_,
+                             indexType_);
+    }
+
+    // Indices start at indexOffset() of buffer(), after the vertices
+    VkBuffer buffer() const { return buffer_; }
+    VkDeviceSize indexOffset() const { return indexOffset_; }
+
+    // Vertex input state of mesh.vert, in addition to the instance one.
+    // Locations: 4 vec4 position, 5 vec2 octahedral normal, 6 vec2 uv
+    static VkVertexInputBindingDescription bindingDescription() {
+        VkVertexInputBindingDescription description{};
+        description.binding = kBinding;
+        description.stride = sizeof(QuantizedVertex);
+        description.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+        return description;
+    }
+    static std::array<VkVertexInputAttributeDescription, kAttributeCount>
+    attributeDescriptions() {
+        std::array<VkFormat, kAttributeCount> formats{
+            VK_FORMAT_R16G16B16A16_SNORM, VK_FORMAT_R16G16_SNORM,
+            VK_FORMAT_R16G16_SFLOAT};
+        std::array<uint32_t, kAttributeCount> offsets{
+            offsetof(QuantizedVertex, position),
+            offsetof(QuantizedVertex, normal), offsetof(QuantizedVertex, uv)};
+
+        std::array<VkVertexInputAttributeDescription, kAttributeCount>
+            descriptions{};
+        for (uint32_t i{}; i < kAttributeCount; ++i) {
+            descriptions[i].location = kFirstLocation + i;
+            descriptions[i].binding = kBinding;
+            descriptions[i].format = formats[i];
+            descriptions[i].offset = offsets[i];
+        }
+        return descriptions;
+    }
+
+   private:
+    static constexpr VkDeviceSize kIndexAlignment{16};
+
+    VkDevice device_;
+    DeviceMemoryAllocator& allocator_;
+    uint32_t indexCount_;
+    VkIndexType indexType_;
+    VkDeviceSize indexOffset_;
+
+    VkBuffer buffer_{VK_NULL_HANDLE};
+    DeviceMemoryAllocator::Allocation memory_{};
+};
@@ -0,0 +1,370 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <numeric>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "mesh.hpp"
+
+// Offline index and vertex reordering. Runs in the packer, or at startup
+// when a mesh is imported straight from an OBJ file. optimizeMesh() applies
+// the stages in the order they depend on each other
+namespace mesh_optimizer {
+
+// Post transform cache size the vertex cache optimizer aims for. Larger
+// than FIFO caches of current GPUs, which is harmless, smaller would split
+// strips too often
+inline constexpr int32_t kCacheSize{32};
+// Size of the FIFO cache used to measure and to find cluster boundaries
+inline constexpr uint32_t kFifoCacheSize{16};
+// Allowed ACMR increase of overdraw clustering
+inline constexpr float kOverdrawThreshold{1.05F};
+
+// Average cache miss ratio: transformed vertices per triangle with a FIFO
+// post transform cache. 0.5 is the ideal for a regular grid, 3 the worst
+inline float averageCacheMissRatio(std::span<const uint32_t> indices,
+                                   size_t vertex_count,
+                                   uint32_t cache_size = kFifoCacheSize) {
+    if (indices.size() < 3) {
+        return 0.0F;
+    }
+
+    // Vertex is cached while fewer than cache_size misses happened since its
+    // own miss
+    std::vector<uint32_t> timestamps(vertex_count);
+    uint32_t time{cache_size + 1};
+    size_t misses{};
+    for (uint32_t index : indices) {
+        if (time - timestamps[index] > cache_size) {
+            timestamps[index] = time++;
+            ++misses;
+        }
+    }
+    return static_cast<float>(misses) /
+           static_cast<float>(indices.size() / 3);
+}
+
+namespace detail {
+
+inline float vertexScore(int32_t cache_position, uint32_t live_triangles) {
+    if (live_triangles == 0) {
+        return -1.0F;
+    }
+
+    float score{};
+    if (cache_position >= 0) {
+        // Vertices of the last triangle score lower, so strips do not
+        // double back on themselves
+        score = cache_position < 3
+                    ? 0.75F
+                    : std::pow(1.0F - static_cast<float>(cache_position - 3) /
+                                          static_cast<float>(kCacheSize - 3),
+                               1.5F);
+    }
+    // Boost vertices with few triangles left, so no lone triangles remain
+    return score + 2.0F / std::sqrt(static_cast<float>(live_triangles));
+}
+
+using Vec3 = std::array<float, 3>;
+
+inline Vec3 sub(const Vec3& a, const Vec3& b) {
+    return {a[0] - b[0], a[1] - b[1], a[2] - b[2]};
+}
+inline Vec3 cross(const Vec3& a, const Vec3& b) {
+    return {a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2],
+            a[0] * b[1] - a[1] * b[0]};
+}
+inline float dot(const Vec3& a, const Vec3& b) {
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+}  // namespace detail
+
+// Reorders triangles for post transform cache reuse, after Forsyth's
+// "Linear-Speed Vertex Cache Optimisation". Greedily emits the best scoring
+// triangle touching the simulated LRU cache, scores come from cache position
+// and the number of triangles a vertex still has to be drawn in
+inline void optimizeVertexCache(std::span<uint32_t> indices,
+                                size_t vertex_count) {
+    using detail::vertexScore;
+
+    size_t triangle_count{indices.size() / 3};
+    if (triangle_count == 0) {
+        return;
+    }
+
+    // Triangles of every vertex, the first live[v] ones are not emitted yet
+    std::vector<uint32_t> live(vertex_count);
+    for (uint32_t index : indices) {
+        ++live[index];
+    }
+    std::vector<uint32_t> offsets(vertex_count + 1);
+    std::inclusive_scan(live.begin(), live.end(), offsets.begin() + 1);
+    std::vector<uint32_t> adjacency(indices.size());
+    {
+        std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t i{}; i < indices.size(); ++i) {
+            adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+        }
+    }
+
+    std::vector<int32_t> cache_position(vertex_count, -1);
+    std::vector<float> vertex_scores(vertex_count);
+    for (size_t v{}; v < vertex_count; ++v) {
+        vertex_scores[v] = vertexScore(-1, live[v]);
+    }
+    std::vector<bool> emitted(triangle_count);
+
+    std::vector<uint32_t> result{};
+    result.reserve(indices.size());
+    std::vector<uint32_t> cache{};
+    std::vector<uint32_t> next_cache{};
+    // Fallback when no cached vertex has triangles left: next triangle in
+    // input order, which keeps the original locality
+    size_t cursor{};
+    int64_t best{-1};
+    while (result.size() < indices.size()) {
+        if (best < 0) {
+            while (emitted[cursor]) {
+                ++cursor;
+            }
+            best = static_cast<int64_t>(cursor);
+        }
+
+        auto triangle{static_cast<size_t>(best)};
+        emitted[triangle] = true;
+        std::span<const uint32_t> corners{indices.subspan(triangle * 3, 3)};
+        next_cache.clear();
+        for (uint32_t v : corners) {
+            result.push_back(v);
+
+            // Swap triangle past the live range of v
+            uint32_t* begin{&adjacency[offsets[v]]};
+            uint32_t* last{begin + live[v] - 1};
+            std::iter_swap(std::find(begin, last + 1, triangle), last);
+            --live[v];
+
+            if (std::find(next_cache.begin(), next_cache.end(), v) ==
+                next_cache.end()) {
+                next_cache.push_back(v);
+            }
+        }
+        for (uint32_t v : cache) {
+            if (std::find(corners.begin(), corners.end(), v) == corners.end()) {
+                next_cache.push_back(v);
+            }
+        }
+
+        // Vertices pushed out of the cache are rescored too
+        for (size_t i{}; i < next_cache.size(); ++i) {
+            uint32_t v{next_cache[i]};
+            cache_position[v] =
+                i < kCacheSize ? static_cast<int32_t>(i) : int32_t{-1};
+            vertex_scores[v] = vertexScore(cache_position[v], live[v]);
+        }
+
+        best = -1;
+        float best_score{-1.0F};
+        for (uint32_t v : next_cache) {
+            for (uint32_t i{}; i < live[v]; ++i) {
+                uint32_t candidate{adjacency[offsets[v] + i]};
+                float score{vertex_scores[indices[candidate * 3]] +
+                            vertex_scores[indices[candidate * 3 + 1]] +
+                            vertex_scores[indices[candidate * 3 + 2]]};
+                if (score > best_score) {
+                    best_score = score;
+                    best = candidate;
+                }
+            }
+        }
+
+        next_cache.resize(std::min<size_t>(next_cache.size(), kCacheSize));
+        std::swap(cache, next_cache);
+    }
+
+    std::copy(result.begin(), result.end(), indices.begin());
+}
+
+// Reorders clusters of a cache optimized index buffer so that triangles
+// facing outwards come first, after Sander et al. "Fast Triangle Reordering
+// for Vertex Locality and Reduced Overdraw". Clusters start where the FIFO
+// cache is flushed anyway, and are split further while ACMR stays within
+// threshold of the unsplit one. Front most clusters then occlude the rest
+// for most view directions, so early depth testing rejects their fragments
+inline void optimizeOverdraw(std::span<uint32_t> indices,
+                             std::span<const MeshVertex> vertices,
+                             float threshold = kOverdrawThreshold) {
+    using detail::Vec3;
+
+    size_t triangle_count{indices.size() / 3};
+    if (triangle_count < 2) {
+        return;
+    }
+
+    std::vector<uint32_t> timestamps(vertices.size());
+    uint32_t time{kFifoCacheSize + 1};
+    auto misses{[&](size_t triangle) {
+        uint32_t count{};
+        for (size_t k{}; k < 3; ++k) {
+            uint32_t index{indices[triangle * 3 + k]};
+            if (time - timestamps[index] > kFifoCacheSize) {
+                timestamps[index] = time++;
+                ++count;
+            }
+        }
+        return count;
+    }};
+    auto flush{[&] { time += kFifoCacheSize + 1; }};
+
+    // Hard boundaries: triangles missing all three vertices
+    std::vector<size_t> hard{};
+    for (size_t t{}; t < triangle_count; ++t) {
+        if (misses(t) == 3) {
+            hard.push_back(t);
+        }
+    }
+    hard.push_back(triangle_count);
+
+    // Soft boundaries: restart the cache once a cluster is as cheap as its
+    // hard cluster allows
+    std::vector<size_t> clusters{};
+    for (size_t h{}; h + 1 < hard.size(); ++h) {
+        size_t begin{hard[h]};
+        size_t end{hard[h + 1]};
+
+        flush();
+        uint32_t cluster_misses{};
+        for (size_t t{begin}; t < end; ++t) {
+            cluster_misses += misses(t);
+        }
+        float limit{threshold * static_cast<float>(cluster_misses) /
+                    static_cast<float>(end - begin)};
+
+        flush();
+        size_t start{begin};
+        uint32_t running{};
+        clusters.push_back(begin);
+        for (size_t t{begin}; t + 1 < end; ++t) {
+            running += misses(t);
+            if (static_cast<float>(running) /
+                    static_cast<float>(t - start + 1) <=
+                limit) {
+                flush();
+                start = t + 1;
+                running = 0;
+                clusters.push_back(start);
+            }
+        }
+    }
+    clusters.push_back(triangle_count);
+
+    // Area weighted centroids and normals
+    auto triangleNormal{[&](size_t t) {
+        const Vec3& a{vertices[indices[t * 3]].position};
+        const Vec3& b{vertices[indices[t * 3 + 1]].position};
+        const Vec3& c{vertices[indices[t * 3 + 2]].position};
+        return detail::cross(detail::sub(b, a), detail::sub(c, a));
+    }};
+    auto triangleCentroid{[&](size_t t) {
+        Vec3 centroid{};
+        for (size_t k{}; k < 3; ++k) {
+            const Vec3& p{vertices[indices[t * 3 + k]].position};
+            for (size_t axis{}; axis < 3; ++axis) {
+                centroid[axis] += p[axis] / 3.0F;
+            }
+        }
+        return centroid;
+    }};
+
+    Vec3 mesh_centroid{};
+    float mesh_area{};
+    for (size_t t{}; t < triangle_count; ++t) {
+        Vec3 normal{triangleNormal(t)};
+        float area{std::sqrt(detail::dot(normal, normal))};
+        Vec3 centroid{triangleCentroid(t)};
+        for (size_t axis{}; axis < 3; ++axis) {
+            mesh_centroid[axis] += centroid[axis] * area;
+        }
+        mesh_area += area;
+    }
+    if (mesh_area > 0.0F) {
+        for (float& value : mesh_centroid) {
+            value /= mesh_area;
+        }
+    }
+
+    size_t cluster_count{clusters.size() - 1};
+    std::vector<float> sort_keys(cluster_count);
+    for (size_t c{}; c < cluster_count; ++c) {
+        Vec3 centroid{};
+        Vec3 normal{};
+        float area{};
+        for (size_t t{clusters[c]}; t < clusters[c + 1]; ++t) {
+            Vec3 triangle_normal{triangleNormal(t)};
+            float triangle_area{
+                std::sqrt(detail::dot(triangle_normal, triangle_normal))};
+            Vec3 triangle_centroid{triangleCentroid(t)};
+            for (size_t axis{}; axis < 3; ++axis) {
+                centroid[axis] += triangle_centroid[axis] * triangle_area;
+                normal[axis] += triangle_normal[axis];
+            }
+            area += triangle_area;
+        }
+
+        float normal_length{std::sqrt(detail::dot(normal, normal))};
+        if (area > 0.0F && normal_length > 0.0F) {
+            for (size_t axis{}; axis < 3; ++axis) {
+                centroid[axis] /= area;
+            }
+            sort_keys[c] =
+                detail::dot(detail::sub(centroid, mesh_centroid), normal) /
+                normal_length;
+        }
+    }
+
+    std::vector<size_t> order(cluster_count);
+    std::iota(order.begin(), order.end(), size_t{});
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return sort_keys[a] > sort_keys[b];
+    });
+
+    std::vector<uint32_t> result{};
+    result.reserve(indices.size());
+    for (size_t c : order) {
+        std::span<const uint32_t> cluster{indices.subspan(
+            clusters[c] * 3, (clusters[c + 1] - clusters[c]) * 3)};
+        result.insert(result.end(), cluster.begin(), cluster.end());
+    }
+    std::copy(result.begin(), result.end(), indices.begin());
+}
+
+// Orders vertices by first use and drops unused ones, so the vertex fetch
+// of consecutive triangles reads consecutive memory
+inline void optimizeVertexFetch(std::vector<MeshVertex>& vertices,
+                                std::span<uint32_t> indices) {
+    std::vector<uint32_t> remap(vertices.size(), UINT32_MAX);
+    std::vector<MeshVertex> reordered{};
+    reordered.reserve(vertices.size());
+    for (uint32_t& index : indices) {
+        if (remap[index] == UINT32_MAX) {
+            remap[index] = static_cast<uint32_t>(reordered.size());
+            reordered.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+    vertices = std::move(reordered);
+}
+
+inline void optimizeMesh(Mesh& mesh) {
+    optimizeVertexCache(mesh.indices, mesh.vertices.size());
+    optimizeOverdraw(mesh.indices, mesh.vertices);
+    optimizeVertexFetch(mesh.vertices, mesh.indices);
+}
+
+}  // namespace mesh_optimizer
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <vulkan/vulkan_core.h>
+
+#include <cstdint>
+#include <vector>
+
+// Tells whether a pipeline came from the pipeline cache, through
+// VK_EXT_pipeline_creation_feedback. Chain it into a pipeline create info,
+// create the pipeline, then read describe(). Without the extension the
+// driver reports nothing, so only whether cache data was loaded is known
+class PipelineFeedback {
+   public:
+    // enabled: VK_EXT_pipeline_creation_feedback is enabled on device
+    PipelineFeedback(bool enabled, uint32_t stage_count)
+        : enabled_{enabled}, stages_(stage_count) {
+        info_.sType =
+            VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO_EXT;
+        info_.pPipelineCreationFeedback = &pipeline_;
+        info_.pipelineStageCreationFeedbackCount = stage_count;
+        info_.pPipelineStageCreationFeedbacks = stages_.data();
+    }
+
+    PipelineFeedback(const PipelineFeedback&) = delete;
+    PipelineFeedback& operator=(const PipelineFeedback&) = delete;
+    PipelineFeedback(PipelineFeedback&&) = delete;
+    PipelineFeedback& operator=(PipelineFeedback&&) = delete;
+
+    // pNext of create info. Chains next behind feedback if enabled
+    const void* chain(const void* next) {
+        if (!enabled_) {
+            return next;
+        }
+        info_.pNext = next;
+        return &info_;
+    }
+
+    // cache_loaded: pipeline cache was populated from disk
+    const char* describe(bool cache_loaded) const {
+        if (!enabled_ ||
+            (pipeline_.flags & VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT_EXT) ==
+                0) {
+            return cache_loaded ? "pipeline cache loaded" : "no pipeline cache";
+        }
+        return (pipeline_.flags & kCacheHit) != 0 ? "pipeline cache hit"
+                                                  : "pipeline cache miss";
+    }
+
+   private:
+    static constexpr VkPipelineCreationFeedbackFlagsEXT kCacheHit{
+        VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT_EXT};
+
+    bool enabled_;
+    VkPipelineCreationFeedbackEXT pipeline_{};
+    std::vector<VkPipelineCreationFeedbackEXT> stages_;
+    VkPipelineCreationFeedbackCreateInfoEXT info_{};
+};
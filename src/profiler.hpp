@@ -0,0 +1,319 @@
+#pragma once
+
+#include <vulkan/vulkan_core.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Single producer single consumer lock-free ring buffer
+template <typename T, size_t kCapacity>
+class SpscRing {
+    static_assert((kCapacity & (kCapacity - 1)) == 0,
+                  "Capacity must be a power of two");
+
+   public:
+    // Returns false if ring is full
+    bool push(const T& value) {
+        size_t head{head_.load(std::memory_order_relaxed)};
+        if (head - tail_.load(std::memory_order_acquire) == kCapacity) {
+            return false;
+        }
+
+        buffer_[head & (kCapacity - 1)] = value;
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+    std::optional<T> pop() {
+        size_t tail{tail_.load(std::memory_order_relaxed)};
+        if (tail == head_.load(std::memory_order_acquire)) {
+            return std::nullopt;
+        }
+
+        T value{buffer_[tail & (kCapacity - 1)]};
+        tail_.store(tail + 1, std::memory_order_release);
+        return value;
+    }
+
+   private:
+    std::array<T, kCapacity> buffer_{};
+    // Separate cache lines, so producer and consumer do not false share
+    alignas(64) std::atomic<size_t> head_{};
+    alignas(64) std::atomic<size_t> tail_{};
+};
+
+struct ProfileEvent {
+    // Must be a string literal
+    const char* name{};
+    uint64_t frame{};
+    // Microseconds since profiler creation
+    double startUs{};
+    double durationUs{};
+    bool gpu{};
+};
+
+// Collects CPU phase timings and GPU timestamp scopes of every frame.
+// Events go through a lock-free ring into a background thread which writes
+// them to disk, so the render thread never blocks on file I/O.
+// Output format follows file extension: .csv writes CSV, anything else writes
+// Chrome trace JSON (load it in chrome://tracing or Perfetto).
+//
+// All methods except the constructor must be called from the render thread.
+class FrameProfiler {
+   public:
+    static constexpr uint32_t kMaxGpuScopesPerFrame{16};
+
+    FrameProfiler(VkPhysicalDevice physical_device, VkDevice device,
+                  uint32_t frame_slot_count, uint32_t timestamp_valid_bits,
+                  const std::string& output_path)
+        : device_{device},
+          output_{output_path, std::ios::trunc},
+          csv_{output_path.ends_with(".csv")},
+          slots_(frame_slot_count) {
+        if (!output_) {
+            throw std::runtime_error{"Failed to open profile output file!"};
+        }
+
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(physical_device, &properties);
+        timestampPeriod_ = properties.limits.timestampPeriod;
+
+        if (timestamp_valid_bits > 0 && timestampPeriod_ > 0.0F) {
+            timestampMask_ = timestamp_valid_bits >= 64
+                                 ? ~uint64_t{}
+                                 : (uint64_t{1} << timestamp_valid_bits) - 1;
+
+            VkQueryPoolCreateInfo pool_info{};
+            pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+            pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+            pool_info.queryCount =
+                frame_slot_count * kMaxGpuScopesPerFrame * 2;
+
+            if (vkCreateQueryPool(device_, &pool_info, nullptr,
+                                  &queryPool_) != VK_SUCCESS) {
+                throw std::runtime_error{"Failed to create query pool!"};
+            }
+        }
+
+        if (csv_) {
+            output_ << "track,name,frame,start_us,duration_us\n";
+        } else {
+            output_ << "{\"traceEvents\":[\n"
+                    << R"({"name":"thread_name","ph":"M","pid":0,"tid":0,)"
+                    << R"("args":{"name":"CPU"}},)" << '\n'
+                    << R"({"name":"thread_name","ph":"M","pid":0,"tid":1,)"
+                    << R"("args":{"name":"GPU"}})";
+        }
+
+        exporter_ = std::jthread{[this](const std::stop_token& stop) {
+            exportLoop(stop);
+        }};
+    }
+    ~FrameProfiler() {
+        exporter_.request_stop();
+        exporter_.join();
+
+        if (!csv_) {
+            output_ << "\n]}\n";
+        }
+        vkDestroyQueryPool(device_, queryPool_, nullptr);
+    }
+
+    FrameProfiler(const FrameProfiler&) = delete;
+    FrameProfiler& operator=(const FrameProfiler&) = delete;
+    FrameProfiler(FrameProfiler&&) = delete;
+    FrameProfiler& operator=(FrameProfiler&&) = delete;
+
+    double nowUs() const {
+        return std::chrono::duration<double, std::micro>(
+                   std::chrono::steady_clock::now() - epoch_)
+            .count();
+    }
+
+    void addCpuEvent(const char* name, double start_us, double end_us) {
+        push({name, frame_, start_us, end_us - start_us, false});
+    }
+
+    // Start a frame in frame slot. Fence of the slot must have signaled, so
+    // GPU results of the previous frame in this slot are read here
+    void beginFrame(uint32_t slot, uint64_t frame) {
+        currentSlot_ = slot;
+        frame_ = frame;
+        collectGpuResults(slots_[slot]);
+    }
+    // Mark the moment frame was submitted. GPU scopes of the frame are placed
+    // on the timeline relative to it
+    void endFrame() { slots_[currentSlot_].submitUs = nowUs(); }
+
+    // Must be recorded before any GPU scope of the frame, outside of render
+    // pass
+    void cmdResetQueries(VkCommandBuffer command_buffer) {
+        if (queryPool_ == VK_NULL_HANDLE) {
+            return;
+        }
+        vkCmdResetQueryPool(command_buffer, queryPool_, firstQuery(),
+                            kMaxGpuScopesPerFrame * 2);
+    }
+    // Returns scope id for cmdEndGpuScope()
+    uint32_t cmdBeginGpuScope(VkCommandBuffer command_buffer,
+                              const char* name) {
+        FrameSlot& slot{slots_[currentSlot_]};
+        if (queryPool_ == VK_NULL_HANDLE ||
+            slot.scopes.size() == kMaxGpuScopesPerFrame) {
+            return kInvalidScope;
+        }
+
+        auto scope{static_cast<uint32_t>(slot.scopes.size())};
+        slot.scopes.push_back(name);
+        slot.frame = frame_;
+        vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                            queryPool_, firstQuery() + scope * 2);
+
+        return scope;
+    }
+    void cmdEndGpuScope(VkCommandBuffer command_buffer, uint32_t scope) {
+        if (scope == kInvalidScope) {
+            return;
+        }
+        vkCmdWriteTimestamp(command_buffer,
+                            VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool_,
+                            firstQuery() + scope * 2 + 1);
+    }
+
+    // Events lost because exporter could not keep up
+    uint64_t droppedEvents() const {
+        return dropped_.load(std::memory_order_relaxed);
+    }
+
+   private:
+    static constexpr uint32_t kInvalidScope{~0U};
+    static constexpr size_t kRingCapacity{1U << 14U};
+
+    struct FrameSlot {
+        // Names of GPU scopes recorded in the last frame of this slot
+        std::vector<const char*> scopes{};
+        uint64_t frame{};
+        double submitUs{};
+    };
+
+    uint32_t firstQuery() const {
+        return currentSlot_ * kMaxGpuScopesPerFrame * 2;
+    }
+
+    // GPU and CPU clocks are not calibrated against each other. First GPU
+    // timestamp of a frame is aligned with its submit time
+    void collectGpuResults(FrameSlot& slot) {
+        if (slot.scopes.empty()) {
+            return;
+        }
+
+        std::vector<uint64_t> timestamps(slot.scopes.size() * 2);
+        VkResult result{vkGetQueryPoolResults(
+            device_, queryPool_, firstQuery(),
+            static_cast<uint32_t>(timestamps.size()),
+            timestamps.size() * sizeof(uint64_t), timestamps.data(),
+            sizeof(uint64_t), VK_QUERY_RESULT_64_BIT)};
+
+        if (result == VK_SUCCESS) {
+            uint64_t origin{timestamps[0] & timestampMask_};
+            for (size_t i{}; i < slot.scopes.size(); ++i) {
+                uint64_t begin{timestamps[i * 2] & timestampMask_};
+                uint64_t end{timestamps[i * 2 + 1] & timestampMask_};
+
+                push({slot.scopes[i], slot.frame,
+                      slot.submitUs + ticksToUs(begin - origin),
+                      ticksToUs(end - begin), true});
+            }
+        }
+
+        slot.scopes.clear();
+    }
+    double ticksToUs(uint64_t ticks) const {
+        return static_cast<double>(ticks) *
+               static_cast<double>(timestampPeriod_) / 1000.0;
+    }
+
+    void push(const ProfileEvent& event) {
+        if (!ring_.push(event)) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    void exportLoop(const std::stop_token& stop) {
+        while (true) {
+            // Read stop flag first, so events pushed before stop are written
+            bool stopping{stop.stop_requested()};
+            while (auto event{ring_.pop()}) {
+                write(*event);
+            }
+            if (stopping) {
+                return;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds{5});
+        }
+    }
+    void write(const ProfileEvent& event) {
+        if (csv_) {
+            output_ << (event.gpu ? "gpu," : "cpu,") << event.name << ','
+                    << event.frame << ',' << event.startUs << ','
+                    << event.durationUs << '\n';
+            return;
+        }
+
+        output_ << ",\n{\"name\":\"" << event.name << "\",\"cat\":\""
+                << (event.gpu ? "gpu" : "cpu") << R"(","ph":"X","ts":)"
+                << event.startUs << ",\"dur\":" << event.durationUs
+                << ",\"pid\":0,\"tid\":" << (event.gpu ? 1 : 0)
+                << ",\"args\":{\"frame\":" << event.frame << "}}";
+    }
+
+    VkDevice device_;
+    std::ofstream output_;
+    bool csv_;
+    std::chrono::steady_clock::time_point epoch_{
+        std::chrono::steady_clock::now()};
+
+    VkQueryPool queryPool_{VK_NULL_HANDLE};
+    float timestampPeriod_{};
+    uint64_t timestampMask_{};
+    std::vector<FrameSlot> slots_;
+    uint32_t currentSlot_{};
+    uint64_t frame_{};
+
+    SpscRing<ProfileEvent, kRingCapacity> ring_{};
+    std::atomic<uint64_t> dropped_{};
+    // Declared last, so it is started after everything it uses
+    std::jthread exporter_{};
+};
+
+// Times enclosing scope on CPU. Does nothing without profiler
+class CpuScope {
+   public:
+    CpuScope(FrameProfiler* profiler, const char* name)
+        : profiler_{profiler},
+          name_{name},
+          startUs_{profiler != nullptr ? profiler->nowUs() : 0.0} {}
+    ~CpuScope() {
+        if (profiler_ != nullptr) {
+            profiler_->addCpuEvent(name_, startUs_, profiler_->nowUs());
+        }
+    }
+
+    CpuScope(const CpuScope&) = delete;
+    CpuScope& operator=(const CpuScope&) = delete;
+    CpuScope(CpuScope&&) = delete;
+    CpuScope& operator=(CpuScope&&) = delete;
+
+   private:
+    FrameProfiler* profiler_;
+    const char* name_;
+    double startUs_;
+};
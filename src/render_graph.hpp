@@ -0,0 +1,623 @@
+#pragma once
+
+#include <vulkan/vulkan_core.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "device_memory_allocator.hpp"
+
+// Frame described as passes which declare how they read and write resources.
+// compile() then
+// - culls passes whose results are never used,
+// - plans pipeline barriers, batched into a single vkCmdPipelineBarrier in
+//   front of each pass, and skips them where previous barriers already made
+//   writes visible,
+// - creates transient images and lets those whose lifetimes do not overlap
+//   share memory. Images with VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT prefer
+//   lazily allocated memory, which tile based GPUs may never back at all if
+//   the image never leaves a render pass.
+//
+// Imported images have one VkImage per image index, e.g. per swap chain
+// image, and execute() picks them by image index. Imported buffers are bound
+// with bindBuffer() before every execute().
+//
+// Graph is static once compiled. Anything which changes resource sizes, like
+// swap chain recreation, builds a new graph
+class RenderGraph {
+   public:
+    using ResourceId = uint32_t;
+    using PassId = uint32_t;
+    using PassCallback = std::function<void(VkCommandBuffer command_buffer,
+                                            uint32_t image_index)>;
+
+    // Pipeline stages, access types and, for images, layout of a use
+    struct Access {
+        VkPipelineStageFlags stages{};
+        VkAccessFlags access{};
+        VkImageLayout layout{VK_IMAGE_LAYOUT_UNDEFINED};
+    };
+
+    struct ImageDesc {
+        VkFormat format{VK_FORMAT_UNDEFINED};
+        VkExtent2D extent{};
+        VkImageUsageFlags usage{};
+        VkSampleCountFlagBits samples{VK_SAMPLE_COUNT_1_BIT};
+        VkImageAspectFlags aspect{VK_IMAGE_ASPECT_COLOR_BIT};
+    };
+
+    RenderGraph(VkDevice device, DeviceMemoryAllocator& allocator)
+        : device_{device}, allocator_{allocator} {}
+    ~RenderGraph() {
+        for (const auto& resource : resources_) {
+            vkDestroyImage(device_, resource.transientImage, nullptr);
+        }
+        for (const auto& slot : aliasSlots_) {
+            allocator_.free(slot.allocation);
+        }
+    }
+
+    RenderGraph(const RenderGraph&) = delete;
+    RenderGraph& operator=(const RenderGraph&) = delete;
+    RenderGraph(RenderGraph&&) = delete;
+    RenderGraph& operator=(RenderGraph&&) = delete;
+
+    // Image owned by the caller. `initial` is its state when the graph
+    // starts, e.g. the wait stage of an acquire semaphore. Image is left in
+    // `final` state, so it counts as graph output
+    ResourceId importImage(const char* name, std::vector<VkImage> images,
+                           VkImageAspectFlags aspect, const Access& initial,
+                           const Access& final) {
+        Resource resource{};
+        resource.name = name;
+        resource.kind = ResourceKind::kImportedImage;
+        resource.images = std::move(images);
+        resource.desc.aspect = aspect;
+        resource.initial = initial;
+        resource.final = final;
+        return addResource(std::move(resource));
+    }
+    // Buffer owned by the caller. Its first use in the graph is not
+    // synchronized with anything before the graph
+    ResourceId importBuffer(const char* name) {
+        Resource resource{};
+        resource.name = name;
+        resource.kind = ResourceKind::kImportedBuffer;
+        return addResource(std::move(resource));
+    }
+    // Image created by compile(). Its contents do not survive the frame
+    ResourceId createImage(const char* name, const ImageDesc& desc) {
+        Resource resource{};
+        resource.name = name;
+        resource.kind = ResourceKind::kTransientImage;
+        resource.desc = desc;
+        return addResource(std::move(resource));
+    }
+
+    void bindBuffer(ResourceId id, VkBuffer buffer) {
+        resources_.at(id).buffer = buffer;
+    }
+    // Transient image. VK_NULL_HANDLE before compile() or if it was culled
+    VkImage image(ResourceId id) const {
+        return resources_.at(id).transientImage;
+    }
+
+    // Passes run in the order they were added
+    PassId addPass(const char* name, PassCallback callback) {
+        if (compiled_) {
+            throw std::runtime_error{"Render graph is already compiled!"};
+        }
+        Pass pass{};
+        pass.name = name;
+        pass.callback = std::move(callback);
+        passes_.push_back(std::move(pass));
+        return static_cast<PassId>(passes_.size() - 1);
+    }
+    void read(PassId pass, ResourceId resource, const Access& access) {
+        addUse(pass, resource, access, false);
+    }
+    // Writes without a read of the same resource discard previous contents
+    void write(PassId pass, ResourceId resource, const Access& access) {
+        addUse(pass, resource, access, true);
+    }
+
+    void compile() {
+        if (compiled_) {
+            throw std::runtime_error{"Render graph is already compiled!"};
+        }
+        compiled_ = true;
+
+        cullPasses();
+        computeLifetimes();
+        allocateTransientImages();
+        planBarriers();
+    }
+
+    void execute(VkCommandBuffer command_buffer, uint32_t image_index) const {
+        for (const auto& pass : passes_) {
+            if (!pass.live) {
+                continue;
+            }
+            recordBarriers(command_buffer, pass.barriers, image_index);
+            pass.callback(command_buffer, image_index);
+        }
+        recordBarriers(command_buffer, finalBarriers_, image_index);
+    }
+
+    void printStatistics(std::ostream& out) const {
+        auto live_passes{std::ranges::count_if(
+            passes_, [](const Pass& pass) { return pass.live; })};
+        size_t batches{finalBarriers_.empty() ? 0U : 1U};
+        size_t barriers{finalBarriers_.images.size() +
+                        finalBarriers_.buffers.size()};
+        for (const auto& pass : passes_) {
+            batches += pass.barriers.empty() ? 0U : 1U;
+            barriers += pass.barriers.images.size() +
+                        pass.barriers.buffers.size();
+        }
+
+        VkDeviceSize aliased_bytes{};
+        for (const auto& slot : aliasSlots_) {
+            aliased_bytes += slot.requirements.size;
+        }
+
+        out << "Render graph: " << live_passes << " of " << passes_.size()
+            << " passes live, " << barriers << " barriers in " << batches
+            << " batches, transient images use " << aliased_bytes << " of "
+            << transientBytes_ << " bytes\n";
+    }
+
+   private:
+    enum class ResourceKind {
+        kImportedImage,
+        kImportedBuffer,
+        kTransientImage,
+    };
+
+    struct Resource {
+        const char* name{};
+        ResourceKind kind{};
+        std::vector<VkImage> images{};
+        VkBuffer buffer{VK_NULL_HANDLE};
+        ImageDesc desc{};
+        Access initial{};
+        Access final{};
+
+        VkImage transientImage{VK_NULL_HANDLE};
+        VkMemoryRequirements requirements{};
+        // Live passes using the resource, first and last
+        PassId firstPass{};
+        PassId lastPass{};
+        bool used{};
+        // Union of all uses, for the next occupant of the same memory
+        VkPipelineStageFlags allStages{};
+        VkAccessFlags allWrites{};
+        // Transient image which used the same memory before this one. Itself
+        // if it has the memory alone
+        ResourceId aliasPredecessor{};
+
+        bool isImage() const { return kind != ResourceKind::kImportedBuffer; }
+    };
+
+    // All uses of a resource by one pass, merged
+    struct Use {
+        ResourceId resource{};
+        Access access{};
+        bool reads{};
+        bool writes{};
+    };
+
+    struct ImageBarrier {
+        ResourceId resource{};
+        VkAccessFlags srcAccess{};
+        VkAccessFlags dstAccess{};
+        VkImageLayout oldLayout{};
+        VkImageLayout newLayout{};
+    };
+    struct BufferBarrier {
+        ResourceId resource{};
+        VkAccessFlags srcAccess{};
+        VkAccessFlags dstAccess{};
+    };
+    struct BarrierBatch {
+        VkPipelineStageFlags srcStages{};
+        VkPipelineStageFlags dstStages{};
+        std::vector<ImageBarrier> images{};
+        std::vector<BufferBarrier> buffers{};
+
+        bool empty() const { return images.empty() && buffers.empty(); }
+    };
+
+    struct Pass {
+        const char* name{};
+        PassCallback callback{};
+        std::vector<Use> uses{};
+        bool live{};
+        BarrierBatch barriers{};
+    };
+
+    // Last known state of a resource while barriers are planned
+    struct State {
+        VkImageLayout layout{VK_IMAGE_LAYOUT_UNDEFINED};
+        // Last write, or layout transition, which later uses must wait for
+        VkPipelineStageFlags writeStages{};
+        VkAccessFlags writeAccess{};
+        // Reads since the last write. A write must wait for them
+        VkPipelineStageFlags readStages{};
+        // Stages and accesses the last write is already visible to
+        VkPipelineStageFlags visibleStages{};
+        VkAccessFlags visibleAccess{};
+    };
+
+    // Memory shared by transient images with disjoint lifetimes
+    struct AliasSlot {
+        VkMemoryRequirements requirements{};
+        // Only transient attachments may share lazily allocated memory
+        bool lazy{};
+        // Ordered by first pass
+        std::vector<ResourceId> resources{};
+        DeviceMemoryAllocator::Allocation allocation{};
+    };
+
+    static constexpr VkAccessFlags kWriteAccess{
+        VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+        VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT |
+        VK_ACCESS_MEMORY_WRITE_BIT};
+
+    ResourceId addResource(Resource resource) {
+        if (compiled_) {
+            throw std::runtime_error{"Render graph is already compiled!"};
+        }
+        resources_.push_back(std::move(resource));
+        return static_cast<ResourceId>(resources_.size() - 1);
+    }
+
+    void addUse(PassId pass_id, ResourceId resource, const Access& access,
+                bool write) {
+        if (compiled_) {
+            throw std::runtime_error{"Render graph is already compiled!"};
+        }
+        if (resource >= resources_.size()) {
+            throw std::runtime_error{"Unknown render graph resource!"};
+        }
+
+        Pass& pass{passes_.at(pass_id)};
+        auto use{std::ranges::find(pass.uses, resource, &Use::resource)};
+        if (use == pass.uses.end()) {
+            pass.uses.push_back({resource, access, !write, write});
+            return;
+        }
+
+        if (resources_[resource].isImage() &&
+            use->access.layout != access.layout) {
+            throw std::runtime_error{
+                "Pass uses an image in two layouts at once!"};
+        }
+        use->access.stages |= access.stages;
+        use->access.access |= access.access;
+        (write ? use->writes : use->reads) = true;
+    }
+
+    // Walk passes backwards from graph outputs. A live pass needs what it
+    // reads, while what it only writes is not needed from earlier passes
+    void cullPasses() {
+        std::vector<bool> needed(resources_.size());
+        for (ResourceId id{}; id < resources_.size(); ++id) {
+            needed[id] = resources_[id].kind == ResourceKind::kImportedImage;
+        }
+
+        for (auto pass{passes_.rbegin()}; pass != passes_.rend(); ++pass) {
+            pass->live = std::ranges::any_of(pass->uses, [&](const Use& use) {
+                return use.writes && needed[use.resource];
+            });
+            if (!pass->live) {
+                continue;
+            }
+
+            for (const auto& use : pass->uses) {
+                if (use.writes && !use.reads) {
+                    needed[use.resource] = false;
+                }
+            }
+            for (const auto& use : pass->uses) {
+                if (use.reads) {
+                    needed[use.resource] = true;
+                }
+            }
+        }
+    }
+
+    void computeLifetimes() {
+        for (PassId pass_id{}; pass_id < passes_.size(); ++pass_id) {
+            if (!passes_[pass_id].live) {
+                continue;
+            }
+            for (const auto& use : passes_[pass_id].uses) {
+                Resource& resource{resources_[use.resource]};
+                if (!resource.used) {
+                    resource.used = true;
+                    resource.firstPass = pass_id;
+                }
+                resource.lastPass = pass_id;
+                resource.allStages |= use.access.stages;
+                resource.allWrites |= use.access.access & kWriteAccess;
+            }
+        }
+    }
+
+    // Largest images pick memory first, later ones join the first slot
+    // whose images all live in other passes
+    void allocateTransientImages() {
+        std::vector<ResourceId> transients{};
+        for (ResourceId id{}; id < resources_.size(); ++id) {
+            Resource& resource{resources_[id]};
+            if (resource.kind != ResourceKind::kTransientImage ||
+                !resource.used) {
+                continue;
+            }
+
+            createTransientImage(resource);
+            transientBytes_ += resource.requirements.size;
+            transients.push_back(id);
+        }
+
+        std::ranges::stable_sort(transients, [this](ResourceId a,
+                                                    ResourceId b) {
+            return resources_[a].requirements.size >
+                   resources_[b].requirements.size;
+        });
+
+        for (ResourceId id : transients) {
+            const Resource& resource{resources_[id]};
+            bool lazy{(resource.desc.usage &
+                       VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT) != 0};
+            auto overlaps{[&](ResourceId other_id) {
+                const Resource& other{resources_[other_id]};
+                return resource.firstPass <= other.lastPass &&
+                       other.firstPass <= resource.lastPass;
+            }};
+
+            auto fits{[&](const AliasSlot& slot) {
+                return slot.lazy == lazy &&
+                       (slot.requirements.memoryTypeBits &
+                        resource.requirements.memoryTypeBits) != 0 &&
+                       std::ranges::none_of(slot.resources, overlaps);
+            }};
+
+            auto slot{std::ranges::find_if(aliasSlots_, fits)};
+            if (slot == aliasSlots_.end()) {
+                aliasSlots_.push_back({resource.requirements, lazy, {}, {}});
+                slot = std::prev(aliasSlots_.end());
+            }
+
+            VkMemoryRequirements& requirements{slot->requirements};
+            requirements.size =
+                std::max(requirements.size, resource.requirements.size);
+            requirements.alignment = std::max(
+                requirements.alignment, resource.requirements.alignment);
+            requirements.memoryTypeBits &= resource.requirements.memoryTypeBits;
+            slot->resources.push_back(id);
+        }
+
+        for (auto& slot : aliasSlots_) {
+            slot.allocation = allocator_.allocate(
+                slot.requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                slot.lazy ? VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT : 0,
+                DeviceMemoryAllocator::ResourceKind::kOptimal);
+
+            std::ranges::sort(slot.resources, {}, [this](ResourceId id) {
+                return resources_[id].firstPass;
+            });
+            // First image of a frame follows the last one of previous frame
+            for (size_t i{}; i < slot.resources.size(); ++i) {
+                Resource& resource{resources_[slot.resources[i]]};
+                resource.aliasPredecessor =
+                    slot.resources[(i + slot.resources.size() - 1) %
+                                   slot.resources.size()];
+
+                if (vkBindImageMemory(device_, resource.transientImage,
+                                      slot.allocation.memory,
+                                      slot.allocation.offset) != VK_SUCCESS) {
+                    throw std::runtime_error{"Failed to bind image memory!"};
+                }
+            }
+        }
+    }
+    void createTransientImage(Resource& resource) {
+        VkImageCreateInfo image_info{};
+        image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        image_info.imageType = VK_IMAGE_TYPE_2D;
+        image_info.format = resource.desc.format;
+        image_info.extent = {resource.desc.extent.width,
+                             resource.desc.extent.height, 1};
+        image_info.mipLevels = 1;
+        image_info.arrayLayers = 1;
+        image_info.samples = resource.desc.samples;
+        image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+        image_info.usage = resource.desc.usage;
+        image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        if (vkCreateImage(device_, &image_info, nullptr,
+                          &resource.transientImage) != VK_SUCCESS) {
+            throw std::runtime_error{"Failed to create transient image!"};
+        }
+        vkGetImageMemoryRequirements(device_, resource.transientImage,
+                                     &resource.requirements);
+    }
+
+    void planBarriers() {
+        std::vector<State> states(resources_.size());
+        for (ResourceId id{}; id < resources_.size(); ++id) {
+            const Resource& resource{resources_[id]};
+            State& state{states[id]};
+
+            if (resource.kind == ResourceKind::kImportedImage) {
+                state.layout = resource.initial.layout;
+                state.writeStages = resource.initial.stages;
+                state.writeAccess = resource.initial.access;
+            } else if (resource.kind == ResourceKind::kTransientImage &&
+                       resource.used) {
+                // Memory was last used by the previous image in its slot
+                const Resource& predecessor{
+                    resources_[resource.aliasPredecessor]};
+                state.writeStages = predecessor.allStages;
+                state.writeAccess = predecessor.allWrites;
+            }
+        }
+
+        for (auto& pass : passes_) {
+            if (!pass.live) {
+                continue;
+            }
+            for (const auto& use : pass.uses) {
+                transition(pass.barriers, use, states[use.resource]);
+            }
+        }
+
+        for (ResourceId id{}; id < resources_.size(); ++id) {
+            const Resource& resource{resources_[id]};
+            if (resource.kind != ResourceKind::kImportedImage) {
+                continue;
+            }
+            Use use{id, resource.final, true, false};
+            transition(finalBarriers_, use, states[id]);
+        }
+    }
+    // Add barrier needed before `use`, if any, and advance state past it
+    void transition(BarrierBatch& batch, const Use& use, State& state) const {
+        const Resource& resource{resources_[use.resource]};
+        const Access& access{use.access};
+
+        bool layout_change{resource.isImage() &&
+                           access.layout != state.layout};
+        bool covered{(access.stages & ~state.visibleStages) == 0 &&
+                     (access.access & ~state.visibleAccess) == 0};
+
+        VkPipelineStageFlags src_stages{};
+        if (layout_change || use.writes) {
+            // Write after write and write after read
+            src_stages = state.writeStages | state.readStages;
+        } else if (!covered) {
+            // Read after write
+            src_stages = state.writeStages;
+        }
+
+        if (layout_change || src_stages != 0) {
+            batch.srcStages |=
+                src_stages != 0
+                    ? src_stages
+                    : VkPipelineStageFlags{VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT};
+            batch.dstStages |= access.stages;
+
+            if (resource.isImage()) {
+                batch.images.push_back(
+                    {use.resource, state.writeAccess, access.access,
+                     // Contents which are not read may be discarded
+                     use.reads ? state.layout : VK_IMAGE_LAYOUT_UNDEFINED,
+                     access.layout});
+            } else {
+                batch.buffers.push_back(
+                    {use.resource, state.writeAccess, access.access});
+            }
+        }
+
+        if (use.writes || layout_change) {
+            // Layout transition is a write later uses must wait for
+            state.writeStages = access.stages;
+            state.writeAccess =
+                use.writes ? access.access & kWriteAccess : VkAccessFlags{};
+            state.readStages = use.writes ? 0 : access.stages;
+            state.visibleStages = use.writes ? 0 : access.stages;
+            state.visibleAccess = use.writes ? 0 : access.access;
+        } else {
+            state.readStages |= access.stages;
+            if (src_stages != 0) {
+                state.visibleStages |= access.stages;
+                state.visibleAccess |= access.access;
+            }
+        }
+        state.layout = access.layout;
+    }
+
+    void recordBarriers(VkCommandBuffer command_buffer,
+                        const BarrierBatch& batch,
+                        uint32_t image_index) const {
+        if (batch.empty()) {
+            return;
+        }
+
+        std::vector<VkImageMemoryBarrier> image_barriers{};
+        image_barriers.reserve(batch.images.size());
+        for (const auto& barrier : batch.images) {
+            const Resource& resource{resources_[barrier.resource]};
+
+            VkImageMemoryBarrier image_barrier{};
+            image_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            image_barrier.srcAccessMask = barrier.srcAccess;
+            image_barrier.dstAccessMask = barrier.dstAccess;
+            image_barrier.oldLayout = barrier.oldLayout;
+            image_barrier.newLayout = barrier.newLayout;
+            image_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            image_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            image_barrier.image = resource.kind == ResourceKind::kImportedImage
+                                      ? resource.images.at(image_index)
+                                      : resource.transientImage;
+            image_barrier.subresourceRange.aspectMask = resource.desc.aspect;
+            image_barrier.subresourceRange.levelCount =
+                VK_REMAINING_MIP_LEVELS;
+            image_barrier.subresourceRange.layerCount =
+                VK_REMAINING_ARRAY_LAYERS;
+            image_barriers.push_back(image_barrier);
+        }
+
+        std::vector<VkBufferMemoryBarrier> buffer_barriers{};
+        buffer_barriers.reserve(batch.buffers.size());
+        for (const auto& barrier : batch.buffers) {
+            const Resource& resource{resources_[barrier.resource]};
+            if (resource.buffer == VK_NULL_HANDLE) {
+                throw std::runtime_error{
+                    std::string{"Render graph buffer is not bound: "} +
+                    resource.name};
+            }
+
+            VkBufferMemoryBarrier buffer_barrier{};
+            buffer_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+            buffer_barrier.srcAccessMask = barrier.srcAccess;
+            buffer_barrier.dstAccessMask = barrier.dstAccess;
+            buffer_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            buffer_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            buffer_barrier.buffer = resource.buffer;
+            buffer_barrier.offset = 0;
+            buffer_barrier.size = VK_WHOLE_SIZE;
+            buffer_barriers.push_back(buffer_barrier);
+        }
+
+        vkCmdPipelineBarrier(command_buffer, batch.srcStages, batch.dstStages,
+                             0, 0, nullptr,
+                             static_cast<uint32_t>(buffer_barriers.size()),
+                             buffer_barriers.data(),
+                             static_cast<uint32_t>(image_barriers.size()),
+                             image_barriers.data());
+    }
+
+    VkDevice device_;
+    DeviceMemoryAllocator& allocator_;
+
+    std::vector<Resource> resources_{};
+    std::vector<Pass> passes_{};
+    bool compiled_{};
+
+    // Transitions of imported images into their final state
+    BarrierBatch finalBarriers_{};
+    std::vector<AliasSlot> aliasSlots_{};
+    // Memory transient images would take without aliasing
+    VkDeviceSize transientBytes_{};
+};
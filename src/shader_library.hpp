@@ -0,0 +1,140 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "asset_pack.hpp"
+#include "mapped_file.hpp"
+
+// Every shader the app uses
+enum class ShaderId : uint8_t {
+    kTriangleVert,
+    kTriangleFrag,
+    kCull,
+    // Quantized mesh vertices instead of the built in triangle
+    kMeshVert,
+    // kTriangleFrag without textures, needs no bindless heap
+    kColorFrag,
+    kCount,
+};
+
+inline constexpr size_t kShaderCount{static_cast<size_t>(ShaderId::kCount)};
+
+// Names of compiled shaders in a shader directory, see shaders/compile.sh,
+// and in an asset pack
+inline constexpr std::array<const char*, kShaderCount> kShaderFileNames{
+    "vert.spv",
+    "frag.spv",
+    "cull.spv",
+    "mesh.spv",
+    "color.spv",
+};
+
+#ifdef EMBED_SHADERS
+// SPIR-V compiled by the build, see CMakeLists.txt
+namespace embedded_shaders {
+alignas(16) inline constexpr uint32_t kTriangleVert[]{
+#include "shaders/shader.vert.inc"
+};
+alignas(16) inline constexpr uint32_t kTriangleFrag[]{
+#include "shaders/shader.frag.inc"
+};
+alignas(16) inline constexpr uint32_t kCull[]{
+#include "shaders/cull.comp.inc"
+};
+alignas(16) inline constexpr uint32_t kMeshVert[]{
+#include "shaders/mesh.vert.inc"
+};
+alignas(16) inline constexpr uint32_t kColorFrag[]{
+#include "shaders/color.frag.inc"
+};
+}  // namespace embedded_shaders
+
+inline constexpr std::array<std::span<const uint32_t>, kShaderCount>
+    kEmbeddedShaders{
+        embedded_shaders::kTriangleVert,
+        embedded_shaders::kTriangleFrag,
+        embedded_shaders::kCull,
+        embedded_shaders::kMeshVert,
+        embedded_shaders::kColorFrag,
+    };
+#endif
+
+// Hands out SPIR-V of shaders. An asset pack takes precedence over a shader
+// directory, whose files are memory mapped on first use. Embedded shaders
+// are used when neither is given. Mappings stay alive as long as the
+// library and the pack, so returned code may be kept until then
+class ShaderLibrary {
+   public:
+    // Empty directory selects embedded shaders. Builds without them fall
+    // back to kDefaultDirectory. Pack may be nullptr. Shaders of a pack are
+    // prefetched, so their pages are read while other init steps run
+    ShaderLibrary(std::string directory, const AssetPack* pack)
+        : directory_{std::move(directory)}, pack_{pack} {
+        if (pack_ != nullptr) {
+            for (const char* name : kShaderFileNames) {
+                // Missing ones only fail once they are used
+                if (auto asset{pack_->find(name)}) {
+                    pack_->prefetch(*asset);
+                }
+            }
+        }
+#ifndef EMBED_SHADERS
+        if (directory_.empty()) {
+            directory_ = kDefaultDirectory;
+        }
+#endif
+    }
+
+    ShaderLibrary(const ShaderLibrary&) = delete;
+    ShaderLibrary& operator=(const ShaderLibrary&) = delete;
+    ShaderLibrary(ShaderLibrary&&) = delete;
+    ShaderLibrary& operator=(ShaderLibrary&&) = delete;
+
+    std::span<const uint32_t> code(ShaderId id) {
+        auto index{static_cast<size_t>(id)};
+
+        // Blobs are aligned and the mapping is page aligned, so words can be
+        // read in place
+        if (pack_ != nullptr) {
+            AssetPack::Asset asset{pack_->get(kShaderFileNames[index])};
+            if (asset.type != asset_pack::AssetType::kSpirv) {
+                throw std::runtime_error{std::string{"Asset is not SPIR-V: "} +
+                                         kShaderFileNames[index]};
+            }
+            return {reinterpret_cast<const uint32_t*>(asset.data.data()),
+                    asset.data.size() / sizeof(uint32_t)};
+        }
+
+#ifdef EMBED_SHADERS
+        if (directory_.empty()) {
+            return kEmbeddedShaders[index];
+        }
+#endif
+
+        auto& file{files_[index]};
+        if (!file) {
+            std::string path{directory_ + '/' + kShaderFileNames[index]};
+            file = std::make_unique<MappedFile>(path);
+            if (file->size() == 0 || file->size() % sizeof(uint32_t) != 0) {
+                throw std::runtime_error{"Invalid SPIR-V file: " + path};
+            }
+        }
+
+        return {static_cast<const uint32_t*>(file->data()),
+                file->size() / sizeof(uint32_t)};
+    }
+
+   private:
+    static constexpr const char* kDefaultDirectory{"shaders"};
+
+    std::string directory_;
+    const AssetPack* pack_;
+    std::array<std::unique_ptr<MappedFile>, kShaderCount> files_{};
+};
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+// Nearest rank percentile of sorted values, p in [0, 100]. Values must not
+// be empty. Shared by the app log and the benchmark, so both report the
+// same sample
+inline double percentile(const std::vector<double>& sorted, double p) {
+    auto rank{static_cast<size_t>(
+        std::ceil(p / 100.0 * static_cast<double>(sorted.size())))};
+    return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+}
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// One shot graph of tasks with dependencies. A task starts as soon as all of
+// its dependencies are done, so independent tasks overlap on worker threads.
+// Dependencies must be added before their dependents, which rules out
+// cycles and makes insertion order a valid sequential order.
+//
+// Start and duration of every task are recorded for reporting.
+class TaskGraph {
+   public:
+    using TaskId = uint32_t;
+
+    struct Timing {
+        // Must be a string literal
+        const char* name{};
+        // Milliseconds since run() started
+        double startMs{};
+        double durationMs{};
+        // 0 is the thread which called run()
+        uint32_t thread{};
+    };
+
+    TaskId add(const char* name, std::function<void()> work,
+               const std::vector<TaskId>& dependencies = {}) {
+        auto id{static_cast<TaskId>(tasks_.size())};
+        for (TaskId dependency : dependencies) {
+            if (dependency >= id) {
+                throw std::runtime_error{
+                    "Task dependency must be added before its dependent!"};
+            }
+            tasks_[dependency].dependents.push_back(id);
+        }
+
+        Task task{};
+        task.name = name;
+        task.work = std::move(work);
+        task.dependencyCount = static_cast<uint32_t>(dependencies.size());
+        tasks_.push_back(std::move(task));
+
+        return id;
+    }
+
+    // Run every task on calling thread and thread_count - 1 helper threads.
+    // thread_count <= 1 runs tasks one by one in insertion order.
+    // First exception thrown by a task is rethrown once running tasks finish,
+    // tasks not started by then never run
+    void run(uint32_t thread_count) {
+        start_ = std::chrono::steady_clock::now();
+        timings_.clear();
+        timings_.reserve(tasks_.size());
+
+        if (thread_count <= 1) {
+            for (auto& task : tasks_) {
+                execute(task, 0);
+            }
+            return;
+        }
+
+        remaining_ = tasks_.size();
+        for (TaskId id{}; id < tasks_.size(); ++id) {
+            tasks_[id].pendingDependencies = tasks_[id].dependencyCount;
+            if (tasks_[id].dependencyCount == 0) {
+                ready_.push_back(id);
+            }
+        }
+
+        {
+            std::vector<std::jthread> helpers{};
+            helpers.reserve(thread_count - 1);
+            for (uint32_t i{1}; i < thread_count; ++i) {
+                helpers.emplace_back([this, i] { workerLoop(i); });
+            }
+            workerLoop(0);
+        }
+
+        std::sort(timings_.begin(), timings_.end(),
+                  [](const Timing& a, const Timing& b) {
+                      return a.startMs < b.startMs;
+                  });
+        if (error_) {
+            std::rethrow_exception(error_);
+        }
+    }
+
+    // Timings of tasks which ran in the last run(), ordered by start
+    const std::vector<Timing>& timings() const { return timings_; }
+
+   private:
+    struct Task {
+        const char* name{};
+        std::function<void()> work{};
+        std::vector<TaskId> dependents{};
+        uint32_t dependencyCount{};
+        uint32_t pendingDependencies{};
+    };
+
+    double sinceStartMs() const {
+        return std::chrono::duration<double, std::milli>(
+                   std::chrono::steady_clock::now() - start_)
+            .count();
+    }
+
+    void execute(Task& task, uint32_t thread) {
+        double start_ms{sinceStartMs()};
+        task.work();
+        timings_.push_back(
+            {task.name, start_ms, sinceStartMs() - start_ms, thread});
+    }
+
+    void workerLoop(uint32_t thread) {
+        std::unique_lock lock{mutex_};
+
+        while (true) {
+            taskReady_.wait(lock, [this] {
+                return !ready_.empty() || remaining_ == 0 || error_;
+            });
+            if (remaining_ == 0 || error_) {
+                return;
+            }
+
+            TaskId id{ready_.front()};
+            ready_.pop_front();
+            Task& task{tasks_[id]};
+
+            lock.unlock();
+            double start_ms{sinceStartMs()};
+            std::exception_ptr error{};
+            try {
+                task.work();
+            } catch (...) {
+                error = std::current_exception();
+            }
+            double end_ms{sinceStartMs()};
+            lock.lock();
+
+            timings_.push_back(
+                {task.name, start_ms, end_ms - start_ms, thread});
+            --remaining_;
+            if (error && !error_) {
+                error_ = error;
+            }
+            for (TaskId dependent : task.dependents) {
+                if (--tasks_[dependent].pendingDependencies == 0) {
+                    ready_.push_back(dependent);
+                }
+            }
+            taskReady_.notify_all();
+        }
+    }
+
+    std::vector<Task> tasks_{};
+    std::vector<Timing> timings_{};
+    std::chrono::steady_clock::time_point start_{};
+
+    std::mutex mutex_{};
+    std::condition_variable taskReady_{};
+    std::deque<TaskId> ready_{};
+    size_t remaining_{};
+    std::exception_ptr error_{};
+};
@@ -0,0 +1,626 @@
+#pragma once
+
+#include <vulkan/vulkan_core.h>
+
+#include <algorithm>
+#include <bit>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "bindless_heap.hpp"
+#include "device_memory_allocator.hpp"
+#include "upload_manager.hpp"
+
+// Streams mip chains of textures into bindless heap slots. Loader threads
+// decode mips, and update() uploads them through the upload manager. Every
+// texture first gets its mip tail (all mips up to Config::tailSize), then one
+// finer mip at a time. Textures used equally recently are upgraded
+// breadth-first, so all of them are sharp at a coarse level before any of
+// them gets its finest mips.
+//
+// Resident mips of a texture live in one image holding mips [residentMip,
+// mipLevels). Changing residency decodes and uploads the new mip range into
+// a new image, which takes a new heap slot. Old image and slot are destroyed
+// once frames which may sample them have completed. Mip range sizes shrink
+// geometrically, so the coarse mips uploaded again cost a third of the new
+// mip at most.
+//
+// Texel bytes of resident and retired images are kept under Config::budget.
+// When it is exceeded, finest mips of least recently used textures are
+// evicted. Mip tails are always loaded, even over budget.
+//
+// All methods must be called from one thread
+class TextureStreamer {
+   public:
+    using TextureId = uint32_t;
+
+    struct Desc {
+        uint32_t width{};
+        uint32_t height{};
+        // 0 means full mip chain
+        uint32_t mipLevels{};
+        // Formats decode can write, most preferred first
+        std::vector<VkFormat> formats{};
+        // Writes tightly packed texels of one mip in format. Called on loader
+        // threads, possibly several at once
+        std::function<void(VkFormat format, uint32_t mip_level,
+                           std::span<std::byte> texels)>
+            decode{};
+    };
+    // Block compression features enabled on the device. Formats of disabled
+    // features are never picked
+    struct Features {
+        bool textureCompressionBC{};
+        bool textureCompressionETC2{};
+    };
+    struct Config {
+        VkDeviceSize budget{256ULL * 1024 * 1024};
+        uint32_t loaderThreadCount{2};
+        // Mips no larger than this are loaded together as the first level
+        uint32_t tailSize{64};
+        // Texel bytes handed to the upload manager per update. A single
+        // larger mip range is still uploaded alone
+        VkDeviceSize maxUploadBytesPerUpdate{8ULL * 1024 * 1024};
+    };
+    struct Stats {
+        VkDeviceSize residentBytes{};
+        VkDeviceSize retiredBytes{};
+        uint32_t pendingLoads{};
+        uint64_t loadedMips{};
+        uint64_t evictedMips{};
+    };
+
+    TextureStreamer(VkDevice device, VkPhysicalDevice physical_device,
+                    DeviceMemoryAllocator& allocator, UploadManager& uploads,
+                    BindlessHeap& heap, const Features& features,
+                    const Config& config)
+        : device_{device},
+          physicalDevice_{physical_device},
+          allocator_{allocator},
+          uploads_{uploads},
+          heap_{heap},
+          features_{features},
+          config_{config} {
+        uint32_t thread_count{std::max(config_.loaderThreadCount, 1U)};
+        loaders_.reserve(thread_count);
+        for (uint32_t i{}; i < thread_count; ++i) {
+            loaders_.emplace_back(
+                [this](const std::stop_token& stop) { loaderLoop(stop); });
+        }
+    }
+    // GPU must be done with every texture
+    ~TextureStreamer() {
+        for (std::jthread& loader : loaders_) {
+            loader.request_stop();
+        }
+        jobReady_.notify_all();
+        loaders_.clear();
+
+        for (const auto& texture : textures_) {
+            destroyImage(texture->resident);
+        }
+        for (const Retired& retired : retired_) {
+            destroyImage(retired.image);
+        }
+    }
+
+    TextureStreamer(const TextureStreamer&) = delete;
+    TextureStreamer& operator=(const TextureStreamer&) = delete;
+    TextureStreamer(TextureStreamer&&) = delete;
+    TextureStreamer& operator=(TextureStreamer&&) = delete;
+
+    // Bytes of one mip, rounded up to whole blocks
+    static VkDeviceSize mipSize(VkFormat format, uint32_t width,
+                                uint32_t height) {
+        FormatBlock block{formatBlock(format)};
+        return static_cast<VkDeviceSize>((width + block.width - 1) /
+                                         block.width) *
+               ((height + block.height - 1) / block.height) * block.bytes;
+    }
+
+    // Texture has no slot until its mip tail is resident
+    TextureId add(Desc desc) {
+        if (desc.width == 0 || desc.height == 0 || !desc.decode) {
+            throw std::runtime_error{"Invalid texture description!"};
+        }
+
+        auto texture{std::make_unique<Texture>()};
+        texture->id = static_cast<TextureId>(textures_.size());
+        texture->format = pickFormat(desc.formats);
+        texture->mipLevels = fullMipLevels(desc.width, desc.height);
+        if (desc.mipLevels != 0) {
+            texture->mipLevels =
+                std::min(desc.mipLevels, texture->mipLevels);
+        }
+        texture->desc = std::move(desc);
+        texture->residentMip = texture->mipLevels;
+        texture->targetMip = texture->mipLevels;
+        texture->tailMip = texture->mipLevels - 1;
+        while (texture->tailMip > 0 &&
+               std::max(mipWidth(*texture, texture->tailMip - 1),
+                        mipHeight(*texture, texture->tailMip - 1)) <=
+                   config_.tailSize) {
+            --texture->tailMip;
+        }
+
+        textures_.push_back(std::move(texture));
+        return textures_.back()->id;
+    }
+
+    VkFormat format(TextureId id) const { return textures_.at(id)->format; }
+    // BindlessHeap::kInvalidSlot until first mips are resident
+    uint32_t slot(TextureId id) const { return textures_.at(id)->slot; }
+    // Finest resident mip, mip level count when nothing is resident
+    uint32_t residentMip(TextureId id) const {
+        return textures_.at(id)->residentMip;
+    }
+    // Textures used more recently keep their fine mips longer
+    void touch(TextureId id, uint64_t frame) {
+        Texture& texture{*textures_.at(id)};
+        texture.lastUsedFrame = std::max(texture.lastUsedFrame, frame);
+    }
+
+    Stats stats() const {
+        Stats stats{};
+        stats.retiredBytes = retiredBytes_;
+        for (const auto& texture : textures_) {
+            stats.residentBytes +=
+                rangeSize(*texture, texture->residentMip);
+            stats.pendingLoads += texture->loading ? 1U : 0U;
+        }
+        stats.loadedMips = loadedMips_;
+        stats.evictedMips = evictedMips_;
+        return stats;
+    }
+
+    // Applies decoded mips and schedules new loads and evictions. Must be
+    // called before the upload manager is flushed for the next frame, which
+    // then samples the new slots. Frames up to submitted_frame may still
+    // sample old slots, and frames up to completed_frame are done on GPU.
+    // Rethrows errors of loader threads
+    void update(uint64_t submitted_frame, uint64_t completed_frame) {
+        std::erase_if(retired_, [&](const Retired& retired) {
+            if (retired.lastUseFrame > completed_frame) {
+                return false;
+            }
+            destroyImage(retired.image);
+            retiredBytes_ -= retired.bytes;
+            return true;
+        });
+
+        applyLoadedMips(submitted_frame);
+        scheduleLoads();
+    }
+
+   private:
+    struct FormatBlock {
+        uint32_t width{1};
+        uint32_t height{1};
+        uint32_t bytes{};
+    };
+    struct Image {
+        VkImage image{VK_NULL_HANDLE};
+        VkImageView view{VK_NULL_HANDLE};
+        DeviceMemoryAllocator::Allocation memory{};
+    };
+    struct Texture {
+        TextureId id{};
+        Desc desc{};
+        VkFormat format{VK_FORMAT_UNDEFINED};
+        uint32_t mipLevels{};
+        // Coarsest mip which is loaded separately, finer mips are loaded one
+        // at a time
+        uint32_t tailMip{};
+        // Resident image holds mips [residentMip, mipLevels)
+        uint32_t residentMip{};
+        // residentMip once the pending load is applied
+        uint32_t targetMip{};
+        bool loading{};
+        Image resident{};
+        uint32_t slot{BindlessHeap::kInvalidSlot};
+        uint64_t lastUsedFrame{};
+    };
+    // Decoded mips [firstMip, mipLevels), tightly packed one after another
+    struct LoadResult {
+        TextureId id{};
+        uint32_t firstMip{};
+        std::vector<std::byte> texels{};
+        std::exception_ptr error{};
+    };
+    struct LoadJob {
+        const Texture* texture{};
+        uint32_t firstMip{};
+    };
+    struct Retired {
+        Image image{};
+        VkDeviceSize bytes{};
+        uint64_t lastUseFrame{};
+    };
+
+    static FormatBlock formatBlock(VkFormat format) {
+        switch (format) {
+            case VK_FORMAT_R8G8B8A8_UNORM:
+            case VK_FORMAT_R8G8B8A8_SRGB:
+            case VK_FORMAT_B8G8R8A8_UNORM:
+            case VK_FORMAT_B8G8R8A8_SRGB:
+                return {1, 1, 4};
+            case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+            case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+            case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+            case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+            case VK_FORMAT_BC4_UNORM_BLOCK:
+            case VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK:
+            case VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK:
+            case VK_FORMAT_ETC2_R8G8B8A1_UNORM_BLOCK:
+            case VK_FORMAT_ETC2_R8G8B8A1_SRGB_BLOCK:
+                return {4, 4, 8};
+            case VK_FORMAT_BC3_UNORM_BLOCK:
+            case VK_FORMAT_BC3_SRGB_BLOCK:
+            case VK_FORMAT_BC5_UNORM_BLOCK:
+            case VK_FORMAT_BC7_UNORM_BLOCK:
+            case VK_FORMAT_BC7_SRGB_BLOCK:
+            case VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK:
+            case VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK:
+                return {4, 4, 16};
+            default:
+                throw std::runtime_error{"Unsupported texture format!"};
+        }
+    }
+
+    static uint32_t fullMipLevels(uint32_t width, uint32_t height) {
+        return static_cast<uint32_t>(std::bit_width(std::max(width, height)));
+    }
+    static uint32_t mipWidth(const Texture& texture, uint32_t mip_level) {
+        return std::max(texture.desc.width >> mip_level, 1U);
+    }
+    static uint32_t mipHeight(const Texture& texture, uint32_t mip_level) {
+        return std::max(texture.desc.height >> mip_level, 1U);
+    }
+    // Bytes of mips [first_mip, mipLevels)
+    static VkDeviceSize rangeSize(const Texture& texture, uint32_t first_mip) {
+        VkDeviceSize size{};
+        for (uint32_t mip{first_mip}; mip < texture.mipLevels; ++mip) {
+            size += mipSize(texture.format, mipWidth(texture, mip),
+                            mipHeight(texture, mip));
+        }
+        return size;
+    }
+    // First mip of the range the next upgrade makes resident
+    static uint32_t nextFinerMip(const Texture& texture) {
+        return texture.targetMip == texture.mipLevels ? texture.tailMip
+                                                      : texture.targetMip - 1;
+    }
+
+    // Block compressed formats need their device feature, and every format
+    // must be sampleable with optimal tiling
+    VkFormat pickFormat(const std::vector<VkFormat>& formats) const {
+        for (VkFormat format : formats) {
+            bool bc{format >= VK_FORMAT_BC1_RGB_UNORM_BLOCK &&
+                    format <= VK_FORMAT_BC7_SRGB_BLOCK};
+            bool etc2{format >= VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK &&
+                      format <= VK_FORMAT_EAC_R11G11_SNORM_BLOCK};
+            if ((bc && !features_.textureCompressionBC) ||
+                (etc2 && !features_.textureCompressionETC2)) {
+                continue;
+            }
+
+            VkFormatProperties properties{};
+            vkGetPhysicalDeviceFormatProperties(physicalDevice_, format,
+                                                &properties);
+            if ((properties.optimalTilingFeatures &
+                 VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) != 0) {
+                // Throws for formats mipSize() can not handle
+                formatBlock(format);
+                return format;
+            }
+        }
+
+        throw std::runtime_error{"Failed to find a texture format!"};
+    }
+
+    void loaderLoop(const std::stop_token& stop) {
+        while (true) {
+            LoadJob job{};
+            {
+                std::unique_lock lock{mutex_};
+                jobReady_.wait(lock, stop, [this] { return !jobs_.empty(); });
+                if (stop.stop_requested()) {
+                    return;
+                }
+                job = jobs_.front();
+                jobs_.pop_front();
+            }
+
+            LoadResult result{decode(job)};
+            std::lock_guard lock{mutex_};
+            finished_.push_back(std::move(result));
+        }
+    }
+    // Textures are never removed and their description, format and mip
+    // count never change after add(), so loaders read them without locking
+    static LoadResult decode(const LoadJob& job) {
+        LoadResult result{job.texture->id, job.firstMip};
+        const Texture& texture{*job.texture};
+        try {
+            result.texels.resize(rangeSize(texture, job.firstMip));
+            VkDeviceSize offset{};
+            for (uint32_t mip{job.firstMip}; mip < texture.mipLevels; ++mip) {
+                VkDeviceSize size{mipSize(texture.format,
+                                          mipWidth(texture, mip),
+                                          mipHeight(texture, mip))};
+                texture.desc.decode(
+                    texture.format, mip,
+                    std::span{result.texels}.subspan(offset, size));
+                offset += size;
+            }
+        } catch (...) {
+            result.error = std::current_exception();
+        }
+        return result;
+    }
+
+    void applyLoadedMips(uint64_t submitted_frame) {
+        VkDeviceSize uploaded{};
+        while (true) {
+            LoadResult result{};
+            {
+                std::lock_guard lock{mutex_};
+                if (finished_.empty() ||
+                    (uploaded > 0 &&
+                     uploaded + finished_.front().texels.size() >
+                         config_.maxUploadBytesPerUpdate)) {
+                    return;
+                }
+                result = std::move(finished_.front());
+                finished_.pop_front();
+            }
+            if (result.error) {
+                std::rethrow_exception(result.error);
+            }
+
+            uploaded += result.texels.size();
+            swapResidentImage(*textures_[result.id], result, submitted_frame);
+        }
+    }
+    void swapResidentImage(Texture& texture, const LoadResult& result,
+                           uint64_t submitted_frame) {
+        Image image{createImage(texture, result.firstMip)};
+
+        uint32_t block_height{formatBlock(texture.format).height};
+        VkDeviceSize offset{};
+        for (uint32_t mip{result.firstMip}; mip < texture.mipLevels; ++mip) {
+            uint32_t width{mipWidth(texture, mip)};
+            uint32_t height{mipHeight(texture, mip)};
+            VkDeviceSize size{mipSize(texture.format, width, height)};
+
+            VkImageSubresourceLayers subresource{};
+            subresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            subresource.mipLevel = mip - result.firstMip;
+            subresource.baseArrayLayer = 0;
+            subresource.layerCount = 1;
+            uploads_.uploadImage(image.image, subresource, {width, height, 1},
+                                 result.texels.data() + offset, size,
+                                 VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                 VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                                 VK_ACCESS_SHADER_READ_BIT, block_height);
+            offset += size;
+        }
+
+        // Frames recorded so far may still sample the old image
+        if (texture.slot != BindlessHeap::kInvalidSlot) {
+            heap_.release(BindlessHeap::Kind::kTexture, texture.slot,
+                          submitted_frame);
+            retired_.push_back({texture.resident,
+                                rangeSize(texture, texture.residentMip),
+                                submitted_frame});
+            retiredBytes_ += retired_.back().bytes;
+        }
+
+        if (result.firstMip < texture.residentMip) {
+            loadedMips_ += texture.residentMip - result.firstMip;
+        } else {
+            evictedMips_ += result.firstMip - texture.residentMip;
+        }
+        texture.resident = image;
+        texture.residentMip = result.firstMip;
+        texture.loading = false;
+        texture.slot = heap_.addTexture(
+            image.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    }
+
+    // Mip tails first, then upgrades. An upgrade which does not
+    // fit the budget evicts a finer mip of a less recently used texture.
+    // Budget is checked twice: target is residency once pending loads are
+    // applied, committed also counts images still alive during swaps
+    void scheduleLoads() {
+        VkDeviceSize committed{retiredBytes_};
+        VkDeviceSize target{};
+        uint32_t pending{};
+        for (const auto& texture : textures_) {
+            committed += rangeSize(*texture, texture->residentMip);
+            if (texture->loading) {
+                committed += rangeSize(*texture, texture->targetMip);
+                ++pending;
+            }
+            target += rangeSize(*texture, texture->targetMip);
+        }
+
+        auto evict{[&](Texture& victim) {
+            committed += rangeSize(victim, victim.targetMip + 1);
+            target -= rangeSize(victim, victim.targetMip) -
+                      rangeSize(victim, victim.targetMip + 1);
+            queueLoad(victim, victim.targetMip + 1);
+            ++pending;
+        }};
+
+        // Budget may have been exceeded by mip tails
+        while (target > config_.budget && pending < maxPendingLoads()) {
+            Texture* victim{findEvictionVictim(UINT64_MAX)};
+            if (victim == nullptr) {
+                break;
+            }
+            evict(*victim);
+        }
+
+        while (pending < maxPendingLoads()) {
+            Texture* texture{findUpgradeCandidate()};
+            if (texture == nullptr) {
+                return;
+            }
+
+            uint32_t first_mip{nextFinerMip(*texture)};
+            VkDeviceSize size{rangeSize(*texture, first_mip)};
+            VkDeviceSize growth{size - rangeSize(*texture, texture->targetMip)};
+            bool tail{texture->targetMip == texture->mipLevels};
+            if (!tail && target + growth > config_.budget) {
+                // Only strictly less recently used textures give up mips, so
+                // two textures never swap mips back and forth
+                Texture* victim{findEvictionVictim(texture->lastUsedFrame)};
+                if (victim == nullptr) {
+                    return;
+                }
+                evict(*victim);
+                continue;
+            }
+            // Wait until retired images are destroyed
+            if (!tail && committed + size > config_.budget) {
+                return;
+            }
+
+            committed += size;
+            target += growth;
+            queueLoad(*texture, first_mip);
+            ++pending;
+        }
+    }
+    uint32_t maxPendingLoads() const {
+        return 2 * static_cast<uint32_t>(loaders_.size());
+    }
+    // Most recently used idle texture, then the coarsest one. Textures which
+    // are no longer used would otherwise win as soon as they are evicted
+    Texture* findUpgradeCandidate() {
+        Texture* best{};
+        for (const auto& texture : textures_) {
+            if (texture->loading || texture->targetMip == 0) {
+                continue;
+            }
+            if (best == nullptr ||
+                texture->lastUsedFrame > best->lastUsedFrame ||
+                (texture->lastUsedFrame == best->lastUsedFrame &&
+                 texture->targetMip > best->targetMip)) {
+                best = texture.get();
+            }
+        }
+        return best;
+    }
+    // Idle texture used before used_before_frame with mips finer than its
+    // tail. Least recently used, then finest
+    Texture* findEvictionVictim(uint64_t used_before_frame) {
+        Texture* best{};
+        for (const auto& texture : textures_) {
+            if (texture->loading || texture->targetMip >= texture->tailMip ||
+                texture->lastUsedFrame >= used_before_frame) {
+                continue;
+            }
+            if (best == nullptr ||
+                texture->lastUsedFrame < best->lastUsedFrame ||
+                (texture->lastUsedFrame == best->lastUsedFrame &&
+                 texture->targetMip < best->targetMip)) {
+                best = texture.get();
+            }
+        }
+        return best;
+    }
+    void queueLoad(Texture& texture, uint32_t first_mip) {
+        texture.loading = true;
+        texture.targetMip = first_mip;
+        {
+            std::lock_guard lock{mutex_};
+            jobs_.push_back({&texture, first_mip});
+        }
+        jobReady_.notify_one();
+    }
+
+    Image createImage(const Texture& texture, uint32_t first_mip) {
+        VkImageCreateInfo image_info{};
+        image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        image_info.imageType = VK_IMAGE_TYPE_2D;
+        image_info.format = texture.format;
+        image_info.extent = {mipWidth(texture, first_mip),
+                             mipHeight(texture, first_mip), 1};
+        image_info.mipLevels = texture.mipLevels - first_mip;
+        image_info.arrayLayers = 1;
+        image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+        image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+        image_info.usage =
+            VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+        image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        Image image{};
+        if (vkCreateImage(device_, &image_info, nullptr, &image.image) !=
+            VK_SUCCESS) {
+            throw std::runtime_error{"Failed to create texture image!"};
+        }
+        image.memory = allocator_.allocateForImage(
+            image.image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        VkImageViewCreateInfo view_info{};
+        view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        view_info.image = image.image;
+        view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        view_info.format = texture.format;
+        view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        view_info.subresourceRange.baseMipLevel = 0;
+        view_info.subresourceRange.levelCount = image_info.mipLevels;
+        view_info.subresourceRange.baseArrayLayer = 0;
+        view_info.subresourceRange.layerCount = 1;
+
+        if (vkCreateImageView(device_, &view_info, nullptr, &image.view) !=
+            VK_SUCCESS) {
+            destroyImage(image);
+            throw std::runtime_error{"Failed to create texture image view!"};
+        }
+        return image;
+    }
+    void destroyImage(const Image& image) {
+        vkDestroyImageView(device_, image.view, nullptr);
+        vkDestroyImage(device_, image.image, nullptr);
+        if (image.memory.memory != VK_NULL_HANDLE) {
+            allocator_.free(image.memory);
+        }
+    }
+
+    VkDevice device_;
+    VkPhysicalDevice physicalDevice_;
+    DeviceMemoryAllocator& allocator_;
+    UploadManager& uploads_;
+    BindlessHeap& heap_;
+    Features features_;
+    Config config_;
+
+    std::vector<std::unique_ptr<Texture>> textures_{};
+    std::vector<Retired> retired_{};
+    VkDeviceSize retiredBytes_{};
+    uint64_t loadedMips_{};
+    uint64_t evictedMips_{};
+
+    // Guards jobs_ and finished_
+    std::mutex mutex_{};
+    std::condition_variable_any jobReady_{};
+    std::deque<LoadJob> jobs_{};
+    std::deque<LoadResult> finished_{};
+
+    // Declared last, so they are started after everything they use
+    std::vector<std::jthread> loaders_{};
+};
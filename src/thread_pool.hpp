@@ -0,0 +1,106 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed size pool of worker threads for fork-join jobs.
+// Every job runs once on each worker, and caller blocks until all of them are
+// done. Worker index lets jobs pick per thread resources (e.g. command pools)
+// without any locking.
+class ThreadPool {
+   public:
+    explicit ThreadPool(uint32_t thread_count) {
+        workers_.reserve(thread_count);
+        for (uint32_t i{}; i < thread_count; ++i) {
+            workers_.emplace_back([this, i] { workerLoop(i); });
+        }
+    }
+    ~ThreadPool() {
+        {
+            std::lock_guard lock{mutex_};
+            stop_ = true;
+        }
+        jobReady_.notify_all();
+        // std::jthread joins on destruction
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    ThreadPool(ThreadPool&&) = delete;
+    ThreadPool& operator=(ThreadPool&&) = delete;
+
+    uint32_t size() const { return static_cast<uint32_t>(workers_.size()); }
+
+    // Run job(worker_index) on every worker and wait for all of them.
+    // Rethrows the first exception thrown by a job
+    void runOnAll(const std::function<void(uint32_t)>& job) {
+        std::unique_lock lock{mutex_};
+        job_ = &job;
+        pending_ = size();
+        error_ = nullptr;
+        ++generation_;
+        jobReady_.notify_all();
+
+        jobDone_.wait(lock, [this] { return pending_ == 0; });
+        job_ = nullptr;
+
+        if (error_) {
+            std::rethrow_exception(error_);
+        }
+    }
+
+   private:
+    void workerLoop(uint32_t worker_index) {
+        uint64_t seen_generation{};
+
+        while (true) {
+            const std::function<void(uint32_t)>* job{};
+            {
+                std::unique_lock lock{mutex_};
+                jobReady_.wait(lock, [this, seen_generation] {
+                    return stop_ || generation_ != seen_generation;
+                });
+                if (stop_) {
+                    return;
+                }
+                seen_generation = generation_;
+                job = job_;
+            }
+
+            std::exception_ptr error{};
+            try {
+                (*job)(worker_index);
+            } catch (...) {
+                error = std::current_exception();
+            }
+
+            {
+                std::lock_guard lock{mutex_};
+                if (error && !error_) {
+                    error_ = error;
+                }
+                if (--pending_ == 0) {
+                    jobDone_.notify_one();
+                }
+            }
+        }
+    }
+
+    std::mutex mutex_{};
+    std::condition_variable jobReady_{};
+    std::condition_variable jobDone_{};
+    const std::function<void(uint32_t)>* job_{nullptr};
+    uint64_t generation_{};
+    uint32_t pending_{};
+    std::exception_ptr error_{};
+    bool stop_{};
+
+    // Declared last, so workers are joined before the state they use is
+    // destroyed
+    std::vector<std::jthread> workers_{};
+};
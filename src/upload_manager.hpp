@@ -0,0 +1,580 @@
+#pragma once
+
+#include <vulkan/vulkan_core.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+#include "device_memory_allocator.hpp"
+
+// Streams buffer and image data to device local memory.
+// Data is copied into a persistently mapped staging ring buffer and copy
+// commands are batched into one command buffer until flush(). Batches run on
+// a dedicated transfer queue when the device has one, so large uploads do not
+// stall rendering. Ownership of uploaded resources is then released by the
+// transfer queue family and acquired by the graphics queue family.
+//
+// upload*() may be called from any thread. flush() submits to the graphics
+// queue, so it must be called from the thread which renders. When the
+// batch being recorded fills the whole staging ring, upload*() submits its
+// copies to the transfer queue and waits for them. Without a dedicated
+// family that is the graphics queue, so uploads must then not race with
+// frame submits, i.e. happen during init or on the render thread.
+class UploadManager {
+   public:
+    static constexpr VkDeviceSize kDefaultStagingSize{32ULL * 1024 * 1024};
+
+    UploadManager(VkDevice device, DeviceMemoryAllocator& allocator,
+                  VkQueue transfer_queue, uint32_t transfer_family,
+                  uint32_t graphics_family,
+                  VkDeviceSize staging_size = kDefaultStagingSize)
+        : device_{device},
+          allocator_{allocator},
+          transferQueue_{transfer_queue},
+          transferFamily_{transfer_family},
+          graphicsFamily_{graphics_family},
+          stagingSize_{staging_size} {
+        VkBufferCreateInfo buffer_info{};
+        buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        buffer_info.size = stagingSize_;
+        buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+        buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        if (vkCreateBuffer(device_, &buffer_info, nullptr, &stagingBuffer_) !=
+            VK_SUCCESS) {
+            throw std::runtime_error{"Failed to create staging buffer!"};
+        }
+        stagingMemory_ = allocator_.allocateForBuffer(
+            stagingBuffer_, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+        transferPool_ = createCommandPool(transferFamily_);
+        graphicsPool_ = hasDedicatedQueue()
+                            ? createCommandPool(graphicsFamily_)
+                            : VK_NULL_HANDLE;
+    }
+    ~UploadManager() {
+        while (!batches_.empty()) {
+            retireOldestBatch();
+        }
+        if (current_.commandBuffer != VK_NULL_HANDLE) {
+            vkEndCommandBuffer(current_.commandBuffer);
+        }
+
+        vkDestroyCommandPool(device_, transferPool_, nullptr);
+        vkDestroyCommandPool(device_, graphicsPool_, nullptr);
+        vkDestroyBuffer(device_, stagingBuffer_, nullptr);
+        allocator_.free(stagingMemory_);
+    }
+
+    UploadManager(const UploadManager&) = delete;
+    UploadManager& operator=(const UploadManager&) = delete;
+    UploadManager(UploadManager&&) = delete;
+    UploadManager& operator=(UploadManager&&) = delete;
+
+    // Whether uploads run on a transfer only queue family
+    bool hasDedicatedQueue() const { return transferFamily_ != graphicsFamily_; }
+
+    // Copy data into dst. Once flushed, data is visible to dst_access in
+    // dst_stage of graphics queue. Buffer must use exclusive sharing mode.
+    // Data is copied in chunks of at most half the staging ring, so uploads
+    // of any size fit
+    void uploadBuffer(VkBuffer dst, VkDeviceSize dst_offset, const void* data,
+                      VkDeviceSize size, VkPipelineStageFlags dst_stage,
+                      VkAccessFlags dst_access) {
+        std::lock_guard lock{mutex_};
+
+        const auto* bytes{static_cast<const char*>(data)};
+        for (VkDeviceSize done{}; done < size;) {
+            VkDeviceSize chunk{std::min(size - done, stagingSize_ / 2)};
+            VkDeviceSize staging_offset{allocateStaging(chunk, kCopyAlignment)};
+            std::memcpy(static_cast<char*>(stagingMemory_.mapped) +
+                            staging_offset,
+                        bytes + done, chunk);
+
+            VkBufferCopy region{};
+            region.srcOffset = staging_offset;
+            region.dstOffset = dst_offset + done;
+            region.size = chunk;
+            vkCmdCopyBuffer(currentCommandBuffer(), stagingBuffer_, dst, 1,
+                            &region);
+
+            done += chunk;
+        }
+
+        VkBufferMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = dst_access;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.buffer = dst;
+        barrier.offset = dst_offset;
+        barrier.size = size;
+        addBufferBarrier(barrier, dst_stage);
+    }
+    // Copy tightly packed texel data into one subresource of dst and
+    // transition it to final_layout. Previous contents are discarded.
+    // Image must use exclusive sharing mode. Subresources larger than half
+    // the staging ring are copied in bands of texel block rows, block_height
+    // being the texel block height of the image format
+    void uploadImage(VkImage dst, const VkImageSubresourceLayers& subresource,
+                     VkExtent3D extent, const void* data, VkDeviceSize size,
+                     VkImageLayout final_layout, VkPipelineStageFlags dst_stage,
+                     VkAccessFlags dst_access, uint32_t block_height = 1) {
+        uint32_t block_rows{(extent.height + block_height - 1) / block_height};
+        VkDeviceSize row_count{VkDeviceSize{block_rows} * extent.depth *
+                               subresource.layerCount};
+        if (row_count == 0 || size % row_count != 0) {
+            throw std::runtime_error{"Image data does not match extent!"};
+        }
+        // Bands of a 3D image are whole depth slices. Bands never cross
+        // array layers
+        bool slices{extent.depth > 1};
+        VkDeviceSize layer_size{size / subresource.layerCount};
+        VkDeviceSize band_unit{slices ? layer_size / extent.depth
+                                      : layer_size / block_rows};
+        uint32_t unit_count{slices ? extent.depth : block_rows};
+        if (band_unit > stagingSize_ / 2) {
+            throw std::runtime_error{"Image row does not fit staging ring!"};
+        }
+        auto units_per_band{static_cast<uint32_t>(
+            std::min<VkDeviceSize>(stagingSize_ / 2 / band_unit, unit_count))};
+
+        std::lock_guard lock{mutex_};
+
+        VkImageSubresourceRange range{};
+        range.aspectMask = subresource.aspectMask;
+        range.baseMipLevel = subresource.mipLevel;
+        range.levelCount = 1;
+        range.baseArrayLayer = subresource.baseArrayLayer;
+        range.layerCount = subresource.layerCount;
+
+        VkImageMemoryBarrier to_transfer{};
+        to_transfer.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        to_transfer.srcAccessMask = 0;
+        to_transfer.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        to_transfer.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        to_transfer.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        to_transfer.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        to_transfer.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        to_transfer.image = dst;
+        to_transfer.subresourceRange = range;
+        vkCmdPipelineBarrier(currentCommandBuffer(),
+                             VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+                             nullptr, 1, &to_transfer);
+
+        const auto* bytes{static_cast<const char*>(data)};
+        for (uint32_t layer{}; layer < subresource.layerCount; ++layer) {
+            const char* layer_bytes{bytes + layer_size * layer};
+            for (uint32_t first{}; first < unit_count;
+                 first += units_per_band) {
+                uint32_t count{std::min(units_per_band, unit_count - first)};
+                VkDeviceSize band_size{band_unit * count};
+                VkDeviceSize staging_offset{
+                    allocateStaging(band_size, kCopyAlignment)};
+                std::memcpy(
+                    static_cast<char*>(stagingMemory_.mapped) + staging_offset,
+                    layer_bytes + band_unit * first, band_size);
+
+                VkBufferImageCopy region{};
+                region.bufferOffset = staging_offset;
+                region.bufferRowLength = 0;
+                region.bufferImageHeight = 0;
+                region.imageSubresource = subresource;
+                region.imageSubresource.baseArrayLayer += layer;
+                region.imageSubresource.layerCount = 1;
+                if (slices) {
+                    region.imageOffset = {0, 0, static_cast<int32_t>(first)};
+                    region.imageExtent = {extent.width, extent.height, count};
+                } else {
+                    // Last band may end in a partial block row
+                    uint32_t y{first * block_height};
+                    region.imageOffset = {0, static_cast<int32_t>(y), 0};
+                    region.imageExtent = {
+                        extent.width,
+                        std::min(count * block_height, extent.height - y), 1};
+                }
+                vkCmdCopyBufferToImage(currentCommandBuffer(), stagingBuffer_,
+                                       dst,
+                                       VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1,
+                                       &region);
+            }
+        }
+
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = dst_access;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = final_layout;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = dst;
+        barrier.subresourceRange = range;
+        addImageBarrier(barrier, dst_stage);
+    }
+
+    // Submit recorded uploads. Graphics queue work submitted after this call
+    // sees uploaded data. Does nothing if nothing was recorded
+    void flush(VkQueue graphics_queue) {
+        std::lock_guard lock{mutex_};
+
+        retireCompletedBatches();
+        if (current_.commandBuffer == VK_NULL_HANDLE) {
+            // Copies already ran when the ring filled up, only handing them
+            // over to graphics family may be left
+            if (!current_.acquireBufferBarriers.empty() ||
+                !current_.acquireImageBarriers.empty()) {
+                Batch batch{std::move(current_)};
+                current_ = {};
+                submitAcquire(batch, graphics_queue);
+                batch.stagingEnd = stagingHead_;
+                batches_.push_back(std::move(batch));
+            }
+            return;
+        }
+
+        Batch batch{std::move(current_)};
+        current_ = {};
+        endTransferCommands(batch);
+
+        batch.transferFence = createFence();
+        if (hasDedicatedQueue()) {
+            VkSemaphoreCreateInfo semaphore_info{};
+            semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+            if (vkCreateSemaphore(device_, &semaphore_info, nullptr,
+                                  &batch.semaphore) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to create semaphores!");
+            }
+        }
+
+        VkSubmitInfo submit_info{};
+        submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submit_info.commandBufferCount = 1;
+        submit_info.pCommandBuffers = &batch.commandBuffer;
+        submit_info.signalSemaphoreCount = hasDedicatedQueue() ? 1 : 0;
+        submit_info.pSignalSemaphores = &batch.semaphore;
+
+        // Without a dedicated family transfer queue is the graphics queue
+        VkQueue transfer_queue{hasDedicatedQueue() ? transferQueue_
+                                                   : graphics_queue};
+        if (vkQueueSubmit(transfer_queue, 1, &submit_info,
+                          batch.transferFence) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to submit upload commands!");
+        }
+
+        if (hasDedicatedQueue()) {
+            submitAcquire(batch, graphics_queue);
+        }
+
+        batch.stagingEnd = stagingHead_;
+        batches_.push_back(std::move(batch));
+    }
+
+    // Wait until every flushed upload has completed
+    void waitIdle() {
+        std::lock_guard lock{mutex_};
+        while (!batches_.empty()) {
+            retireOldestBatch();
+        }
+    }
+
+   private:
+    // Satisfies optimalBufferCopyOffsetAlignment on common hardware and texel
+    // block size of every format
+    static constexpr VkDeviceSize kCopyAlignment{16};
+
+    struct Batch {
+        VkCommandBuffer commandBuffer{VK_NULL_HANDLE};
+        // Graphics family command buffer with acquire barriers
+        VkCommandBuffer acquireCommandBuffer{VK_NULL_HANDLE};
+        VkSemaphore semaphore{VK_NULL_HANDLE};
+        VkFence transferFence{VK_NULL_HANDLE};
+        VkFence acquireFence{VK_NULL_HANDLE};
+        VkPipelineStageFlags dstStages{};
+        std::vector<VkBufferMemoryBarrier> releaseBufferBarriers{};
+        std::vector<VkImageMemoryBarrier> releaseImageBarriers{};
+        std::vector<VkBufferMemoryBarrier> acquireBufferBarriers{};
+        std::vector<VkImageMemoryBarrier> acquireImageBarriers{};
+        // Staging ring position after this batch
+        VkDeviceSize stagingEnd{};
+    };
+
+    VkCommandPool createCommandPool(uint32_t queue_family) {
+        VkCommandPoolCreateInfo pool_info{};
+        pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        pool_info.queueFamilyIndex = queue_family;
+
+        VkCommandPool command_pool{};
+        if (vkCreateCommandPool(device_, &pool_info, nullptr, &command_pool) !=
+            VK_SUCCESS) {
+            throw std::runtime_error("Failed to create command pool!");
+        }
+
+        return command_pool;
+    }
+    VkCommandBuffer beginCommandBuffer(VkCommandPool command_pool) {
+        VkCommandBufferAllocateInfo alloc_info{};
+        alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        alloc_info.commandPool = command_pool;
+        alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        alloc_info.commandBufferCount = 1;
+
+        VkCommandBuffer command_buffer{};
+        if (vkAllocateCommandBuffers(device_, &alloc_info, &command_buffer) !=
+            VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate command buffers!");
+        }
+
+        VkCommandBufferBeginInfo begin_info{};
+        begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+        if (vkBeginCommandBuffer(command_buffer, &begin_info) != VK_SUCCESS) {
+            throw std::runtime_error(
+                "Failed to begin recording command buffer!");
+        }
+
+        return command_buffer;
+    }
+    VkFence createFence() {
+        VkFenceCreateInfo fence_info{};
+        fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+        VkFence fence{};
+        if (vkCreateFence(device_, &fence_info, nullptr, &fence) !=
+            VK_SUCCESS) {
+            throw std::runtime_error("Failed to create fence!");
+        }
+
+        return fence;
+    }
+
+    // Release barriers on transfer queue. With a single queue family these
+    // are the only barriers and make data visible to graphics stages
+    void endTransferCommands(Batch& batch) {
+        VkPipelineStageFlags release_dst_stage{batch.dstStages};
+        if (hasDedicatedQueue()) {
+            release_dst_stage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+        }
+        vkCmdPipelineBarrier(
+            batch.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            release_dst_stage, 0, 0, nullptr,
+            static_cast<uint32_t>(batch.releaseBufferBarriers.size()),
+            batch.releaseBufferBarriers.data(),
+            static_cast<uint32_t>(batch.releaseImageBarriers.size()),
+            batch.releaseImageBarriers.data());
+        if (vkEndCommandBuffer(batch.commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to record upload commands!");
+        }
+    }
+    // Whole ring belongs to the batch being recorded. Its copies are
+    // submitted and waited for here, so the ring can be reused. Acquire
+    // barriers stay in current_ for the next flush(). Later copies into the
+    // same resources are ordered after these by submission order
+    void submitCurrentAndWait() {
+        endTransferCommands(current_);
+
+        VkFence fence{createFence()};
+        VkSubmitInfo submit_info{};
+        submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submit_info.commandBufferCount = 1;
+        submit_info.pCommandBuffers = &current_.commandBuffer;
+        if (vkQueueSubmit(transferQueue_, 1, &submit_info, fence) !=
+            VK_SUCCESS) {
+            vkDestroyFence(device_, fence, nullptr);
+            throw std::runtime_error("Failed to submit upload commands!");
+        }
+        vkWaitForFences(device_, 1, &fence, VK_TRUE, UINT64_MAX);
+        vkDestroyFence(device_, fence, nullptr);
+
+        vkFreeCommandBuffers(device_, transferPool_, 1,
+                             &current_.commandBuffer);
+        current_.commandBuffer = VK_NULL_HANDLE;
+        current_.releaseBufferBarriers.clear();
+        current_.releaseImageBarriers.clear();
+        // Ring is empty now, start over at its beginning
+        stagingHead_ = (stagingHead_ + stagingSize_ - 1) / stagingSize_ *
+                       stagingSize_;
+        stagingTail_ = stagingHead_;
+    }
+
+    VkCommandBuffer currentCommandBuffer() {
+        if (current_.commandBuffer == VK_NULL_HANDLE) {
+            current_.commandBuffer = beginCommandBuffer(transferPool_);
+        }
+
+        return current_.commandBuffer;
+    }
+
+    // With a dedicated transfer family barrier is split into a release on
+    // transfer queue and a matching acquire on graphics queue
+    void addBufferBarrier(VkBufferMemoryBarrier barrier,
+                          VkPipelineStageFlags dst_stage) {
+        current_.dstStages |= dst_stage;
+        if (!hasDedicatedQueue()) {
+            current_.releaseBufferBarriers.push_back(barrier);
+            return;
+        }
+
+        barrier.srcQueueFamilyIndex = transferFamily_;
+        barrier.dstQueueFamilyIndex = graphicsFamily_;
+
+        VkBufferMemoryBarrier release{barrier};
+        release.dstAccessMask = 0;
+        current_.releaseBufferBarriers.push_back(release);
+
+        VkBufferMemoryBarrier acquire{barrier};
+        acquire.srcAccessMask = 0;
+        current_.acquireBufferBarriers.push_back(acquire);
+    }
+    void addImageBarrier(VkImageMemoryBarrier barrier,
+                         VkPipelineStageFlags dst_stage) {
+        current_.dstStages |= dst_stage;
+        if (!hasDedicatedQueue()) {
+            current_.releaseImageBarriers.push_back(barrier);
+            return;
+        }
+
+        barrier.srcQueueFamilyIndex = transferFamily_;
+        barrier.dstQueueFamilyIndex = graphicsFamily_;
+
+        VkImageMemoryBarrier release{barrier};
+        release.dstAccessMask = 0;
+        current_.releaseImageBarriers.push_back(release);
+
+        VkImageMemoryBarrier acquire{barrier};
+        acquire.srcAccessMask = 0;
+        current_.acquireImageBarriers.push_back(acquire);
+    }
+
+    // Acquire ownership on graphics queue once transfer queue is done.
+    // Pipeline barrier's second scope covers everything later in submission
+    // order, so subsequent frames see uploaded data
+    void submitAcquire(Batch& batch, VkQueue graphics_queue) {
+        batch.acquireCommandBuffer = beginCommandBuffer(graphicsPool_);
+        vkCmdPipelineBarrier(
+            batch.acquireCommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+            batch.dstStages, 0, 0, nullptr,
+            static_cast<uint32_t>(batch.acquireBufferBarriers.size()),
+            batch.acquireBufferBarriers.data(),
+            static_cast<uint32_t>(batch.acquireImageBarriers.size()),
+            batch.acquireImageBarriers.data());
+        if (vkEndCommandBuffer(batch.acquireCommandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to record upload commands!");
+        }
+
+        batch.acquireFence = createFence();
+
+        VkPipelineStageFlags wait_stage{VK_PIPELINE_STAGE_ALL_COMMANDS_BIT};
+        VkSubmitInfo submit_info{};
+        submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        // No semaphore if copies were already waited for on the host
+        submit_info.waitSemaphoreCount =
+            batch.semaphore != VK_NULL_HANDLE ? 1 : 0;
+        submit_info.pWaitSemaphores = &batch.semaphore;
+        submit_info.pWaitDstStageMask = &wait_stage;
+        submit_info.commandBufferCount = 1;
+        submit_info.pCommandBuffers = &batch.acquireCommandBuffer;
+
+        if (vkQueueSubmit(graphics_queue, 1, &submit_info,
+                          batch.acquireFence) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to submit upload commands!");
+        }
+    }
+
+    // Reserve size bytes of staging ring. Ring positions grow monotonically;
+    // physical offset is position modulo ring size. Waits for the oldest
+    // batches when ring is full, and for the batch being recorded when it
+    // fills the ring alone
+    VkDeviceSize allocateStaging(VkDeviceSize size, VkDeviceSize alignment) {
+        VkDeviceSize head{(stagingHead_ + alignment - 1) / alignment *
+                          alignment};
+        // Allocation must not wrap around the end of the ring
+        if (head % stagingSize_ + size > stagingSize_) {
+            head += stagingSize_ - head % stagingSize_;
+        }
+
+        while (head + size - stagingTail_ > stagingSize_) {
+            if (batches_.empty()) {
+                submitCurrentAndWait();
+                head = stagingHead_;
+                break;
+            }
+            retireOldestBatch();
+        }
+
+        stagingHead_ = head + size;
+        return head % stagingSize_;
+    }
+
+    void retireCompletedBatches() {
+        while (!batches_.empty() &&
+               (batches_.front().transferFence == VK_NULL_HANDLE ||
+                vkGetFenceStatus(device_, batches_.front().transferFence) ==
+                    VK_SUCCESS) &&
+               (batches_.front().acquireFence == VK_NULL_HANDLE ||
+                vkGetFenceStatus(device_, batches_.front().acquireFence) ==
+                    VK_SUCCESS)) {
+            retireOldestBatch();
+        }
+    }
+    void retireOldestBatch() {
+        Batch& batch{batches_.front()};
+
+        // Batches left after a full ring have an acquire fence alone
+        std::vector<VkFence> fences{};
+        for (VkFence fence : {batch.transferFence, batch.acquireFence}) {
+            if (fence != VK_NULL_HANDLE) {
+                fences.push_back(fence);
+            }
+        }
+        vkWaitForFences(device_, static_cast<uint32_t>(fences.size()),
+                        fences.data(), VK_TRUE, UINT64_MAX);
+
+        if (batch.commandBuffer != VK_NULL_HANDLE) {
+            vkFreeCommandBuffers(device_, transferPool_, 1,
+                                 &batch.commandBuffer);
+        }
+        if (batch.acquireCommandBuffer != VK_NULL_HANDLE) {
+            vkFreeCommandBuffers(device_, graphicsPool_, 1,
+                                 &batch.acquireCommandBuffer);
+        }
+        vkDestroyFence(device_, batch.transferFence, nullptr);
+        vkDestroyFence(device_, batch.acquireFence, nullptr);
+        vkDestroySemaphore(device_, batch.semaphore, nullptr);
+
+        stagingTail_ = batch.stagingEnd;
+        batches_.pop_front();
+    }
+
+    VkDevice device_;
+    DeviceMemoryAllocator& allocator_;
+    VkQueue transferQueue_;
+    uint32_t transferFamily_;
+    uint32_t graphicsFamily_;
+    VkDeviceSize stagingSize_;
+
+    VkBuffer stagingBuffer_{VK_NULL_HANDLE};
+    DeviceMemoryAllocator::Allocation stagingMemory_{};
+    // Ring positions. Memory in [stagingTail_, stagingHead_) is in use
+    VkDeviceSize stagingHead_{};
+    VkDeviceSize stagingTail_{};
+
+    VkCommandPool transferPool_{VK_NULL_HANDLE};
+    VkCommandPool graphicsPool_{VK_NULL_HANDLE};
+
+    std::mutex mutex_{};
+    // Batch being recorded
+    Batch current_{};
+    // Submitted batches, oldest first
+    std::deque<Batch> batches_{};
+};